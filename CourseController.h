@@ -0,0 +1,276 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Gains for the course correction controller.
+/// </summary>
+//******************************************************************************
+struct CourseGains
+{
+    float Kp;           // Proportional gain
+    float Ki;           // Integral gain (per sample - the integral is a plain sum)
+    float Kd;           // Derivative gain (per sample - the derivative is a plain difference)
+    float alpha;        // Exponential smoothing factor applied to the gyro rate
+};
+
+
+//******************************************************************************
+/// <summary>
+/// The control law used by TaskCorrectCourse to hold the robot on a straight
+/// course.
+/// </summary>
+/// <remarks>
+/// The gyro z-axis rate is smoothed with an exponential moving average, then
+/// integrated to get the heading relative to where the controller was reset.
+/// The heading error drives a PID controller whose output is the trim applied
+/// to the right motor.
+///
+/// In heading-hold mode the heading comes from outside instead (TaskHeading,
+/// which keeps integrating through turns) and is steered back to a target
+/// that survives Reset(). The error is limited to MAX_HOLD_ERROR so coming back
+/// to the target after an avoidance turn is a gentle arc rather than a spin.
+///
+/// The correction is clamped to the limits set with SetLimits() (what the
+/// right motor can actually do at the current speed). While it is clamped the
+/// integral only moves in the direction that brings it back inside (anti-windup),
+/// and the integral term on its own never exceeds the limits.
+///
+/// This is kept separate from the task (and free of any Arduino headers) so the
+/// host-side tuning tool (Tools/PidTune.cpp) replays recorded gyro data through
+/// exactly the same arithmetic as the robot. Everything is done in float since
+/// that is what double is on the AVR.
+/// </remarks>
+//******************************************************************************
+class CourseController
+{
+    /*--------------------------------------------------------------------------
+    Constants
+    --------------------------------------------------------------------------*/
+    public: static constexpr float MAX_HOLD_ERROR = 15;    // Degrees
+
+    /*--------------------------------------------------------------------------
+    Constructors
+    --------------------------------------------------------------------------*/
+    public: CourseController(const CourseGains& gains) : _gains(gains) { Reset(); };
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+    public: void Reset()
+    {
+        _w0 = 0;
+        _h0 = 0;
+        _e0 = 0;
+        _ei = 0;
+    }
+
+    public: int16_t Update(float wz, float dt)
+    {
+        auto w1 = _gains.alpha * _w0 + (1 - _gains.alpha) * wz;
+        auto h1 = _h0 + w1 * dt;
+        auto e1 = 0 - h1;       // The current error
+
+        _w0 = w1;
+        _h0 = h1;
+
+        return Pid(e1);
+    }
+
+    /// <summary>
+    /// Heading-hold update: heading and target in degrees, +/-180. samples is
+    /// the time since the last update in nominal sample periods, so a late
+    /// update integrates (and differentiates) over the time that really passed.
+    /// </summary>
+    public: int16_t Hold(float heading, float target, float samples = 1)
+    {
+        auto e1 = target - heading;
+
+        if (e1 > 180) e1 -= 360;
+        else if (e1 < -180) e1 += 360;
+
+        if (e1 > MAX_HOLD_ERROR) e1 = MAX_HOLD_ERROR;
+        else if (e1 < -MAX_HOLD_ERROR) e1 = -MAX_HOLD_ERROR;
+
+        _h0 = heading;
+
+        return Pid(e1, samples);
+    }
+
+    public: const CourseGains& Gains() { return _gains; };
+    public: void SetGains(const CourseGains& gains) { _gains = gains; };
+    public: void SetLimits(int16_t lower, int16_t upper) { _lower = lower; _upper = upper; };
+
+    public: float W0() { return _w0; };     // Last filtered angular rate
+    public: float H0() { return _h0; };     // Last heading
+    public: float E0() { return _e0; };     // Last error
+    public: float Ei() { return _ei; };     // Accumulated error
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+    private: int16_t Pid(float e1, float samples = 1)
+    {
+        auto ei = _ei + e1 * samples;   // The accumulated error (integrated error)
+
+        // The integral term alone may not push past the limits
+        if (_gains.Ki > 0)
+        {
+            if (_gains.Ki * ei > _upper) ei = _upper / _gains.Ki;
+            else if (_gains.Ki * ei < _lower) ei = _lower / _gains.Ki;
+        }
+
+        auto correction = _gains.Kp * e1 + _gains.Ki * ei + _gains.Kd * (e1 - _e0) / samples;
+
+        // Saturated: keep the clamped output, and don't integrate further into the limit
+        if (correction > _upper)
+        {
+            correction = _upper;
+            if (e1 > 0) ei = _ei;
+        }
+        else if (correction < _lower)
+        {
+            correction = _lower;
+            if (e1 < 0) ei = _ei;
+        }
+
+        _ei = ei;
+        _e0 = e1;
+
+        return int16_t(correction);
+    }
+
+    private: CourseGains _gains;
+    private: float _w0;                 // Previous angular rate measurement
+    private: float _h0;                 // Previous heading measurement
+    private: float _e0;                 // Previous error measurement
+    private: float _ei;                 // Accumulated error
+    private: int16_t _lower = -32767;   // Correction limits
+    private: int16_t _upper = 32767;
+};
+
+
+//******************************************************************************
+/// <summary>
+/// Relay (Astrom-Hagglund) auto-tuning of the course controller gains.
+/// </summary>
+/// <remarks>
+/// In place of the PID, the correction is switched between +amplitude and
+/// -amplitude whenever the heading error crosses +/-hysteresis. The robot
+/// then weaves about the target heading in a steady oscillation whose period
+/// is the ultimate period Tu, and whose size gives the ultimate gain
+///
+///   Ku = 4 * amplitude / (pi * sqrt(a^2 - hysteresis^2))
+///
+/// where a is the peak heading error. The first cycle is skipped while the
+/// oscillation settles, then Tu and a are averaged over CYCLES cycles.
+///
+/// Gains() turns Ku and Tu into PI gains (Kp = 0.8 Ku, Ti = 8 Tu), in the
+/// per-sample form CourseGains uses. The heading is an integrating plant (the
+/// trim sets the turn rate), so the proportional term does the work of
+/// holding the course and the integral only has to take out the steady track
+/// mismatch. The rules for self-regulating plants (Ziegler-Nichols,
+/// Tyreus-Luyben) give far too little Kp and too much integral here; these
+/// ratios came out best in Tools/CorridorSim -t, at both the old 100ms period
+/// and the 10ms one the robot runs now. No derivative is used, with the gyro
+/// noise.
+/// </remarks>
+//******************************************************************************
+class RelayTuner
+{
+    /*--------------------------------------------------------------------------
+    Constants
+    --------------------------------------------------------------------------*/
+    public: static constexpr uint8_t CYCLES = 4;   // Cycles measured after the first
+
+    /*--------------------------------------------------------------------------
+    Constructors
+    --------------------------------------------------------------------------*/
+    public: RelayTuner(int16_t amplitude, float hysteresis) : _amplitude(amplitude), _hysteresis(hysteresis) {};
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+
+    /// <summary>Relay output for a heading error (degrees) at time t (seconds)</summary>
+    public: int16_t Update(float error, float t)
+    {
+        auto magnitude = error < 0 ? -error : error;
+
+        if (magnitude > _peak) _peak = magnitude;
+
+        if (_output <= 0 && error > _hysteresis)
+        {
+            // Rising switch - a full cycle since the last one, unless this
+            // ends the first (settling) cycle
+            if (_rises > 1 && !Done())
+            {
+                _periodSum += t - _lastRise;
+                _cycles++;
+                AddPeak();
+            }
+
+            if (_rises < 2) _rises++;
+
+            _lastRise = t;
+            _output = _amplitude;
+            _peak = 0;
+        }
+        else if (_output >= 0 && error < -_hysteresis)
+        {
+            if (_rises > 1 && !Done()) AddPeak();
+
+            _output = -_amplitude;
+            _peak = 0;
+        }
+
+        return _output;
+    }
+
+    public: bool Done() { return _cycles >= CYCLES; };
+
+    /// <summary>Ultimate period (seconds)</summary>
+    public: float Tu() { return _cycles > 0 ? _periodSum / _cycles : 0; };
+
+    /// <summary>Ultimate gain (correction per degree)</summary>
+    public: float Ku()
+    {
+        auto a = _peakCount > 0 ? _peakSum / _peakCount : 0;
+
+        if (a <= _hysteresis) return 0;
+
+        return 4 * _amplitude / (3.14159265f * sqrtf(a * a - _hysteresis * _hysteresis));
+    }
+
+    /// <summary>PI gains for a controller run every sampleInterval seconds</summary>
+    public: CourseGains Gains(float sampleInterval, float alpha)
+    {
+        auto Kp = 0.8f * Ku();
+        auto Ti = 8.0f * Tu();
+
+        return { Kp, Ti > 0 ? Kp * sampleInterval / Ti : 0, 0, alpha };
+    }
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+    private: void AddPeak()
+    {
+        _peakSum += _peak;
+        _peakCount++;
+    }
+
+    private: int16_t _amplitude;
+    private: float _hysteresis;
+    private: int16_t _output = 0;
+    private: uint8_t _rises = 0;        // Rising switches seen (up to 2)
+    private: uint8_t _cycles = 0;       // Cycles measured
+    private: float _lastRise = 0;
+    private: float _periodSum = 0;
+    private: float _peak = 0;           // Largest |error| in the current half cycle
+    private: float _peakSum = 0;
+    private: uint8_t _peakCount = 0;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#endif
+
+
+//******************************************************************************
+/// <summary>
+/// Compile-time event lookup tables for the state machine (see
+/// StateMachine.h).
+/// </summary>
+/// <remarks>
+/// The event IDs every state can receive are hashed into SLOTS slots with
+/// Slot(id, k) = the top bits of id * k. Multiplier() finds, at compile time,
+/// a k that puts every event in a different slot (a perfect hash). Each state
+/// then gets a byte per slot (Build()) giving the position of the first entry
+/// for that slot's event in its transition table, or NONE if it has none.
+///
+/// Looking an event up is then a 16 bit multiply and one byte read, however
+/// long the state's table is, and an event a state ignores never touches its
+/// table at all. An ID that isn't one of the events may land in another
+/// event's slot, so the caller still checks the entry's event ID.
+///
+/// C++11 constexpr functions are a single return statement, so the searches
+/// are recursive; nothing recurses more than about 2N deep for N events.
+///
+/// Everything here is free of any Arduino headers so the host-side benchmark
+/// (Tools/DispatchBench.cpp) builds exactly the same lookup as the robot. On
+/// the robot the indexes are in flash (PROGMEM) and are read with
+/// pgm_read_byte.
+/// </remarks>
+//******************************************************************************
+namespace EventIndex
+{
+    const uint8_t NONE = 0xFF;
+    const uint8_t SLOT_BITS = 6;
+    const uint8_t SLOTS = 1 << SLOT_BITS;       // About 3 per event keeps a perfect hash easy to find
+
+    template <size_t N> struct Entries { uint8_t entry[N]; };   // Table position for each slot
+
+    /// <summary>The slot for an event ID (unsigned is 16 bits on the AVR, so the multiply is too)</summary>
+    constexpr uint8_t Slot(uint16_t id, uint16_t k)
+    {
+        return uint8_t(uint16_t(unsigned(id) * k) >> (16 - SLOT_BITS));
+    }
+
+    //**************************************************************************
+    // Finding the multiplier
+    //**************************************************************************
+    template <size_t N>
+    constexpr bool Alone(const uint16_t (&ids)[N], uint16_t k, size_t i, size_t j)
+    {
+        return j >= N || (Slot(ids[i], k) != Slot(ids[j], k) && Alone(ids, k, i, j + 1));
+    }
+
+    /// <summary>True if every ID has a slot of its own</summary>
+    template <size_t N>
+    constexpr bool Distinct(const uint16_t (&ids)[N], uint16_t k, size_t i = 0)
+    {
+        return i >= N || (Alone(ids, k, i, i + 1) && Distinct(ids, k, i + 1));
+    }
+
+    // Odd multipliers 64 * block + 2 * i + 1, i = 0..31
+    template <size_t N>
+    constexpr uint16_t MultiplierIn(const uint16_t (&ids)[N], uint16_t block, uint16_t i = 0)
+    {
+        return i >= 32 ? 0
+             : Distinct(ids, 64 * block + 2 * i + 1) ? 64 * block + 2 * i + 1
+             : MultiplierIn(ids, block, i + 1);
+    }
+
+    /// <summary>The smallest odd k below 2048 that gives a perfect hash, or 0 if there is none</summary>
+    template <size_t N>
+    constexpr uint16_t Multiplier(const uint16_t (&ids)[N], uint16_t block = 0)
+    {
+        return block >= 32 ? 0
+             : MultiplierIn(ids, block) != 0 ? MultiplierIn(ids, block)
+             : Multiplier(ids, block + 1);
+    }
+
+    //**************************************************************************
+    // A state's index into its transition table (any array of entries with
+    // an EventID member)
+    //**************************************************************************
+
+    // Position of the first entry for an event in slot s, or NONE
+    template <class E, size_t N>
+    constexpr uint8_t First(const E (&table)[N], uint16_t k, uint8_t s, size_t i = 0)
+    {
+        return i >= N ? NONE : Slot(table[i].EventID, k) == s ? uint8_t(i) : First(table, k, s, i + 1);
+    }
+
+    template <size_t... S> struct Sequence {};
+    template <size_t N, size_t... S> struct MakeSequence : MakeSequence<N - 1, N - 1, S...> {};
+    template <size_t... S> struct MakeSequence<0, S...> { typedef Sequence<S...> Type; };
+
+    template <class E, size_t N, size_t... S>
+    constexpr Entries<SLOTS> Build(const E (&table)[N], uint16_t k, Sequence<S...>)
+    {
+        return {{ First(table, k, uint8_t(S))... }};
+    }
+
+    /// <summary>The first table entry for each slot</summary>
+    template <class E, size_t N>
+    constexpr Entries<SLOTS> Build(const E (&table)[N], uint16_t k)
+    {
+        static_assert(N < NONE, "EventIndex: too many entries for a byte index");
+
+        return Build(table, k, typename MakeSequence<SLOTS>::Type());
+    }
+
+    //**************************************************************************
+    // Run-time lookup
+    //**************************************************************************
+
+    /// <summary>
+    /// Position of the first table entry for an event (index in flash on the
+    /// robot), or NONE. The entry may be for another event if the ID isn't
+    /// one of the hashed events.
+    /// </summary>
+    inline uint8_t Find(const Entries<SLOTS>& index, uint16_t k, uint16_t id)
+    {
+#ifdef __AVR__
+        return pgm_read_byte(&index.entry[Slot(id, k)]);
+#else
+        return index.entry[Slot(id, k)];
+#endif
+    }
+}
@@ -0,0 +1,114 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+
+#include <RTL_Stdlib.h>
+#include "EventLanes.h"
+
+
+DEFINE_CLASSNAME(EventLanes);
+
+EventLanes::LaneQueue EventLanes::_lanes[EventLanes::LANE_COUNT];
+uint16_t EventLanes::_coalesced = 0;
+
+
+bool EventLanes::Queue(EventSource& source, uint16_t eventID, variant_t data, Lane lane, bool coalesce)
+{
+    auto& queue = _lanes[lane];
+
+    if (coalesce)
+    {
+        for (uint8_t i = 0; i < queue.count; i++)
+        {
+            auto& pending = queue.events[(queue.head + i) % LANE_SIZE];
+
+            if (pending.pSource == &source && pending.eventID == eventID)
+            {
+                pending.data = data;
+                _coalesced++;
+                return true;
+            }
+        }
+    }
+
+    if (queue.count >= LANE_SIZE)
+    {
+        queue.overflows++;
+        TRACE(Logger(_classname_) << F("Lane ") << lane << F(" overflow, event=0x") << _HEX(eventID) << endl);
+        return false;
+    }
+
+    auto& pending = queue.events[(queue.head + queue.count) % LANE_SIZE];
+
+    pending.pSource = &source;
+    pending.eventID = eventID;
+    pending.data = data;
+
+    if (++queue.count > queue.highWater) queue.highWater = queue.count;
+
+    return true;
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Moves pending events into the EventQueue. Called once per pass through the
+/// main loop, just before TaskManager::Dispatch().
+/// </summary>
+//******************************************************************************
+void EventLanes::Dispatch()
+{
+    auto& urgent = _lanes[URGENT];
+
+    // All urgent events go first, until the EventQueue is full
+    while (urgent.count > 0)
+    {
+        if (!Forward(urgent)) return;
+    }
+
+    // Then at most one normal event per pass
+    Forward(_lanes[NORMAL]);
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Prints the pending count, high-water mark, overflows and EventQueue
+/// refusals for each lane, and the number of coalesced events.
+/// </summary>
+//******************************************************************************
+void EventLanes::Report()
+{
+    for (uint8_t i = 0; i < LANE_COUNT; i++)
+    {
+        auto& lane = _lanes[i];
+
+        Logger(_classname_) << (i == URGENT ? F("urgent") : F("normal")) << F(": pending=") << lane.count
+                            << F(", highWater=") << lane.highWater << F("/") << LANE_SIZE
+                            << F(", overflows=") << lane.overflows << F(", refused=") << lane.refused << endl;
+    }
+
+    Logger(_classname_) << F("coalesced=") << _coalesced << endl;
+}
+
+
+// Forwards the event at the front of a lane. If the EventQueue is full the
+// event is left where it is for the next pass.
+bool EventLanes::Forward(LaneQueue& lane)
+{
+    if (lane.count == 0) return false;
+
+    auto& pending = lane.events[lane.head];
+
+    if (!EventQueue::Queue(*pending.pSource, pending.eventID, pending.data))
+    {
+        lane.refused++;
+        TRACE(Logger(_classname_) << F("EventQueue full, event=0x") << _HEX(pending.eventID) << endl);
+        return false;
+    }
+
+    lane.head = (lane.head + 1) % LANE_SIZE;
+    lane.count--;
+
+    return true;
+}
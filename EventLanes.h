@@ -0,0 +1,89 @@
+#pragma once
+
+#include <RTL_Stdlib.h>
+#include <EventQueue.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Priority lanes in front of the event queue.
+/// </summary>
+/// <remarks>
+/// The library EventQueue is a single FIFO, so a safety-critical event (e.g. a
+/// cliff edge from the step sensor) can end up waiting behind a backlog of
+/// repeated proximity events. Sensor tasks post their events here instead,
+/// choosing a lane:
+///
+///   URGENT - Safety events. Forwarded to the EventQueue before anything else.
+///   NORMAL - Everything else. Forwarded one at a time, and only when the urgent
+///            lane is empty, so the EventQueue never builds up a backlog that
+///            an urgent event would have to wait behind.
+///
+/// An event can optionally be coalesced: if an event with the same ID from the
+/// same source is already waiting in the lane, its data is updated in place
+/// instead of queuing a duplicate.
+///
+/// If the EventQueue is full, the event stays at the front of its lane and
+/// forwarding stops until the next pass, so nothing is lost unless the lane
+/// itself overflows. Every event a task posts goes through the lanes, so the
+/// EventQueue only ever holds what the lanes have let through.
+///
+/// High-water marks, overflow counts and EventQueue refusals are kept for each
+/// lane so the lane sizes can be checked against real workloads. Report()
+/// prints them; it is triggered by sending 'e' on the serial port.
+/// </remarks>
+//******************************************************************************
+class EventLanes
+{
+    DECLARE_CLASSNAME;
+
+    /*--------------------------------------------------------------------------
+    Lanes
+    --------------------------------------------------------------------------*/
+    public: enum Lane : uint8_t
+    {
+        URGENT = 0,
+        NORMAL = 1,
+        LANE_COUNT = 2
+    };
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+    public: static bool Queue(EventSource& source, uint16_t eventID, variant_t data, Lane lane, bool coalesce = false);
+    public: static void Dispatch();
+
+    public: static uint8_t Pending(Lane lane) { return _lanes[lane].count; };
+    public: static uint8_t HighWaterMark(Lane lane) { return _lanes[lane].highWater; };
+    public: static uint16_t Overflows(Lane lane) { return _lanes[lane].overflows; };
+    public: static uint16_t Refused(Lane lane) { return _lanes[lane].refused; };
+    public: static uint16_t Coalesced() { return _coalesced; };
+    public: static void Report();
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+    private: static const uint8_t LANE_SIZE = 6;
+
+    private: struct PendingEvent
+    {
+        EventSource* pSource;
+        uint16_t eventID;
+        variant_t data;
+    };
+
+    private: struct LaneQueue
+    {
+        PendingEvent events[LANE_SIZE];
+        uint8_t head;
+        uint8_t count;
+        uint8_t highWater;
+        uint16_t overflows;             // Events lost because the lane was full
+        uint16_t refused;               // Times the EventQueue was full (event kept for the next pass)
+    };
+
+    private: static bool Forward(LaneQueue& lane);
+
+    private: static LaneQueue _lanes[LANE_COUNT];
+    private: static uint16_t _coalesced;
+};
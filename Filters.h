@@ -0,0 +1,319 @@
+#pragma once
+
+#include <stdint.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Sensor filter stages that compose at compile time.
+/// </summary>
+/// <remarks>
+/// Each stage is a small class with the same shape:
+///
+///   typedef ... Input;        // Type of the value fed in
+///   typedef ... Output;       // Type of the value produced
+///   Output operator()(Input x) - Filters one sample
+///   void Reset()              - Returns to the initial state
+///
+/// All constants are template parameters so each stage (and each Pipeline of
+/// stages) compiles to straight-line code with the constants folded in. The
+/// stages are header-only and free of any Arduino headers so the host-side
+/// benchmark (Tools/FilterBench.cpp) builds exactly the same code as the robot.
+///
+/// Template parameters can't be float in C++11, so fractional constants are
+/// given as a ratio (e.g. Ema<float, 8, 10> for a smoothing factor of 0.8) and
+/// thresholds are whole numbers in the units of the input.
+///
+/// Example - a range reading that goes through a 3 sample median, then becomes
+/// a "near" flag with 10cm of hysteresis that must hold for 3 samples:
+///
+///   Filters::Pipeline<Filters::Median<uint16_t, 3>,
+///                     Filters::Hysteresis<uint16_t, 65, 75, true>,
+///                     Filters::Debounce<3>> near;
+///
+///   if (near(ping)) ...
+/// </remarks>
+//******************************************************************************
+namespace Filters
+{
+    //**************************************************************************
+    /// <summary>
+    /// Exponential moving average: y = a*y + (1 - a)*x, with a = NUM/DEN.
+    /// </summary>
+    /// <remarks>
+    /// a is the weight given to the previous output, as in CourseController.
+    /// The first sample initializes the average.
+    /// </remarks>
+    //**************************************************************************
+    template <class T, int16_t NUM, int16_t DEN>
+    class Ema
+    {
+        static_assert(DEN > 0 && NUM >= 0 && NUM < DEN, "Ema: smoothing factor must be in [0, 1)");
+
+        public: typedef T Input;
+        public: typedef T Output;
+
+        public: T operator()(T x)
+        {
+            _y = _primed ? T((_y * NUM + x * (DEN - NUM)) / DEN) : x;
+            _primed = true;
+
+            return _y;
+        }
+
+        public: void Reset() { _primed = false; };
+
+        private: T _y = 0;
+        private: bool _primed = false;
+    };
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Median of the last N samples (N odd, and small - it sorts a copy).
+    /// </summary>
+    /// <remarks>
+    /// Until N samples have been seen the median of the samples so far is used
+    /// (the upper one of an even count). N = 3 has its own version below.
+    /// </remarks>
+    //**************************************************************************
+    template <class T, uint8_t N>
+    class Median
+    {
+        static_assert(N % 2 == 1, "Median: N must be odd");
+
+        public: typedef T Input;
+        public: typedef T Output;
+
+        public: T operator()(T x)
+        {
+            _window[_next] = x;
+            _next = (_next + 1) % N;
+
+            if (_count < N) _count++;
+
+            T sorted[N];
+
+            for (uint8_t i = 0; i < _count; i++)
+            {
+                auto value = _window[i];
+                auto j = i;
+
+                for (; j > 0 && sorted[j - 1] > value; j--) sorted[j] = sorted[j - 1];
+
+                sorted[j] = value;
+            }
+
+            return sorted[_count / 2];
+        }
+
+        public: void Reset() { _count = 0; _next = 0; };
+
+        private: T _window[N];
+        private: uint8_t _count = 0;
+        private: uint8_t _next = 0;
+    };
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Median of the last 3 samples, by comparing the new sample against the
+    /// previous two rather than sorting. Gives the same output as the general
+    /// version (FilterBench checks it against the hand-written median).
+    /// </summary>
+    //**************************************************************************
+    template <class T>
+    class Median<T, 3>
+    {
+        public: typedef T Input;
+        public: typedef T Output;
+
+        public: T operator()(T x)
+        {
+            T median;
+
+            if (_count == 2)
+            {
+                auto lo = _a < _b ? _a : _b;
+                auto hi = _a < _b ? _b : _a;
+
+                median = x < lo ? lo : (x > hi ? hi : x);
+            }
+            else
+            {
+                median = (_count == 1 && _b > x) ? _b : x;    // Upper of two, as above
+                _count++;
+            }
+
+            _a = _b;
+            _b = x;
+
+            return median;
+        }
+
+        public: void Reset() { _count = 0; };
+
+        private: T _a = 0;                  // The sample before last
+        private: T _b = 0;                  // The last sample
+        private: uint8_t _count = 0;        // Samples seen, up to 2
+    };
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Two-level threshold. The output turns on when the input reaches UPPER and
+    /// turns off when it falls to LOWER; in between it keeps its last value.
+    /// </summary>
+    /// <remarks>
+    /// With INVERT the sense is flipped: the output is on when the input is low
+    /// (on at LOWER or below, off at UPPER or above) - e.g. "obstacle near" from a
+    /// range reading.
+    /// </remarks>
+    //**************************************************************************
+    template <class T, int32_t LOWER, int32_t UPPER, bool INVERT = false>
+    class Hysteresis
+    {
+        static_assert(LOWER <= UPPER, "Hysteresis: LOWER must not be above UPPER");
+
+        public: typedef T Input;
+        public: typedef bool Output;
+
+        public: bool operator()(T x)
+        {
+            if (x >= T(UPPER)) _on = !INVERT;
+            else if (x <= T(LOWER)) _on = INVERT;
+
+            return _on;
+        }
+
+        public: void Reset() { _on = false; };
+
+        private: bool _on = false;
+    };
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Boolean debounce. The output only changes after N consecutive samples
+    /// disagree with it.
+    /// </summary>
+    //**************************************************************************
+    template <uint8_t N, bool INITIAL = false>
+    class Debounce
+    {
+        static_assert(N > 0, "Debounce: N must be at least 1");
+
+        public: typedef bool Input;
+        public: typedef bool Output;
+
+        public: bool operator()(bool x)
+        {
+            if (x == _state)
+            {
+                _count = 0;
+            }
+            else if (++_count >= N)
+            {
+                _state = x;
+                _count = 0;
+            }
+
+            return _state;
+        }
+
+        public: void Reset() { _state = INITIAL; _count = 0; };
+
+        private: bool _state = INITIAL;
+        private: uint8_t _count = 0;
+    };
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Slew rate limiter. The output moves toward the input by at most STEP
+    /// per sample. The first sample passes straight through.
+    /// </summary>
+    //**************************************************************************
+    template <class T, int32_t STEP>
+    class RateLimit
+    {
+        static_assert(STEP > 0, "RateLimit: STEP must be positive");
+
+        public: typedef T Input;
+        public: typedef T Output;
+
+        public: T operator()(T x)
+        {
+            if (!_primed) _y = x;
+            else if (x > _y + T(STEP)) _y = _y + T(STEP);
+            else if (x < _y - T(STEP)) _y = _y - T(STEP);
+            else _y = x;
+
+            _primed = true;
+
+            return _y;
+        }
+
+        public: void Reset() { _primed = false; };
+
+        private: T _y = 0;
+        private: bool _primed = false;
+    };
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Deadband. Inputs within WIDTH of zero become zero; anything else passes
+    /// through unchanged.
+    /// </summary>
+    //**************************************************************************
+    template <class T, int32_t WIDTH>
+    class Deadband
+    {
+        static_assert(WIDTH >= 0, "Deadband: WIDTH must not be negative");
+
+        public: typedef T Input;
+        public: typedef T Output;
+
+        public: T operator()(T x) { return (x > T(WIDTH) || x < -T(WIDTH)) ? x : T(0); };
+
+        public: void Reset() {};
+    };
+
+
+    //**************************************************************************
+    /// <summary>
+    /// A chain of stages; each sample goes through every stage in order. The
+    /// Output type of each stage must convert to the Input type of the next.
+    /// </summary>
+    //**************************************************************************
+    template <class... Stages>
+    class Pipeline;
+
+    template <class Stage>
+    class Pipeline<Stage>
+    {
+        public: typedef typename Stage::Input Input;
+        public: typedef typename Stage::Output Output;
+
+        public: Output operator()(Input x) { return _stage(x); };
+
+        public: void Reset() { _stage.Reset(); };
+
+        private: Stage _stage;
+    };
+
+    template <class Stage, class... Rest>
+    class Pipeline<Stage, Rest...>
+    {
+        public: typedef typename Stage::Input Input;
+        public: typedef typename Pipeline<Rest...>::Output Output;
+
+        public: Output operator()(Input x) { return _rest(_stage(x)); };
+
+        public: void Reset() { _stage.Reset(); _rest.Reset(); };
+
+        private: Stage _stage;
+        private: Pipeline<Rest...> _rest;
+    };
+}
@@ -2,6 +2,7 @@
 
 #include <Arduino.h>
 #include <avr/wdt.h>
+#include "Filters.h"
 #include "IMU.h"
 #include "Movement.h"
 #include "Robot_9_Tank.h"
@@ -32,14 +33,15 @@ void PerformMagCalibration()
     auto xmax = -1000.0f;
     auto ymin = 1000.0f;
     auto ymax = -1000.0f;
-    auto alpha = 0.1f;
-    auto beta = 1 - alpha;
     auto mag = imu.GetMagRaw();
 
     for (auto endtime = millis() + 100; millis() < endtime; mag = imu.GetMagRaw()) delay(10);
 
-    auto x = mag.x;
-    auto y = mag.y;
+    // Low-pass filters (alpha = 0.1), primed with the reading taken at rest
+    Filters::Ema<float, 9, 10> xFilter;
+    Filters::Ema<float, 9, 10> yFilter;
+    auto x = xFilter(mag.x);
+    auto y = yFilter(mag.y);
 
     Movement::Spin('R');
     delay(20);
@@ -54,8 +56,8 @@ void PerformMagCalibration()
         if (t1 < (t0 + 10)) continue;
 
         mag = imu.GetMagRaw();
-        x = beta * x + alpha * mag.x;
-        y = beta * y + alpha * mag.y;
+        x = xFilter(mag.x);
+        y = yFilter(mag.y);
         xmin = min(x, xmin);
         xmax = max(x, xmax);
         ymin = min(y, ymin);
@@ -81,8 +83,8 @@ void PerformMagCalibration()
         if (t1 < (t0 + 10)) continue;
 
         mag = imu.GetMagRaw();
-        x = beta * x + alpha * mag.x;
-        y = beta * y + alpha * mag.y;
+        x = xFilter(mag.x);
+        y = yFilter(mag.y);
         xmin = min(x, xmin);
         xmax = max(x, xmax);
         ymin = min(y, ymin);
@@ -0,0 +1,119 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+
+#include <RTL_Stdlib.h>
+#include "Memory.h"
+
+
+// Symbols provided by the linker and avr-libc
+extern uint8_t __data_start;        // Start of .data (start of SRAM used by the program)
+extern uint8_t __heap_start;        // End of .bss / start of the heap
+extern uint8_t* __brkval;           // Top of the heap (0 if malloc has never been called)
+extern uint8_t _end;                // End of .bss
+extern uint8_t __stack;             // Top of RAM (RAMEND)
+
+struct __freelist
+{
+    size_t sz;
+    struct __freelist* nx;
+};
+
+extern struct __freelist* __flp;    // Heap free list
+
+
+constexpr uint8_t STACK_PAINT = 0xC5;     // Pattern painted over unused RAM at startup
+
+
+//******************************************************************************
+// Paints the unused RAM at startup. This runs in .init3, the place for user
+// start-up code: avr-libc has already cleared r1 (__zero_reg__) and set the
+// stack pointer in .init2, and nothing has been pushed yet. Only the RAM
+// below the stack pointer is painted, so a spill by the compiler can't be
+// painted over.
+//******************************************************************************
+void PaintStack() __attribute__((naked, used, section(".init3")));
+
+void PaintStack()
+{
+    for (auto p = &_end; p < (uint8_t*)SP; p++) *p = STACK_PAINT;
+}
+
+
+namespace Memory
+{
+    static inline uint8_t* HeapTop()
+    {
+        return (__brkval != nullptr) ? __brkval : &__heap_start;
+    }
+
+
+    uint16_t StaticSize()
+    {
+        return &__heap_start - &__data_start;
+    }
+
+
+    uint16_t HeapSize()
+    {
+        return HeapTop() - &__heap_start;
+    }
+
+
+    uint16_t FreeHeap()
+    {
+        uint16_t size = 0;
+
+        for (auto p = __flp; p != nullptr; p = p->nx) size += p->sz + sizeof(size_t);
+
+        return size;
+    }
+
+
+    uint16_t FreeRam()
+    {
+        return (uint8_t*)SP - HeapTop();
+    }
+
+
+    uint16_t StackUsed()
+    {
+        return &__stack - (uint8_t*)SP;
+    }
+
+
+
+    //**************************************************************************
+    // Returns the lowest address the stack has ever reached: the first byte
+    // above the heap that no longer has the paint pattern.
+    //**************************************************************************
+    static uint8_t* StackLowWater()
+    {
+        auto p = HeapTop();
+
+        while (p < (uint8_t*)SP && *p == STACK_PAINT) p++;
+
+        return p;
+    }
+
+
+    uint16_t StackMaxUsed()
+    {
+        return &__stack - StackLowWater();
+    }
+
+
+    uint16_t NeverUsed()
+    {
+        return StackLowWater() - HeapTop();
+    }
+
+
+    void Report()
+    {
+        Logger() << F("RAM: static=") << StaticSize()
+                 << F(", heap=") << HeapSize() << F(" (free ") << FreeHeap() << ')'
+                 << F(", stack=") << StackUsed() << F(" (max ") << StackMaxUsed() << ')'
+                 << F(", free=") << FreeRam() << F(", never used=") << NeverUsed() << endl;
+    }
+}
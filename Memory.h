@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+
+
+//******************************************************************************
+/// <summary>
+/// SRAM usage probes.
+/// </summary>
+/// <remarks>
+/// The ATmega328 has 2K of SRAM, shared by the static data (.data and .bss),
+/// the heap (growing up from the end of .bss) and the stack (growing down from
+/// the top of RAM).
+///
+/// At startup (before any constructors run) the space between the end of .bss
+/// and the top of RAM is painted with a known pattern. The deepest the stack
+/// has ever reached (the high-water mark) is then found by looking for the
+/// lowest address where the pattern has been overwritten.
+///
+/// Report() prints the current figures; it can be triggered by sending 'm' on
+/// the serial port. Tools/MemoryReport.cpp gives the static (build-time) view:
+/// .data/.bss per translation unit and per object.
+/// </remarks>
+//******************************************************************************
+namespace Memory
+{
+    //**************************************************************************
+    // Function declarations
+    //**************************************************************************
+    uint16_t StaticSize();      // Bytes used by .data + .bss
+    uint16_t HeapSize();        // Bytes the heap has grown to
+    uint16_t FreeHeap();        // Bytes in the heap's free list
+    uint16_t FreeRam();         // Bytes between the top of the heap and the stack pointer
+    uint16_t StackUsed();       // Current stack depth in bytes
+    uint16_t StackMaxUsed();    // Deepest the stack has been (high-water mark)
+    uint16_t NeverUsed();       // Bytes never touched by the heap or the stack
+    void Report();
+}
@@ -0,0 +1,197 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+
+#include <RTL_Stdlib.h>
+#include "Metrics.h"
+#include "Safety.h"
+#include "ScanLog.h"
+
+
+namespace Metrics
+{
+    //******************************************************************************
+    // Counters
+    //******************************************************************************
+    uint16_t residency[STATE_COUNT];                // Seconds spent in each state
+    uint8_t transitions[STATE_COUNT][STATE_COUNT];  // [from][to] transition counts (stick at 255)
+    uint16_t obstacles[SOURCE_COUNT];               // Obstacle events by source
+    uint16_t spins = 0;                             // Spins in place
+    uint16_t stops = 0;                             // Times the robot came to a stop from moving
+    uint16_t motorOnTime = 0;                       // Seconds with either motor running
+    float forwardTravel = 0;                        // Integral of forward speed (speed * seconds)
+
+    uint32_t runStart = 0;                          // millis() when the counters were reset
+    uint32_t stateSince = 0;                        // millis() the current state's time is counted from
+    uint32_t motorsSince = 0;                       // millis() the motor-on time is counted from
+    uint32_t speedSince = 0;                        // millis() the motor speeds last changed
+    StateID currentState = STATE_COUNT;             // STATE_COUNT until the first state is entered
+    int16_t forwardSpeed = 0;                       // Forward component of the current motor speeds
+    bool motorsOn = false;
+
+
+    //******************************************************************************
+    // Adds the whole seconds since 'since' to a counter, and moves 'since' up
+    // so the remainder is carried into the next update.
+    //******************************************************************************
+    static void AddSeconds(uint16_t& seconds, uint32_t& since, uint32_t now)
+    {
+        auto elapsed = (now - since) / 1000;
+
+        seconds += elapsed;
+        since += elapsed * 1000;
+    }
+
+
+    void StateEntered(StateID state)
+    {
+        auto now = millis();
+
+        if (currentState < STATE_COUNT)
+        {
+            AddSeconds(residency[currentState], stateSince, now);
+
+            auto& count = transitions[currentState][state];
+
+            if (count < 255) count++;
+        }
+        else
+        {
+            stateSince = now;
+        }
+
+        currentState = state;
+    }
+
+
+    void Obstacle(Source source)
+    {
+        obstacles[source]++;
+        ScanLog::Obstacle(source);     // The outcome of the last scan
+    }
+
+
+    void Spin()
+    {
+        spins++;
+    }
+
+
+    //******************************************************************************
+    // Brings the motor-on time and forward travel up to date
+    //******************************************************************************
+    static void UpdateMotorTotals(uint32_t now)
+    {
+        forwardTravel += forwardSpeed * ((now - speedSince) / 1000.0F);
+        speedSince = now;
+
+        if (motorsOn) AddSeconds(motorOnTime, motorsSince, now);
+    }
+
+
+    void MotorsChanged(int leftSpeed, int rightSpeed)
+    {
+        auto now = millis();
+        auto on = leftSpeed != 0 || rightSpeed != 0;
+
+        UpdateMotorTotals(now);
+
+        if (motorsOn && !on) stops++;
+
+        if (!motorsOn && on) motorsSince = now;
+
+        forwardSpeed = (leftSpeed + rightSpeed) / 2;
+        motorsOn = on;
+    }
+
+
+    //******************************************************************************
+    // Estimated forward distance (in centimeters) since the last reset, up to now
+    //******************************************************************************
+    float Distance()
+    {
+        auto travel = forwardTravel + forwardSpeed * ((millis() - speedSince) / 1000.0F);
+
+        return travel * CM_PER_SPEED_SECOND;
+    }
+
+
+    void Reset()
+    {
+        auto now = millis();
+
+        memset(residency, 0, sizeof(residency));
+        memset(transitions, 0, sizeof(transitions));
+        memset(obstacles, 0, sizeof(obstacles));
+        spins = 0;
+        stops = 0;
+        motorOnTime = 0;
+        forwardTravel = 0;
+        runStart = now;
+        stateSince = now;
+        motorsSince = now;
+        speedSince = now;
+    }
+
+
+    static const __FlashStringHelper* StateName(uint8_t state)
+    {
+        switch (state)
+        {
+            case MOVING:        return F("Moving");
+            case BACKING:       return F("Backing");
+            case STOPPED:       return F("Stopped");
+            case REVERSING:     return F("Reversing");
+            case SCANNING:      return F("Scanning");
+            case BACKUP_AVOID:  return F("BackupAvoid");
+            default:            return F("?");
+        }
+    }
+
+
+    void Report()
+    {
+        // Bring the running totals up to date first
+        auto now = millis();
+
+        if (currentState < STATE_COUNT) AddSeconds(residency[currentState], stateSince, now);
+
+        UpdateMotorTotals(now);
+
+        auto runTime = (now - runStart) / 1000.0F;
+        auto minutes = runTime / 60;
+        uint16_t reversals = 0;
+
+        Logger() << F("KPI: run=") << _FLOAT(runTime, 0) << F("s, motorOn=") << motorOnTime
+                 << F("s, distance=") << _FLOAT(forwardTravel * CM_PER_SPEED_SECOND / 100, 1)
+                 << F("m, avgSpeed=") << _FLOAT(runTime > 0 ? forwardTravel / runTime : 0, 1)
+                 << F(", stops=") << stops
+                 << F(", stops/min=") << _FLOAT(minutes > 0 ? stops / minutes : 0, 2)
+                 << F(", spins=") << spins
+                 << endl;
+
+        Logger() << F("KPI: obstacles sonarDanger=") << obstacles[SONAR_DANGER]
+                 << F(", sonarDetected=") << obstacles[SONAR_DETECTED]
+                 << F(", ir=") << obstacles[IR_PROXIMITY]
+                 << F(", step=") << obstacles[STEP]
+                 << endl;
+
+        Logger() << F("KPI: reflex latency=") << Safety::LastLatency() << F("us, max=") << Safety::MaxLatency() << F("us") << endl;
+
+        for (uint8_t from = 0; from < STATE_COUNT; from++)
+        {
+            reversals += transitions[from][REVERSING];
+
+            Logger() << F("KPI: ") << StateName(from) << F(" time=") << residency[from] << 's';
+
+            for (uint8_t to = 0; to < STATE_COUNT; to++)
+            {
+                if (transitions[from][to] != 0) LoggerAppend() << F(", >") << StateName(to) << '=' << unsigned(transitions[from][to]);
+            }
+
+            LoggerAppend() << endl;
+        }
+
+        Logger() << F("KPI: reversals=") << reversals << endl;
+    }
+}
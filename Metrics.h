@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Always-on performance counters (KPIs) for judging firmware changes.
+/// </summary>
+/// <remarks>
+/// Counts, since startup or the last Reset():
+///
+///   - time spent in each state, and the number of transitions between each
+///     pair of states (reversals are the transitions into ReversingDirection)
+///   - obstacle events by source (sonar danger/detected, IR proximity, step)
+///   - spins in place and stops
+///   - motor-on time, and the forward distance estimated from the forward
+///     component of the motor speeds over time
+///
+/// Report() prints them; it is triggered by sending 'k' on the serial port.
+/// The IR remote's 0 key prints them and starts a new run.
+///
+/// Everything is kept small (about 90 bytes): times are whole seconds with the
+/// remainder carried over, and transition counts are bytes that stick at 255.
+/// </remarks>
+//******************************************************************************
+namespace Metrics
+{
+    //**************************************************************************
+    // Constants
+    //**************************************************************************
+    enum StateID : uint8_t
+    {
+        MOVING,
+        BACKING,
+        STOPPED,
+        REVERSING,
+        SCANNING,
+        BACKUP_AVOID,
+        STATE_COUNT
+    };
+
+    enum Source : uint8_t
+    {
+        SONAR_DANGER,
+        SONAR_DETECTED,
+        IR_PROXIMITY,
+        STEP,
+        SOURCE_COUNT
+    };
+
+    // Estimated centimeters traveled per second for each unit of motor speed.
+    // Measured roughly at CRUISE_SPEED (200 -> about 30cm/s); refine by timing
+    // a straight run.
+    const float CM_PER_SPEED_SECOND = 0.15F;
+
+    //**************************************************************************
+    // Function declarations
+    //**************************************************************************
+    void StateEntered(StateID state);
+    void Obstacle(Source source);
+    void Spin();
+    void MotorsChanged(int leftSpeed, int rightSpeed);
+    float Distance();
+    void Reset();
+    void Report();
+}
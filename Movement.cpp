@@ -4,8 +4,11 @@
 #include <avr/wdt.h>
 
 #include <RTL_Stdlib.h>
+#include "Filters.h"
 #include "IMU.h"
+#include "Metrics.h"
 #include "Movement.h"
+#include "Safety.h"
 
 
 namespace Movement
@@ -21,10 +24,13 @@ namespace Movement
     // Movement control varaibles.
     //******************************************************************************
     int currentSpeed = 0;
+    int16_t currentCurvature = STRAIGHT;
     bool isMoving = false;         // Indicates if the motors are enabled
     bool goingSlow = false;
     bool motorsEnabled = true;
 
+    bool DriveMotors(int speed, int16_t curvature);
+
 
     //******************************************************************************
     // Movement control methods.
@@ -33,6 +39,7 @@ namespace Movement
     void Go()
     {
         TRACE(Logger(F("Go")) << endl);
+        currentCurvature = STRAIGHT;
         SetMotors(currentSpeed, currentSpeed);
     }
 
@@ -44,8 +51,8 @@ namespace Movement
             TRACE(Logger(F("Go")) << '(' << speed << ')' << endl);
             goingSlow = between(1, speed, SLOW_SPEED);
             currentSpeed = constrain(speed, -MAX_SPEED, MAX_SPEED);
-            SetMotors(currentSpeed, currentSpeed);
-            isMoving = true;
+            currentCurvature = STRAIGHT;
+            isMoving = SetMotors(currentSpeed, currentSpeed);
         }
         else
         {
@@ -90,7 +97,7 @@ namespace Movement
 
         GoBackward();
 
-        while (millis() < timeout) wdt_reset(); // Keep watchdog timer reset to prevent auto-restart
+        while (millis() < timeout) { Safety::Service(); wdt_reset(); }   // Keep reflex and watchdog timer serviced
 
         Stop();
     }
@@ -103,7 +110,7 @@ namespace Movement
 
         GoBackward();
 
-        while (millis() < timeout && predicate()) wdt_reset();  // Keep watchdog timer reset to prevent auto-restart
+        while (millis() < timeout && predicate()) { Safety::Service(); wdt_reset(); }  // Keep reflex and watchdog timer serviced
 
         Stop();
     }
@@ -115,26 +122,99 @@ namespace Movement
 
         if (direction == 'R')      // Turn to the right
         {
-            SetMotors(currentSpeed, 0);
+            Arc(-PIVOT);
         }
         else if (direction == 'L') // Turn to the left
         {
-            SetMotors(0, currentSpeed);
+            Arc(PIVOT);
+        }
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Drives at a linear speed along a curve. The left and right track speeds
+    /// are computed together from the speed and curvature.
+    /// </summary>
+    /// <param>speed - Speed of the outer track (-255 to 255)</param>
+    /// <param>curvature - STRAIGHT (0) to SPIN (256); positive curves left</param>
+    /// <remarks>
+    /// The outer track runs at the given speed and the inner track is slowed
+    /// by curvature/128 of that speed, so PIVOT (128) stops the inner track
+    /// like Turn() and SPIN (256) reverses it to spin in place. Anything in
+    /// between is an arc that keeps the robot moving forward while it turns.
+    /// </remarks>
+    //**************************************************************************
+    void Drive(int speed, int16_t curvature)
+    {
+        TRACE(Logger(F("Drive")) << '(' << speed << ',' << curvature << ')' << endl);
+
+        if (speed == 0)
+        {
+            Stop();
+            return;
         }
+
+        goingSlow = between(1, speed, SLOW_SPEED);
+        currentSpeed = constrain(speed, -MAX_SPEED, MAX_SPEED);
+        isMoving = DriveMotors(currentSpeed, curvature);
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Changes the curvature without changing the current speed.
+    /// </summary>
+    /// <remarks>
+    /// When stopped there is no speed to keep (currentSpeed is left over from
+    /// before the stop), so the robot sets off at SLOW_SPEED.
+    /// </remarks>
+    //**************************************************************************
+    void Arc(int16_t curvature)
+    {
+        TRACE(Logger(F("Arc")) << '(' << curvature << ')' << endl);
+        Drive(isMoving ? currentSpeed : SLOW_SPEED, curvature);
+    }
+
+
+    bool DriveMotors(int speed, int16_t curvature)
+    {
+        curvature = constrain(curvature, -SPIN, SPIN);
+        currentCurvature = curvature;
+
+        auto inner = int(int32_t(speed) * (PIVOT - abs(curvature)) / PIVOT);
+
+        if (curvature > 0)  // Curve left - left track is the inner track
+            return SetMotors(inner, speed);
+        else
+            return SetMotors(speed, inner);
+    }
+
+
+    int16_t Curvature()
+    {
+        return currentCurvature;
+    }
+
+
+    int Speed()
+    {
+        return currentSpeed;
     }
 
 
     void Spin(char direction)
     {
         TRACE(Logger(F("Spin")) << F("direction=") << direction << ')' << endl);
+        Metrics::Spin();
 
         if (direction == 'R') // Spin to the right
         {
-            SetMotors(CRUISE_SPEED, -CRUISE_SPEED);
+            DriveMotors(CRUISE_SPEED, -SPIN);
         }
         else if (direction == 'L')      // Spin to the left
         {
-            SetMotors(-CRUISE_SPEED, CRUISE_SPEED);
+            DriveMotors(CRUISE_SPEED, SPIN);
         }
     }
 
@@ -180,7 +260,7 @@ namespace Movement
     {
         TRACE(Logger(F("Spin")) << F("angle=") << angle << ')' << endl);
     
-        if (angle == 0) return;
+        if (angle == 0) return true;
 
         // Start spin in requested direction
         Spin(angle < 0 ? 'R' : 'L');
@@ -188,8 +268,11 @@ namespace Movement
         auto theta = 0.0F;
         auto now = millis();
         auto t0 = now; 
-        auto nospin_count = 0;
-        
+
+        // Turning faster than 3 deg/s, and only drops to "stalled" after 10
+        // samples (200ms) in a row below that
+        Filters::Pipeline<Filters::Hysteresis<float, 3, 3>, Filters::Debounce<10, true>> spinning;
+
         // Set timeout to 3 seconds (about how long a full 360 degree spin takes)
         for (auto timeout = now + 3000UL; now <= timeout; now = millis())
         {
@@ -201,14 +284,13 @@ namespace Movement
 
             theta += wz * dt;
             t0 = now;
+            Safety::Service();
             wdt_reset();
 
-            // If no appreciable rotation detected for 20 samples in a row then
+            // If no appreciable rotation detected for 10 samples in a row then
             // we might be stuck, so abort. This assumes that the robot is spinning
             // at a reasonable speed (not too slow).
-            nospin_count = (fabs(wz) < 3) ? (nospin_count + 1) : 0;
-
-            if (++nospin_count >= 20) return false;
+            if (!spinning(fabs(wz))) return false;
 
             if (fabs(theta) >= fabs(angle)) return true;    // Success - spin completed
         }
@@ -224,7 +306,7 @@ namespace Movement
 
         Spin(direction);
 
-        while (millis() < timeout) wdt_reset();     // Keep watchdog timer reset to prevent auto-restart
+        while (millis() < timeout) { Safety::Service(); wdt_reset(); }   // Keep reflex and watchdog timer serviced
 
         Stop();
     }
@@ -232,10 +314,10 @@ namespace Movement
 
     void EnableMotors(bool isEnabled)
     {
-        motorsEnabled = isEnabled;
+        // Ensure motors are stopped if disabling (while they still take commands)
+        if (!isEnabled) Stop();
 
-        // Ensure motores are stopped if disabling
-        if (!motorsEnabled) Stop();
+        motorsEnabled = isEnabled;
 
         TRACE(Logger(F("EnableMotors=")) << motorsEnabled << endl);
     }
@@ -250,15 +332,33 @@ namespace Movement
     //******************************************************************************
     // Set the motor speed
     // The speed of both motors is constrained to the range -255 to +255.
+    // Returns false if the safety reflex refused to drive forward (the motors
+    // are left as they were); with the motors disabled the command still counts.
     //******************************************************************************
-    void SetMotors(int leftSpeed, int rightSpeed)
+    bool SetMotors(int leftSpeed, int rightSpeed)
     {
-        if (!motorsEnabled) return;
+        auto forward = leftSpeed >= 0 && rightSpeed >= 0 && (leftSpeed != 0 || rightSpeed != 0);
+
+        // Don't drive forward into a cliff or obstacle the safety reflex has seen
+        if (forward && Safety::Faults() != 0) return false;
+
+        // The motors aren't driving, so the reflex has nothing to guard
+        if (!motorsEnabled)
+        {
+            Safety::MotorsChanged(false);
+            return true;
+        }
 
         // If the motors don't rotate in the desired direction you can correct it
         // by changing the sign of the speed in these calls.
         leftMotor.Run(leftSpeed);
         rightMotor.Run(rightSpeed);
+
+        Metrics::MotorsChanged(leftSpeed, rightSpeed);
+
+        Safety::MotorsChanged(forward);
+
+        return true;
     }
 
 
@@ -266,7 +366,8 @@ namespace Movement
     {
         TRACE(Logger(F("Trim")) << F("side=") << side << F(", delta=") << delta << endl);
 
-        if (!motorsEnabled || delta == 0) return;
+        // A zero trim still has to be written, to take off the previous trim
+        if (!motorsEnabled || Safety::Faults() != 0) return;
 
         auto speed = currentSpeed + delta;
 
@@ -15,6 +15,13 @@ namespace Movement
     const int MAX_SPEED = 255;      // Maximum motor speed
     const int CRUISE_SPEED = 200;   // Normal running speed
     const int SLOW_SPEED = 120;     // Slower speed when approaching obstacle
+    const int FAST_SPEED = 230;     // Open-space speed (leaves the right motor room for course correction)
+
+    // Curvature, in 1/128ths of the outer track speed taken off the inner track.
+    // Positive curves to the left, negative to the right.
+    const int16_t STRAIGHT = 0;     // Both tracks at the same speed
+    const int16_t PIVOT = 128;      // Inner track stopped (what Turn() does)
+    const int16_t SPIN = 256;       // Inner track reversed (spin in place)
 
     //******************************************************************************
     // Function declarations
@@ -28,13 +35,17 @@ namespace Movement
     void GoBackward(uint32_t duration);
     void GoBackward(uint32_t duration, bool(*predicate)());
     void Turn(char direction);
+    void Drive(int speed, int16_t curvature);
+    void Arc(int16_t curvature);
     bool Spin(int16_t angle);
     void Spin(char direction);
     void Spin(char direction, uint32_t duration);
     void Trim(char direction, int16_t delta);
-    void SetMotors(int leftSpeed, int rightSpeed);
+    bool SetMotors(int leftSpeed, int rightSpeed);
     void EnableMotors(bool isEnabled = true);
     bool IsMotorsEnabled();
+    int16_t Curvature();
+    int Speed();
 
 
     //******************************************************************************
@@ -0,0 +1,75 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+
+#include "ProximitySampler.h"
+
+
+ProximitySampler::ProximitySampler(const uint8_t* pins, uint8_t count, uint8_t threshold)
+{
+    _count = min(count, MAX_SENSORS);
+    _threshold = threshold;
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        auto pin = pins[i];
+        auto pInput = portInputRegister(digitalPinToPort(pin));
+        uint8_t port = 0;
+
+        pinMode(pin, INPUT);
+
+        // Find the port register, adding it if this is the first sensor on it
+        while (port < _portCount && _ports[port] != pInput) port++;
+
+        if (port == _portCount && _portCount < MAX_PORTS) _ports[_portCount++] = pInput;
+
+        _sensors[i].port = port;
+        _sensors[i].mask = digitalPinToBitMask(pin);
+    }
+
+    Reset();
+}
+
+
+void ProximitySampler::Reset(uint8_t state)
+{
+    _state = state;
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        _integrators[i] = (state & (1 << i)) ? _threshold : 0;
+    }
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Reads the sensors and returns the debounced state.
+/// </summary>
+//******************************************************************************
+uint8_t ProximitySampler::Sample()
+{
+    uint8_t levels[MAX_PORTS];
+
+    // One read per port so all the sensors on it are sampled together
+    for (uint8_t p = 0; p < _portCount; p++) levels[p] = *_ports[p];
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        auto& sensor = _sensors[i];
+        auto& integrator = _integrators[i];
+        uint8_t bit = 1 << i;
+
+        if ((levels[sensor.port] & sensor.mask) == 0)
+        {
+            // Sensor output is low (triggered)
+            if (integrator < _threshold && ++integrator == _threshold) _state |= bit;
+        }
+        else
+        {
+            if (integrator > 0 && --integrator == 0) _state &= ~bit;
+        }
+    }
+
+    return _state;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Samples a group of IR proximity sensors with one read per port register
+/// and debounces each sensor with its own integrator.
+/// </summary>
+/// <remarks>
+/// The sensors are given as a list of Arduino pin numbers. Bit n of the
+/// returned state is set when sensor n is triggered. The sensors pull their
+/// output low when they see something, so a low pin counts as triggered.
+///
+/// Each call to Sample() reads every port that has a sensor on it exactly once,
+/// so all the sensors on a port are sampled at the same moment. The raw reading
+/// feeds a saturating integrator for each sensor. The integrator counts up while
+/// the sensor reads triggered and down while it reads clear. The debounced bit
+/// only changes when the integrator reaches 0 or the threshold, so a single
+/// noisy sample can't flip it.
+/// </remarks>
+//******************************************************************************
+class ProximitySampler
+{
+    /*--------------------------------------------------------------------------
+    Constructors
+    --------------------------------------------------------------------------*/
+    public: ProximitySampler(const uint8_t* pins, uint8_t count, uint8_t threshold);
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+    public: uint8_t Sample();
+    public: void Reset(uint8_t state = 0);
+    public: uint8_t State() { return _state; };
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+    private: static const uint8_t MAX_SENSORS = 8;
+    private: static const uint8_t MAX_PORTS = 3;
+
+    private: struct Sensor
+    {
+        uint8_t port;                       // Index into _ports
+        uint8_t mask;                       // Bit of the sensor's pin in the port register
+    };
+
+    private: volatile uint8_t* _ports[MAX_PORTS];   // Input registers (PINx) that have sensors on them
+    private: uint8_t _portCount = 0;
+    private: Sensor _sensors[MAX_SENSORS];
+    private: uint8_t _count;
+    private: uint8_t _threshold;                    // Integrator value at which a sensor is triggered
+    private: uint8_t _integrators[MAX_SENSORS];
+    private: uint8_t _state = 0;                    // Debounced sensor state (bit n = sensor n triggered)
+};
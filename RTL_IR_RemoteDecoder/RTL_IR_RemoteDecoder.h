@@ -5,6 +5,33 @@
 
 #define IR_REMOTE_I2C_ADDRESS     ((byte)0x45)
 
+#define IR_REMOTE_PROTOCOL_VERSION  ((byte)0x21)    // Batch protocol (v2.1)
+
+// Minor revisions (low nibble) only add to the protocol, so only the major
+// version has to match
+#define IR_REMOTE_PROTOCOL_MAJOR(version)   ((version) & 0xF0)
+#define IR_REMOTE_MAX_BATCH         4               // Max commands returned per I2C request
+
+//******************************************************************************
+// Register select. The master writes one of these bytes to choose what the
+// next I2C request returns. The selection only lasts for one request, so a
+// plain request (no register write) always returns an IRRemoteBatch.
+//******************************************************************************
+#define HUB_REG_IR_BATCH            ((byte)0x00)    // IRRemoteBatch
+#define HUB_REG_SENSORS             ((byte)0x01)    // SensorHubSnapshot
+
+//******************************************************************************
+// Sensor hub status bits (IRRemoteBatchHeader.Sensors, SensorHubSnapshot.Sensors)
+//******************************************************************************
+#define HUB_PROX_RIGHT              ((byte)0x01)    // Right proximity sensor triggered
+#define HUB_PROX_FRONT              ((byte)0x02)    // Front proximity sensor triggered
+#define HUB_PROX_LEFT               ((byte)0x04)    // Left proximity sensor triggered
+#define HUB_STEP                    ((byte)0x08)    // Step sensor sees a drop-off
+#define HUB_SONAR_VALID             ((byte)0x40)    // Hub owns the sonar (range fields are valid)
+#define HUB_SENSORS_VALID           ((byte)0x80)    // Hub samples the proximity/step sensors
+
+#define HUB_NO_ECHO                 0xFFFF          // Sonar range when no echo was received
+
 enum IRRemoteCommandType
 {
     None   = 0x00,
@@ -21,4 +48,52 @@ struct IRRemoteCommand
     uint32_t Code;          // The actual command code
 };
 
+
+//******************************************************************************
+// Response to an I2C request (protocol v2.1). The header is followed by
+// IR_REMOTE_MAX_BATCH command slots, of which the first Count are valid.
+// The whole response (31 bytes) fits in the 32 byte Wire buffer.
+//
+// The header also carries the sensor hub's debounced sensor bits, so one read
+// picks up both IR commands and sensor changes.
+//
+// Overflows and Dropped are running counts that wrap at 255; the master
+// compares them to the previous response to see if anything was lost.
+//
+// A v1 decoder returns a single IRRemoteCommand, whose first byte (Type) never
+// has the major version of IR_REMOTE_PROTOCOL_VERSION, so the master can tell
+// them apart.
+//******************************************************************************
+struct IRRemoteBatchHeader
+{
+    uint8_t Version;        // IR_REMOTE_PROTOCOL_VERSION
+    uint8_t Count;          // Number of valid commands in this response
+    uint8_t Overflows;      // Commands discarded because the decoder buffer was full
+    uint8_t Dropped;        // IR frames discarded part way through (bad timing)
+    uint16_t Age;           // Milliseconds since the first command in this response was decoded
+    uint8_t Sensors;        // Sensor hub status bits (HUB_xxx)
+};
+
+
+struct IRRemoteBatch
+{
+    IRRemoteBatchHeader Header;
+    IRRemoteCommand Commands[IR_REMOTE_MAX_BATCH];
+};
+
+
+//******************************************************************************
+// Sensor hub snapshot (register HUB_REG_SENSORS)
+//******************************************************************************
+struct SensorHubSnapshot
+{
+    uint8_t Version;        // IR_REMOTE_PROTOCOL_VERSION
+    uint8_t Sensors;        // Sensor hub status bits (HUB_xxx)
+    uint8_t Changes;        // Number of debounced sensor changes (wraps at 255)
+    uint8_t PingCount;      // Number of completed sonar pings (wraps at 255)
+    uint16_t SensorAge;     // Milliseconds since the sensor bits last changed
+    uint16_t Range;         // Last sonar range in centimeters (HUB_NO_ECHO if no echo)
+    uint16_t RangeAge;      // Milliseconds since the last ping completed
+};
+
 #endif
@@ -3,24 +3,66 @@ Name:       RTL_IR_RemoteDecoder.ino
 Created:    8/25/2018 4:04:59 PM
 Author:     RTLessly-Laptop\R. T. Lessly
 
-Arduino Sketch for dedicated IR Remote decoder. Default behavior is to decode
-the NEC IR remote protocol.
+Arduino Sketch for dedicated IR Remote decoder and sensor hub. Default behavior is
+to decode the NEC IR remote protocol and sample the robot's proximity and step
+sensors.
 
 Receiving and decoding IR remote signals is a task that requires critical timing. As
 such, this sketch is intended to run on an Arduino dedicated solely to this purpose. 
 An Arduino Nano is a good choice for this.
 
-IR Signals are received via a simple IR sensor, which is expected to be connected
-to digital pin 2 by default (can be changed via the constant IR_SENSOR_PIN). As
-signals are received and decoded, the corresponding commands are cached in a
-circular buffer until they are retrieved by an external device via the I2C interface.
-A maximum of 10 commands can be buffered. If the buffer fills up then the oldest
-commands in the buffer are overwritten as new commands are received and decoded.
+IR Signals are received via a simple IR sensor, which must be connected to digital
+pin 8 (ICP1, the Timer1 input capture pin). The NEC protocol is decoded directly
+from the Timer1 input capture interrupt: every edge of the IR signal is timestamped
+by the hardware (4us resolution) and a small pulse-width state machine in the ISR
+checks each mark/space and shifts in the data bits. A command is complete on the
+final edge of the stop bit and is pushed straight into the command buffer from
+the ISR. Nothing runs between edges, so the CPU is idle unless an IR signal is
+actually being received (the IRremote library sampled the pin from a 50us timer
+interrupt, 20000 times a second, and decoded the samples in loop()).
+
+As commands are decoded they are cached in a circular buffer until they are
+retrieved by an external device via the I2C interface. A maximum of 16 commands
+can be buffered. If the buffer fills up then new commands are discarded (and
+counted) rather than overwriting commands not yet retrieved.
+
+The buffer is a single-producer/single-consumer ring: the input capture ISR is the
+only writer of the tail index and the I2C request handler is the only writer of
+the head index, so no critical section is needed to keep them in sync.
 
 This sketch operates as an I2C slave at address 0x45 by default (can be changed via
-constant IR_REMOTE_I2C_ADDRESS in RTL_IR_RemoteDecoder.h). Simply performing an I2C 
-request operation to this address will return the next command in the buffer. If no
-command is available then a command with a type code of 0 is returned.
+constant IR_REMOTE_I2C_ADDRESS in RTL_IR_RemoteDecoder.h). Performing an I2C request
+operation to this address returns an IRRemoteBatch (protocol v2.1): a 7 byte header
+(version, command count, overflow count, dropped count, age, sensor bits) followed
+by up to 4 commands. All pending commands (up to 4) are returned in one transaction; if the
+count is 4 the master should request again to get the rest. The age is how long
+the first command in the response has been waiting, so the master can measure the
+latency from keypress (decode) to action.
+
+While commands are waiting in the buffer, or the sensor bits have changed since
+the last request, the decoder pulls the "commands pending" line (IR_READY_PIN,
+pin 3) low. The line is open-drain (driven low or left floating) so it needs a
+pull-up on the master side; the master only has to read the decoder when the line
+is low.
+
+SENSOR HUB
+
+If HUB_SENSORS = 1, the three IR proximity sensors and the step sensor are also
+wired to pins 4-7 of this board (in parallel with the main board, which keeps its
+own interrupt-level safety reflex on them). All four are on port D, so a Timer2
+interrupt samples them with a single port read every millisecond and debounces
+them (4 samples). The debounced bits are returned in every IRRemoteBatch header,
+with HUB_SENSORS_VALID set. HUB_SENSORS is 0 by default: the hub can't tell
+unconnected pins from sensors, and the main board would act on whatever the
+floating inputs read, so only set it on a board that has the wiring.
+
+Optionally (HUB_SONAR = 1) the hub also owns the ultrasonic sensor: it pings
+every SONAR_INTERVAL milliseconds, timing the echo with the INT0 interrupt, so
+the main board doesn't have to block in pulseIn().
+
+Writing HUB_REG_SENSORS before a request returns a SensorHubSnapshot instead of
+a batch: the sensor bits plus change count, the last sonar range and the ages of
+both.
 
 A command returned by the I2C interface is defined by the IRRemoteCommand struct
 (declared in RTL_IR_RemoteDecoder.h), which is 6 bytes long and consists of 3 fields:
@@ -28,46 +70,420 @@ A command returned by the I2C interface is defined by the IRRemoteCommand struct
 Field     DataType  Description
 --------  --------  ------------------------------------------------------------
 Type       uint8    Command type: 0=no command; 1=normal command; 3=repeated command.
-Protocol   uint8    Indicates the command protocol. See enum decode_type_t in IRremote.h
-                    for possible values. Currently only the NEC protocol is 
+Protocol   uint8    Indicates the command protocol (the decode_type_t values from the
+                    IRremote library are kept). Currently only the NEC protocol is
                     implemented, so this value will always be 3.
 Code       uint32   The actual command code. The meaning of the command code is
                     dependent on the protocol. See RTL_IR_CommandCodes.h for NEC
                     command codes.
 ******************************************************************************/
 
-#include <ir_Lego_PF_BitStreamEncoder.h>
-#include <IRremoteInt.h>
-#include <IRremote.h>
-#include <boarddefs.h>
 #define DEBUG 0
 
 #include <Arduino.h>
 #include <Wire.h>
 #include <RTL_Stdlib.h>
 #include <RTL_Debug.h>
-#include <IRRemoteReceiver.h>
 #include "RTL_IR_RemoteDecoder.h"
 
 
-const int IR_SENSOR_PIN = 2;        // Digital pin connected to the IR sensor
-const int IR_CMD_BUFFER_LEN = 10;   // Command buffer length
+const int IR_SENSOR_PIN = 8;        // Digital pin connected to the IR sensor (ICP1 - must be pin 8)
+const int IR_READY_PIN = 3;         // "Commands pending" line to the master (open-drain, active low)
+const byte IR_CMD_BUFFER_LEN = 16;  // Command buffer length (must be a power of 2)
+const byte IR_CMD_BUFFER_MASK = IR_CMD_BUFFER_LEN - 1;
+const byte NEC_PROTOCOL = 3;        // IRremote decode_type_t value for NEC
 
-static IRRemoteReceiver irReceiver(IR_SENSOR_PIN, LED_BUILTIN);
+// Sensor hub pins. The proximity and step sensors must all be on port D (pins 4-7)
+const int PROX_RIGHT_PIN = 4;       // Right IR proximity sensor (low when triggered)
+const int PROX_FRONT_PIN = 5;       // Front IR proximity sensor (low when triggered)
+const int PROX_LEFT_PIN = 6;        // Left IR proximity sensor (low when triggered)
+const int STEP_PIN = 7;             // Step sensor (high when there is no floor)
+const int SONAR_ECHO_PIN = 2;       // Ultrasonic sensor echo (INT0)
+const int SONAR_TRIGGER_PIN = 9;    // Ultrasonic sensor trigger
 
+#define HUB_SENSORS 0               // 1 if the proximity and step sensors are wired to the hub
+#define HUB_SONAR   0               // 1 if the ultrasonic sensor is wired to the hub
+
+const byte DEBOUNCE_SAMPLES = 4;            // Samples (ms) a sensor must agree before it changes
+const uint16_t SONAR_INTERVAL = 30;         // Milliseconds between sonar pings
+const uint32_t SONAR_TIMEOUT = 25000;       // Microseconds to wait for an echo (~4m)
+
+const uint32_t REPORT_INTERVAL = 10000;    // Milliseconds between decoder statistics reports
+
+// Command ring buffer. The head and tail are free-running counters (the buffer
+// index is the counter masked by IR_CMD_BUFFER_MASK), so tail - head is always
+// the number of commands in the buffer.
 static IRRemoteCommand buffer[IR_CMD_BUFFER_LEN];
-static byte bufferHead = 0;
-static byte bufferTail = 0;
-static byte bufferCount = 0;
+static uint16_t bufferTime[IR_CMD_BUFFER_LEN];     // millis() (low 16 bits) when each command was decoded
+static volatile byte bufferHead = 0;    // Only written by RequestI2C()
+static volatile byte bufferTail = 0;    // Only written by the input capture ISR
+
+static volatile byte overflowCount = 0; // Commands discarded because the buffer was full
+static volatile byte droppedCount = 0;  // IR frames discarded because of bad timing
 
 static uint32_t lastCommandCode = IR_NONE;
 
+static volatile byte hubRegister = HUB_REG_IR_BATCH;   // Register selected for the next request
+
+
+//******************************************************************************
+// NEC decoder
+//
+// Timer1 runs at 250kHz (4us per tick) and captures the time of each edge on
+// ICP1. The IR sensor output is low during a mark (carrier present) and high
+// during a space. A NEC frame is:
+//
+//   9ms mark, 4.5ms space                       leader
+//   32 x (560us mark, 560us or 1690us space)    data bits (0 or 1)
+//   560us mark                                  stop bit
+//
+// A repeat frame (sent every 108ms while a key is held) is a 9ms mark, a 2.25ms
+// space and a 560us mark. Bits are shifted in MSB first so the codes match the
+// values the IRremote library reported (see RTL_IR_CommandCodes.h).
+//
+// The compare match A interrupt is set a little past each edge to reset the
+// state machine if a frame stops part way through.
+//******************************************************************************
+enum NecState : byte
+{
+    NEC_IDLE,               // Waiting for the falling edge that starts a leader mark
+    NEC_LEADER_MARK,        // In the leader mark, waiting for its rising edge
+    NEC_LEADER_SPACE,       // In the leader space, waiting for the falling edge
+    NEC_DATA_MARK,          // In a data (or stop) bit mark
+    NEC_DATA_SPACE,         // In a data bit space
+    NEC_REPEAT_MARK         // In the stop mark of a repeat frame
+};
+
+constexpr uint16_t Ticks(uint32_t us) { return us / 4; }
+
+// True if a duration (in ticks) is within 30% of the nominal time (in microseconds)
+constexpr bool Match(uint16_t ticks, uint32_t us)
+{
+    return (ticks >= Ticks(us * 7 / 10)) && (ticks <= Ticks(us * 13 / 10));
+}
+
+const uint16_t NEC_TIMEOUT = Ticks(12000);      // Longest gap between edges within a frame
+
+static volatile NecState necState = NEC_IDLE;
+static uint16_t necLastEdge = 0;                // ICR1 at the previous edge
+static uint32_t necData = 0;
+static byte necBitCount = 0;
+
+// Decoder statistics, used to measure CPU load and decode latency
+static volatile uint32_t isrTicks = 0;          // Timer1 ticks spent in the capture ISR
+static volatile uint16_t latencyTicks = 0;      // Final edge to command queued, for the last command
+static volatile uint16_t frameCount = 0;        // Commands decoded
+
+
+static void BeginNecDecoder()
+{
+    pinMode(IR_SENSOR_PIN, INPUT);
+
+    noInterrupts();
+    TCCR1A = 0;
+    TCCR1B = _BV(ICNC1) | _BV(CS11) | _BV(CS10);   // Noise canceler, falling edge, clk/64 (4us)
+    TIFR1 = _BV(ICF1) | _BV(OCF1A);
+    TIMSK1 = _BV(ICIE1);
+    interrupts();
+}
+
+
+static inline void WaitForEdge(bool isRising)
+{
+    if (isRising)
+        TCCR1B |= _BV(ICES1);
+    else
+        TCCR1B &= ~_BV(ICES1);
+
+    TIFR1 = _BV(ICF1);      // Changing the edge can set the capture flag
+}
+
+
+static void PushCommand(byte type, uint32_t code, uint16_t edge)
+{
+    if (byte(bufferTail - bufferHead) >= IR_CMD_BUFFER_LEN)
+    {
+        // The slots between head and tail belong to the consumer (RequestI2C)
+        overflowCount++;
+        return;
+    }
+
+    auto& command = buffer[bufferTail & IR_CMD_BUFFER_MASK];
+
+    command.Type = type;
+    command.Protocol = NEC_PROTOCOL;
+    command.Code = code;
+    bufferTime[bufferTail & IR_CMD_BUFFER_MASK] = millis();
+
+    // Make sure the command is in the buffer before publishing the new tail
+    __asm__ __volatile__("" ::: "memory");
+    bufferTail++;
+    SetReady(true);
+
+    latencyTicks = TCNT1 - edge;
+    frameCount++;
+}
+
+
+ISR(TIMER1_CAPT_vect)
+{
+    uint16_t entry = TCNT1;
+    uint16_t edge = ICR1;
+    uint16_t width = edge - necLastEdge;
+    auto state = necState;
+
+    necLastEdge = edge;
+
+    switch (state)
+    {
+        case NEC_IDLE:
+            state = NEC_LEADER_MARK;
+            break;
+
+        case NEC_LEADER_MARK:
+            state = Match(width, 9000) ? NEC_LEADER_SPACE : NEC_IDLE;
+            break;
+
+        case NEC_LEADER_SPACE:
+            if (Match(width, 4500))
+            {
+                necData = 0;
+                necBitCount = 0;
+                state = NEC_DATA_MARK;
+            }
+            else if (Match(width, 2250))
+            {
+                state = NEC_REPEAT_MARK;
+            }
+            else
+            {
+                state = NEC_LEADER_MARK;    // This falling edge may start a new leader
+            }
+            break;
+
+        case NEC_DATA_MARK:
+            if (!Match(width, 560))
+            {
+                droppedCount++;
+                state = NEC_IDLE;
+            }
+            else if (necBitCount == 32)
+            {
+                // End of the stop bit - command complete
+                lastCommandCode = necData;
+                PushCommand(IRRemoteCommandType::Normal, necData, edge);
+                state = NEC_IDLE;
+            }
+            else
+            {
+                state = NEC_DATA_SPACE;
+            }
+            break;
+
+        case NEC_DATA_SPACE:
+            if (Match(width, 560) || Match(width, 1690))
+            {
+                necData = (necData << 1) | (width > Ticks(1125) ? 1 : 0);
+                necBitCount++;
+                state = NEC_DATA_MARK;
+            }
+            else
+            {
+                droppedCount++;
+                state = NEC_LEADER_MARK;    // This falling edge may start a new leader
+            }
+            break;
+
+        case NEC_REPEAT_MARK:
+            if (Match(width, 560) && lastCommandCode != IR_NONE)
+            {
+                PushCommand(IRRemoteCommandType::Repeat, lastCommandCode, edge);
+            }
+            state = NEC_IDLE;
+            break;
+    }
+
+    necState = state;
+
+    // Marks end on a rising edge, spaces (and idle) end on a falling edge
+    WaitForEdge(state == NEC_LEADER_MARK || state == NEC_DATA_MARK || state == NEC_REPEAT_MARK);
+
+    // Abandon the frame if the next edge doesn't arrive in time
+    if (state == NEC_IDLE)
+    {
+        TIMSK1 &= ~_BV(OCIE1A);
+    }
+    else
+    {
+        OCR1A = edge + NEC_TIMEOUT;
+        TIFR1 = _BV(OCF1A);
+        TIMSK1 |= _BV(OCIE1A);
+    }
+
+    isrTicks += uint16_t(TCNT1 - entry);
+}
+
+
+ISR(TIMER1_COMPA_vect)
+{
+    if (necState == NEC_DATA_MARK || necState == NEC_DATA_SPACE) droppedCount++;
+
+    necState = NEC_IDLE;
+    WaitForEdge(false);
+    TIMSK1 &= ~_BV(OCIE1A);
+}
+
+
+//******************************************************************************
+// Sensor hub
+//
+// Timer2 interrupts every millisecond (CTC mode, clk/64, OCR2A = 249). The ISR
+// reads port D once, converts the pin levels to HUB_xxx bits and runs a
+// saturating integrator for each sensor, so a sensor has to read the same for
+// DEBOUNCE_SAMPLES samples in a row before its bit changes.
+//******************************************************************************
+static volatile byte sensorState = 0;           // Debounced sensor bits
+static volatile byte sensorChanges = 0;         // Number of debounced changes
+static volatile uint16_t sensorTime = 0;        // millis() (low 16 bits) of the last change
+static byte integrators[4];
+
+static volatile byte pingCount = 0;             // Number of completed pings
+static volatile uint16_t pingRange = HUB_NO_ECHO;
+static volatile uint16_t pingTime = 0;          // millis() (low 16 bits) when the last ping completed
+static volatile uint32_t echoStart = 0;         // micros() at the rising edge of the echo
+static volatile uint32_t echoEnd = 0;           // micros() at the falling edge of the echo (0 while waiting)
+
+
+static void BeginSensorHub()
+{
+    if (HUB_SENSORS)
+    {
+        pinMode(PROX_RIGHT_PIN, INPUT);
+        pinMode(PROX_FRONT_PIN, INPUT);
+        pinMode(PROX_LEFT_PIN, INPUT);
+        pinMode(STEP_PIN, INPUT);
+
+        noInterrupts();
+        TCCR2A = _BV(WGM21);                // CTC mode
+        TCCR2B = _BV(CS22);                 // clk/64 (4us)
+        OCR2A = 249;                        // 250 x 4us = 1ms
+        TIMSK2 = _BV(OCIE2A);
+        interrupts();
+    }
+
+    if (HUB_SONAR)
+    {
+        pinMode(SONAR_TRIGGER_PIN, OUTPUT);
+        pinMode(SONAR_ECHO_PIN, INPUT);
+        attachInterrupt(digitalPinToInterrupt(SONAR_ECHO_PIN), EchoISR, CHANGE);
+    }
+}
+
+
+ISR(TIMER2_COMPA_vect)
+{
+    byte pins = PIND;
+    byte raw = 0;
+
+    // The proximity sensors pull their output low when triggered; the step
+    // sensor output goes high when it no longer sees the floor. Pins 0-7 are
+    // bits 0-7 of port D.
+    if (!(pins & _BV(PROX_RIGHT_PIN))) raw |= HUB_PROX_RIGHT;
+    if (!(pins & _BV(PROX_FRONT_PIN))) raw |= HUB_PROX_FRONT;
+    if (!(pins & _BV(PROX_LEFT_PIN))) raw |= HUB_PROX_LEFT;
+    if (pins & _BV(STEP_PIN)) raw |= HUB_STEP;
+
+    byte state = sensorState;
+
+    for (byte i = 0; i < 4; i++)
+    {
+        byte bit = 1 << i;
+
+        if (raw & bit)
+        {
+            if (integrators[i] < DEBOUNCE_SAMPLES && ++integrators[i] == DEBOUNCE_SAMPLES) state |= bit;
+        }
+        else
+        {
+            if (integrators[i] > 0 && --integrators[i] == 0) state &= ~bit;
+        }
+    }
+
+    if (state != sensorState)
+    {
+        sensorState = state;
+        sensorChanges++;
+        sensorTime = millis();
+        SetReady(true);
+    }
+}
+
+
+static void EchoISR()
+{
+    if (digitalRead(SONAR_ECHO_PIN))
+        echoStart = micros();
+    else
+        echoEnd = micros();
+}
+
+
+//******************************************************************************
+// Runs the sonar ping cycle from loop(): trigger, then wait (without blocking)
+// for the echo ISR to time the echo or for the timeout.
+//******************************************************************************
+static void PollSonar()
+{
+    static bool isPinging = false;
+    static uint32_t triggerTime = 0;
+    static uint32_t lastPing = 0;
+
+    if (!isPinging)
+    {
+        if ((millis() - lastPing) < SONAR_INTERVAL) return;
+
+        lastPing = millis();
+        echoStart = 0;
+        echoEnd = 0;
+        digitalWrite(SONAR_TRIGGER_PIN, HIGH);
+        delayMicroseconds(10);
+        digitalWrite(SONAR_TRIGGER_PIN, LOW);
+        triggerTime = micros();
+        isPinging = true;
+        return;
+    }
+
+    uint16_t range;
+
+    noInterrupts();
+    auto start = echoStart;
+    auto end = echoEnd;
+    interrupts();
+
+    if (end != 0 && start != 0)
+        range = (end - start) / 58;     // Round trip at ~58us per centimeter
+    else if ((micros() - triggerTime) > SONAR_TIMEOUT)
+        range = HUB_NO_ECHO;
+    else
+        return;
+
+    noInterrupts();
+    pingRange = range;
+    pingTime = millis();
+    pingCount++;
+    interrupts();
+
+    isPinging = false;
+}
+
 
 void setup()
 {
     Serial.begin(115200);
     Wire.begin(IR_REMOTE_I2C_ADDRESS);
-    irReceiver.Begin();
+    BeginNecDecoder();
+    BeginSensorHub();
+    SetReady(false);
 
     // Configure Slave interrupt handlers
     Wire.onReceive(ReceiveI2C);         // interrupt handler for incoming messages
@@ -77,68 +493,41 @@ void setup()
 }
 
 
+//******************************************************************************
+// All decoding and sensor sampling is done in the ISRs, so all loop() has to
+// do is run the sonar (if the hub owns it) and report the decoder's CPU load
+// and decode latency.
+//******************************************************************************
 void loop()
 {
-    decode_results results;
+    static uint32_t reportTime = 0;
+    static uint16_t reportFrames = 0;
 
-    // check to see if the receiver has received a command
-    if (!irReceiver.decode(&results)) return;
+    if (HUB_SONAR) PollSonar();
 
-    TRACE(Logger() << F("Decoded=") << _HEX(results.value) << endl);
+    auto now = millis();
 
-    // buffer the decoded command
-    if (!results.overflow)
-    {
-        IRRemoteCommand command;
+    if ((now - reportTime) < REPORT_INTERVAL) return;
 
-        command.Protocol = results.decode_type;
+    noInterrupts();
+    auto ticks = isrTicks;
+    auto latency = latencyTicks;
+    auto frames = frameCount;
+    isrTicks = 0;
+    interrupts();
 
-        if (results.value != IR_REPEAT)
-        {
-            command.Type = IRRemoteCommandType::Normal;
-            command.Code = results.value;
-            lastCommandCode = results.value;
-        }
-        else
-        {
-            command.Type = IRRemoteCommandType::Repeat;
-            command.Code = lastCommandCode;
-        }
+    // Only report when something was received
+    if (frames != reportFrames)
+    {
+        // CPU load in hundredths of a percent: ticks * 4us / (interval * 1000us) * 10000
+        auto load = ticks * 4 * 10 / (now - reportTime);
 
-        // BEGIN CRITICAL SECTION while updating command buffer
-        // This critical section is necessary to prevent any incoming I2C 
-        // requests from interfering with the buffer update. It is possible
-        // that an I2C request could try to read the buffer while this
-        // update is occurring, which could cause the buffer head and tail
-        // to get out of sync.
-        // This may be overkill since I think the only really critical line
-        // of code is in the else clause below. However, a buffer update
-        // should be treated as an atomic operation, and a 16MHz UNO/Nano 
-        // has ample performance for this, so it doesn't hurt anything to 
-        // mark the entire buffer update operation as a critical section. 
-        // The whole critical section should be no more than 5 microseconds.
-        noInterrupts(); 
-        {
-            buffer[bufferTail] = command;
-            bufferTail = (bufferTail + 1) % IR_CMD_BUFFER_LEN;
-    
-            if (bufferCount < IR_CMD_BUFFER_LEN)
-            {
-                bufferCount++;
-            }
-            else
-            {
-                // Buffer was full and current head was overwritten, so bump head to next command in buffer
-                bufferHead = (bufferHead + 1) % IR_CMD_BUFFER_LEN;
-            }
-        }
-        interrupts(); // END CRITICAL SECTION
-        
-        TRACE(Logger() << F("bufferHead=") << bufferHead << F(", bufferTail=") << bufferTail << F(", bufferCount=") << bufferCount << endl);
+        Logger() << F("IR decoder: frames=") << frames << F(", cpu=") << load / 100 << '.' << (load % 100 < 10 ? F("0") : F("")) << load % 100
+                 << F("%, latency=") << latency * 4 << F("us") << endl;
     }
 
-    // Ready to listen for another command
-    irReceiver.resume();
+    reportFrames = frames;
+    reportTime = now;
 }
 
 
@@ -147,6 +536,9 @@ void loop()
 //******************************************************************************
 static void ReceiveI2C(int messageLength)
 {
+    if (Wire.available()) hubRegister = Wire.read();
+
+    while (Wire.available()) Wire.read();
 }
 
 
@@ -155,15 +547,69 @@ static void ReceiveI2C(int messageLength)
 //******************************************************************************
 static void RequestI2C()
 {
-    IRRemoteCommand command { 0, 0, 0 };
+    if (hubRegister == HUB_REG_SENSORS)
+        SendSnapshot();
+    else
+        SendBatch();
 
-    // Critical section not needed here since interrupts already disabled inside IRQ handler
-    if (bufferCount > 0)
-    {
-        command = buffer[bufferHead];
-        bufferHead = (bufferHead + 1) % IR_CMD_BUFFER_LEN;
-        bufferCount--;
-    }
+    hubRegister = HUB_REG_IR_BATCH;     // Selection only lasts for one request
 
-    Wire.write((uint8_t*)&command, sizeof(command));
+    if (bufferHead == bufferTail) SetReady(false);
+}
+
+
+static byte HubStatus()
+{
+    return sensorState | (HUB_SENSORS ? HUB_SENSORS_VALID : 0) | (HUB_SONAR ? HUB_SONAR_VALID : 0);
+}
+
+
+static void SendBatch()
+{
+    IRRemoteBatch batch;
+    byte head = bufferHead;
+    byte count = min(byte(bufferTail - head), byte(IR_REMOTE_MAX_BATCH));
+
+    memset(&batch, 0, sizeof(batch));
+    batch.Header.Version = IR_REMOTE_PROTOCOL_VERSION;
+    batch.Header.Count = count;
+    batch.Header.Overflows = overflowCount;
+    batch.Header.Dropped = droppedCount;
+    batch.Header.Age = (count > 0) ? uint16_t(millis()) - bufferTime[head & IR_CMD_BUFFER_MASK] : 0;
+    batch.Header.Sensors = HubStatus();
+
+    for (byte i = 0; i < count; i++) batch.Commands[i] = buffer[head++ & IR_CMD_BUFFER_MASK];
+
+    // Release the slots back to the producer only after the commands have been copied
+    bufferHead = head;
+
+    Wire.write((uint8_t*)&batch, sizeof(batch));
+}
+
+
+static void SendSnapshot()
+{
+    SensorHubSnapshot snapshot;
+    uint16_t now = millis();
+
+    snapshot.Version = IR_REMOTE_PROTOCOL_VERSION;
+    snapshot.Sensors = HubStatus();
+    snapshot.Changes = sensorChanges;
+    snapshot.PingCount = pingCount;
+    snapshot.SensorAge = now - sensorTime;
+    snapshot.Range = pingRange;
+    snapshot.RangeAge = now - pingTime;
+
+    Wire.write((uint8_t*)&snapshot, sizeof(snapshot));
+}
+
+
+//******************************************************************************
+// Drives the "commands pending" line. The line is open-drain: it is pulled low
+// when commands are pending and left floating (input) otherwise.
+//******************************************************************************
+static void SetReady(bool isReady)
+{
+    digitalWrite(IR_READY_PIN, LOW);
+    pinMode(IR_READY_PIN, isReady ? OUTPUT : INPUT);
 }
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdint.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Alpha-beta tracker for the range to the obstacle ahead, giving its closing
+/// speed and the time to collision.
+/// </summary>
+/// <remarks>
+/// Each reading is compared with the range predicted from the previous
+/// estimate and rate. The range is moved alpha of the way to the reading, and
+/// the rate by beta of the difference per unit time - a fixed-gain (steady
+/// state) Kalman filter for a constant velocity target, with no matrices to
+/// carry around.
+///
+/// A reading more than GATE from the prediction is treated as an outlier (a
+/// stray echo, or the beam catching something to the side) and the track
+/// coasts on its prediction. After MAX_MISSES outliers or empty readings in a
+/// row the track is dropped, and the next reading starts a new one - that is
+/// how a new, nearer obstacle takes over. A track only counts (IsValid()) once
+/// CONFIRM readings have agreed with it, so a single echo can't produce a
+/// time to collision.
+///
+/// Ranges are in cm, times in seconds, and the rate is positive when the
+/// range is opening. Like CourseController this is free of any Arduino headers
+/// so the host-side simulation (Tools/ApproachSim.cpp) runs the same code.
+/// </remarks>
+//******************************************************************************
+class RangeTracker
+{
+    /*--------------------------------------------------------------------------
+    Constants
+    --------------------------------------------------------------------------*/
+    public: static constexpr float GATE = 25;           // Largest believable innovation (cm)
+    public: static constexpr uint8_t CONFIRM = 3;       // Readings before the track is valid
+    public: static constexpr uint8_t MAX_MISSES = 3;    // Outliers/misses in a row before the track is dropped
+    public: static constexpr float MIN_CLOSING = 1;     // Closing slower than this (cm/s) is not a collision course
+    public: static constexpr float NO_COLLISION = 99;   // TimeToCollision() when not closing (s)
+
+    /*--------------------------------------------------------------------------
+    Constructors
+    --------------------------------------------------------------------------*/
+    public: RangeTracker(float alpha, float beta) : _alpha(alpha), _beta(beta) {};
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+    public: void Reset()
+    {
+        _hits = 0;
+        _misses = 0;
+        _rate = 0;
+    }
+
+    //**************************************************************************
+    /// <summary>
+    /// Adds a range reading taken dt seconds after the previous one.
+    /// </summary>
+    //**************************************************************************
+    public: void Update(float range, float dt)
+    {
+        if (_hits == 0 || dt <= 0)
+        {
+            Start(range);
+            return;
+        }
+
+        auto predicted = _range + _rate * dt;
+        auto innovation = range - predicted;
+
+        if (innovation > GATE || innovation < -GATE)
+        {
+            if (++_misses >= MAX_MISSES)
+                Start(range);
+            else
+                _range = predicted;
+
+            return;
+        }
+
+        _range = predicted + _alpha * innovation;
+        _rate += _beta * innovation / dt;
+        _misses = 0;
+
+        if (_hits < CONFIRM) _hits++;
+    }
+
+    //**************************************************************************
+    /// <summary>
+    /// Records that nothing was seen within range. The track coasts for up to
+    /// MAX_MISSES of these before it is dropped.
+    /// </summary>
+    //**************************************************************************
+    public: void Miss(float dt)
+    {
+        if (_hits == 0) return;
+
+        if (++_misses >= MAX_MISSES)
+            Reset();
+        else
+            _range += _rate * dt;
+    }
+
+    public: bool IsValid() const { return _hits >= CONFIRM; };
+    public: float Range() const { return _range; };
+    public: float Rate() const { return _rate; };
+    public: float Closing() const { return _rate < 0 ? -_rate : 0; };
+
+    /// <summary>Seconds until the range reaches zero at the current closing speed</summary>
+    public: float TimeToCollision() const
+    {
+        if (!IsValid() || _rate > -MIN_CLOSING) return NO_COLLISION;
+
+        auto ttc = _range / -_rate;
+
+        return ttc < NO_COLLISION ? (ttc > 0 ? ttc : 0) : NO_COLLISION;
+    }
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+    private: void Start(float range)
+    {
+        _range = range;
+        _rate = 0;
+        _hits = 1;
+        _misses = 0;
+    }
+
+    private: float _alpha;
+    private: float _beta;
+    private: float _range = 0;          // Estimated range (cm)
+    private: float _rate = 0;           // Estimated range rate (cm/s, negative closing)
+    private: uint8_t _hits = 0;         // Readings in the track so far (up to CONFIRM), 0 = no track
+    private: uint8_t _misses = 0;       // Outliers/misses in a row
+};
@@ -13,6 +13,13 @@
 // Constants
 //******************************************************************************
 const int LED_PIN = 13;             // Hardware LED pin
+const int IR_READY_PIN = 2;         // IR remote decoder "commands pending" line (active low)
+
+//******************************************************************************
+// EEPROM layout
+//******************************************************************************
+const int EEPROM_SERVO_MODEL = 0;   // Sonar pan servo model (Sonar::ServoModel record)
+const int EEPROM_COURSE_GAINS = 16; // Course correction gain table (TaskCorrectCourse)
 
 //******************************************************************************
 // Forward declarations
@@ -21,6 +28,7 @@ void BlinkLED(uint16_t onTime = 100, uint16_t offTime = 0);
 void BlinkLEDCount(uint16_t count, uint16_t onTime = 100, uint16_t offTime = 100);
 void IndicateFailure(const __FlashStringHelper* msg = nullptr);
 void IndicateFailure(int step, const __FlashStringHelper* msg, bool loopForever = false);
+void ProcessSerialCommand(char command);
 //void PerformMagCalibration();
 
 
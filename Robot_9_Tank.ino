@@ -19,6 +19,7 @@
  ******************************************************************************/
 
 #define DEBUG 1
+#define TELEMETRY 0     // 1 = stream binary telemetry records (see Telemetry.h)
 
 #include <Arduino.h>
 #include <avr/wdt.h>
@@ -28,11 +29,18 @@
 #include <RTL_Blinker.h>
 #include <RTL_TaskManager.h>
 #include <EventQueue.h>
+#include "Scheduler.h"
+#include "EventLanes.h"
 
 #include "Robot_9_Tank.h"
 #include "IMU.h"
 #include "Sonar.h"
+#include "Memory.h"
+#include "Metrics.h"
 #include "Movement.h"
+#include "Safety.h"
+#include "ScanLog.h"
+#include "Telemetry.h"
 #include "Tasks.h"
 #include "States.h"
 
@@ -53,6 +61,7 @@ StateBackupToAvoidObstacle  backupToAvoidObstacleState;
 TaskSpin spinTask;
 TaskTurn turnTask;
 TaskBackup backupTask;
+TaskHeading headingTask;
 TaskIRRemote irRemoteTask;
 TaskScanSonar scanSonarTask;
 TaskStepDetection stepDetectionTask;
@@ -73,6 +82,8 @@ void setup()
 {
     Serial.begin(115200);
 
+    if (TELEMETRY) Telemetry::Begin();
+
     int STEP_INIT_MOTORCTRLR;
     int STEP_INIT_IRREMOTE;
     int STEP_INIT_IMU;
@@ -116,6 +127,7 @@ void setup()
     Movement::motorController.Begin();
     Logger() << F("Motor shield configured.") << endl;
     Movement::Stop();     // Ensure the motors are stopped
+    Safety::Begin();      // Arm the cliff/collision reflex interrupts
 
     //--------------------------------------------------------------------------
     // Determine connectivity to IR Remote receiver
@@ -128,6 +140,8 @@ void setup()
     if (!status.IR_REMOTE_VALID) 
         IndicateFailure(STEP_INIT_IRREMOTE, F("IR Remote receiver not found."), true);
 
+    irRemoteTask.Begin();
+
     //--------------------------------------------------------------------------
     // Determine connectivity to IMU
     // If the IMU is not found or fails to initialize then use some other means for
@@ -154,6 +168,11 @@ void setup()
     Sonar::SonarBegin();
     Logger() << F("Sonar initialized.") << endl;
 
+    //--------------------------------------------------------------------------
+    // Load the course correction gains
+    //--------------------------------------------------------------------------
+    correctCourseTask.Begin();
+
     //--------------------------------------------------------------------------
     // Initialize state machine to the stopped state;
     //--------------------------------------------------------------------------
@@ -166,6 +185,7 @@ void setup()
     //--------------------------------------------------------------------------
     heartbeat.Start();
     wdt_enable(WDTO_4S);
+    Memory::Report();
     Logger() << F("Robot ready.") << endl << endl;
 }
 
@@ -175,13 +195,51 @@ void setup()
 //******************************************************************************
 void loop()
 {
+    Safety::Service();
     heartbeat.Poll();
     irRemoteTask.Poll();
+    Scheduler::Dispatch();
+    EventLanes::Dispatch();
     TaskManager::Dispatch();
+    ScanLog::Service();
+    if (Serial.available()) ProcessSerialCommand(Serial.read());
     wdt_reset();
 }
 
 
+//******************************************************************************
+// Serial commands (single characters) for diagnostics
+//******************************************************************************
+void ProcessSerialCommand(char command)
+{
+    switch (command)
+    {
+        case 'm':   // Memory usage
+            Memory::Report();
+            break;
+
+        case 'k':   // Performance counters (KPIs)
+            Metrics::Report();
+            break;
+
+        case 's':   // Scan cache statistics
+            scanSonarTask.Report();
+            break;
+
+        case 'c':   // CPU budget (loop and task run times)
+            Scheduler::Report();
+            break;
+
+        case 'e':   // Event lane statistics
+            EventLanes::Report();
+            break;
+
+        default:
+            break;
+    }
+}
+
+
 //******************************************************************************
 // Utility functions
 //******************************************************************************
@@ -0,0 +1,152 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+#include <avr/wdt.h>
+
+#include <RTL_Stdlib.h>
+#include "Movement.h"
+#include "Safety.h"
+
+
+// The ISRs below are tied to these pins (pin 12 = PB4/PCINT4, pin 6 = PD6/PCINT22)
+constexpr uint8_t STEP_PIN = 12;            // Step sensor, high when there is no floor
+constexpr uint8_t FRONT_PIN = 6;            // Front proximity sensor, low when an obstacle is seen
+constexpr uint8_t STEP_MASK = _BV(4);       // Step sensor bit in PINB
+constexpr uint8_t FRONT_MASK = _BV(6);      // Front sensor bit in PIND
+
+
+//******************************************************************************
+// State shared with the ISRs
+//******************************************************************************
+static volatile bool armed = false;         // Set while the motors are driving forward
+static volatile uint8_t faults = 0;         // Latched faults (STEP_FAULT, FRONT_FAULT)
+static volatile uint32_t edgeTime = 0;      // micros() at the edge that latched the first fault
+
+static bool stopped = false;                // Motors have been stopped for the latched faults
+static uint16_t lastLatency = 0;            // Edge to motor stop time for the last fault (microseconds)
+static uint16_t maxLatency = 0;             // Worst edge to motor stop time seen (microseconds)
+
+
+static inline void Latch(uint8_t fault)
+{
+    if (faults == 0) edgeTime = micros();
+
+    faults |= fault;
+}
+
+
+ISR(PCINT0_vect)
+{
+    if (armed && (PINB & STEP_MASK)) Latch(Safety::STEP_FAULT);
+}
+
+
+ISR(PCINT2_vect)
+{
+    if (armed && !(PIND & FRONT_MASK)) Latch(Safety::FRONT_FAULT);
+}
+
+
+namespace Safety
+{
+    void Begin()
+    {
+        pinMode(STEP_PIN, INPUT);
+        pinMode(FRONT_PIN, INPUT);
+
+        noInterrupts();
+        *digitalPinToPCMSK(STEP_PIN) |= bit(digitalPinToPCMSKbit(STEP_PIN));
+        *digitalPinToPCMSK(FRONT_PIN) |= bit(digitalPinToPCMSKbit(FRONT_PIN));
+        PCIFR = bit(digitalPinToPCICRbit(STEP_PIN)) | bit(digitalPinToPCICRbit(FRONT_PIN));
+        *digitalPinToPCICR(STEP_PIN) |= bit(digitalPinToPCICRbit(STEP_PIN)) | bit(digitalPinToPCICRbit(FRONT_PIN));
+        interrupts();
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Stops the motors if a fault has been latched since the last call.
+    /// </summary>
+    /// <remarks>
+    /// This is the safe point for the reflex. It must be called often: from the
+    /// main loop and from any code that waits in a loop.
+    /// </remarks>
+    //**************************************************************************
+    void Service()
+    {
+        if (faults == 0 || stopped) return;
+
+        Movement::Stop();   // Records the latency through MotorsChanged()
+        stopped = true;     // Even if the motors didn't take the command
+
+        Logger(F("Safety")) << F("Reflex stop, faults=0x") << _HEX(faults) << F(", latency=") << lastLatency << F("us, max=") << maxLatency << F("us") << endl;
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// A delay() that keeps the reflex and the watchdog serviced.
+    /// </summary>
+    //**************************************************************************
+    void Delay(uint32_t duration)
+    {
+        auto t0 = millis();
+
+        while ((millis() - t0) < duration)
+        {
+            Service();
+            wdt_reset();
+        }
+    }
+
+
+    void Clear()
+    {
+        noInterrupts();
+        faults = 0;
+        interrupts();
+
+        stopped = false;
+    }
+
+
+    uint8_t Faults()
+    {
+        return faults;
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Called by Movement::SetMotors() after the motors have been set. Arms the
+    /// interrupts while driving forward. Any other command stops forward
+    /// motion, so it also ends the reflex for a latched fault.
+    /// </summary>
+    //**************************************************************************
+    void MotorsChanged(bool forward)
+    {
+        armed = forward;
+
+        if (forward || faults == 0 || stopped) return;
+
+        noInterrupts();
+        auto latency = micros() - edgeTime;
+        interrupts();
+
+        stopped = true;
+        lastLatency = (latency > 0xFFFF) ? 0xFFFF : uint16_t(latency);
+        maxLatency = max(maxLatency, lastLatency);
+    }
+
+
+    uint16_t LastLatency()
+    {
+        return lastLatency;
+    }
+
+
+    uint16_t MaxLatency()
+    {
+        return maxLatency;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Interrupt-level cliff and collision reflex.
+/// </summary>
+/// <remarks>
+/// The step sensor (pin 12) and the front proximity sensor (pin 6) are watched
+/// by pin-change interrupts. While the robot is driving forward, an edge that
+/// shows a drop-off or an obstacle ahead latches a fault. The time of the edge
+/// is recorded.
+///
+/// The motor shield is on the I2C bus, and I2C can't be used from inside an
+/// interrupt handler, so the ISR can't stop the motors itself. Instead Service()
+/// stops them at the next safe point. Service() is called on every pass of
+/// the main loop and from inside every blocking wait (backing up, timed
+/// spins, sonar servo moves, the echo wait of a gated ping). The time from
+/// sensor edge to motor stop is measured and reported with each stop, and in
+/// the KPI report.
+///
+/// That time can't get down to the 1ms a reflex in the ISR would give. While
+/// driving forward it is the rest of whatever I2C transfer is under way when
+/// the edge comes (an IMU read or a trim, up to about 1ms at 100kHz), plus
+/// the stop itself: two motor writes to the PWM chip on the shield, about
+/// 3ms at 100kHz. So expect about 2-5ms. The bus can't go faster because of
+/// the PCF8574 on the I2C shield, and the shield's PWM chip has no enable
+/// line wired to the Arduino that an ISR could drop instead.
+///
+/// While a fault is latched the motors refuse forward commands. The sensor
+/// tasks see the latched fault and send their normal events, so the state
+/// machine reacts as it always has. The state that handles the fault calls
+/// Clear() once it has taken over.
+/// </remarks>
+//******************************************************************************
+namespace Safety
+{
+    //******************************************************************************
+    // Constants
+    //******************************************************************************
+    const uint8_t STEP_FAULT = 0x01;    // Drop-off seen by the step sensor
+    const uint8_t FRONT_FAULT = 0x02;   // Obstacle seen by the front proximity sensor
+
+    //******************************************************************************
+    // Function declarations
+    //******************************************************************************
+    void Begin();
+    void Service();
+    void Delay(uint32_t duration);
+    void Clear();
+    uint8_t Faults();
+    void MotorsChanged(bool forward);
+    uint16_t LastLatency();
+    uint16_t MaxLatency();
+}
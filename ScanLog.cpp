@@ -0,0 +1,139 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+
+#include <RTL_Stdlib.h>
+#include "ScanLog.h"
+
+
+namespace ScanLog
+{
+    using namespace Telemetry;
+
+    //******************************************************************************
+    // The scan being recorded, or waiting to be sent
+    //******************************************************************************
+    ScanPoint points[MAX_POINTS];
+    uint8_t count = 0;                  // Points recorded
+    uint8_t sent = 0;                   // Points sent so far (sending while sent < count)
+    uint8_t scan = 0;                   // Scan number
+    uint8_t source = 0;
+    int8_t chosenAngle = NO_CHOICE;
+    uint32_t start = 0;                 // millis() when the scan started
+    uint32_t chosen = 0;                // millis() when the direction was chosen
+    bool isRecording = false;           // Between Begin() and Choose()
+    bool awaitingOutcome = false;       // Between Choose() and the outcome
+
+
+    static void SendOutcome(uint8_t outcome, uint32_t now)
+    {
+        ScanOutcomeRecord record;
+
+        record.scan = scan;
+        record.outcome = outcome;
+        record.elapsed = now - chosen;
+        Send(record);
+        awaitingOutcome = false;
+    }
+
+
+    //******************************************************************************
+    /// <summary>
+    /// Starts recording a scan. This is the outcome of the previous scan if no
+    /// obstacle has been met since it.
+    /// </summary>
+    //******************************************************************************
+    void Begin(ScanSource scanSource)
+    {
+        if (!enabled) return;
+
+        auto now = millis();
+
+        if (awaitingOutcome) SendOutcome(OUTCOME_NEXT_SCAN, now);
+
+        // The last of the previous scan is lost if it hasn't gone out yet
+        if (sent < count) dropped++;
+
+        scan++;
+        source = scanSource;
+        start = now;
+        count = 0;
+        sent = 0;
+        isRecording = true;
+    }
+
+
+    //******************************************************************************
+    /// <summary>
+    /// Adds a ping to the scan (range 0 if it failed). age is how long ago (ms)
+    /// it was taken, for a ping reused from a cache.
+    /// </summary>
+    //******************************************************************************
+    void Add(int16_t angle, uint16_t range, uint16_t age)
+    {
+        if (!isRecording || count >= MAX_POINTS) return;
+
+        auto time = (int32_t(millis() - start) - age) / SCAN_TIME_UNIT;
+        auto& point = points[count++];
+
+        point.angle = constrain(angle, -127, 127);
+        point.range = min(range, uint16_t(MAX_RANGE));
+        point.time = constrain(time, -128, 127);
+    }
+
+
+    //******************************************************************************
+    /// <summary>
+    /// Closes the scan with the direction chosen from it (NO_CHOICE for
+    /// turning around), and queues it to be sent.
+    /// </summary>
+    //******************************************************************************
+    void Choose(int16_t angle)
+    {
+        if (!isRecording) return;
+
+        isRecording = false;
+        chosenAngle = (angle == NO_CHOICE) ? NO_CHOICE : constrain(angle, -127, 127);
+        chosen = millis();
+        awaitingOutcome = true;
+        Service();
+    }
+
+
+    //******************************************************************************
+    /// <summary>
+    /// Records an obstacle event (a Metrics::Source) as the outcome of the last
+    /// scan, if it doesn't have one yet.
+    /// </summary>
+    //******************************************************************************
+    void Obstacle(uint8_t obstacle)
+    {
+        if (awaitingOutcome && enabled) SendOutcome(OUTCOME_SONAR_DANGER + obstacle, millis());
+    }
+
+
+    //******************************************************************************
+    /// <summary>
+    /// Sends the next part of a chosen scan, if there is room in the serial
+    /// buffer for it. Called from the main loop.
+    /// </summary>
+    //******************************************************************************
+    void Service()
+    {
+        if (isRecording || sent >= count || !CanSend(sizeof(ScanRecord))) return;
+
+        ScanRecord record;
+
+        memset(&record, 0, sizeof(record));
+        record.scan = scan;
+        record.source = source;
+        record.start = start;
+        record.chosenAngle = chosenAngle;
+        record.first = sent;
+        record.total = count;
+
+        for (uint8_t i = 0; i < POINTS_PER_RECORD && sent < count; i++) record.points[i] = points[sent++];
+
+        Send(record);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Telemetry.h"
+
+
+//******************************************************************************
+/// <summary>
+/// Records every completed scan, the direction chosen from it, and what
+/// happened next, as telemetry - a dataset for judging direction-selection
+/// algorithms off-line (Tools/ScanBench.cpp).
+/// </summary>
+/// <remarks>
+/// A scan is recorded between Begin() and Choose(): the angle, range and time
+/// of each ping (including sectors TaskScanSonar serves from its cache, with
+/// the time they were really pinged). Choose() closes the scan with the
+/// direction the robot took (NO_CHOICE for turning around), and the scan is
+/// then sent as one or more ScanRecords of POINTS_PER_RECORD points. They go
+/// out from Service() in the main loop, one record at a time as the serial
+/// buffer has room, so the scan is never dropped for arriving all at once.
+///
+/// The outcome is the time from the choice to the next obstacle event
+/// (Metrics::Obstacle() reports them here), or to the start of the next scan
+/// if that comes first. It is sent as a ScanOutcomeRecord.
+///
+/// A scan that is abandoned before Choose() (the state changed) is not sent.
+/// Nothing is recorded unless telemetry is enabled. The buffer is
+/// MAX_POINTS * 3 bytes.
+/// </remarks>
+//******************************************************************************
+namespace ScanLog
+{
+    //**************************************************************************
+    // Constants
+    //**************************************************************************
+    const uint8_t MAX_POINTS = 20;      // ScanPlanner takes up to 19 pings, TaskScanSonar 13
+
+    //**************************************************************************
+    // Function declarations
+    //**************************************************************************
+    void Begin(Telemetry::ScanSource source);
+    void Add(int16_t angle, uint16_t range, uint16_t age = 0);
+    void Choose(int16_t angle);
+    void Obstacle(uint8_t obstacle);
+    void Service();
+}
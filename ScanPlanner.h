@@ -0,0 +1,316 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#endif
+
+
+//******************************************************************************
+/// <summary>
+/// Coarse-to-fine scan pattern for finding the most open direction.
+/// </summary>
+/// <remarks>
+/// Instead of pinging every 5 degrees across the full 180 degrees, a scan is a
+/// coarse pass at COARSE_STEP followed by a fine pass at FINE_STEP, but only
+/// within REFINE_SPAN of the CANDIDATES best coarse angles. The best direction
+/// is then picked the same way the full sweep did: the highest average of
+/// WINDOW_COUNT neighbouring fine pings.
+///
+/// The coarse pass alternates direction from one scan to the next, and the
+/// fine pass works back through the candidates from the end the coarse pass
+/// finished at, so the servo never pans back to the start of a sweep.
+///
+/// Use:
+///
+///   planner.Begin();
+///
+///   while (planner.Next(angle)) planner.Record(Sonar::PingAt(angle));
+///
+///   planner.BestAngle(), planner.BestPing()
+///
+/// The angle sequences are built at compile time into PROGMEM tables. The
+/// class is free of any Arduino headers so the host-side replay
+/// (Tools/ScanReplay.cpp) runs exactly the same code as the robot.
+/// </remarks>
+//******************************************************************************
+class ScanPlanner
+{
+    /*--------------------------------------------------------------------------
+    Constants
+    --------------------------------------------------------------------------*/
+    public: static constexpr int8_t MAX_ANGLE = 90;     // Scan covers -MAX_ANGLE to +MAX_ANGLE
+    public: static constexpr int8_t COARSE_STEP = 30;   // Coarse pass resolution (degrees)
+    public: static constexpr int8_t FINE_STEP = 5;      // Fine pass resolution (degrees)
+    public: static constexpr int8_t REFINE_SPAN = 15;   // Fine pass covers +/- this around a candidate
+    public: static constexpr uint8_t CANDIDATES = 2;    // Number of coarse angles refined
+    public: static constexpr uint8_t WINDOW_COUNT = 3;  // Fine pings averaged for a direction
+
+    public: static constexpr uint8_t COARSE_COUNT = 2 * MAX_ANGLE / COARSE_STEP + 1;
+    public: static constexpr uint8_t FINE_COUNT = 2 * REFINE_SPAN / FINE_STEP + 1;
+
+    static_assert(COARSE_STEP % FINE_STEP == 0, "ScanPlanner: coarse angles must lie on the fine grid");
+    static_assert(COARSE_COUNT >= CANDIDATES, "ScanPlanner: more candidates than coarse angles");
+    static_assert(FINE_COUNT >= WINDOW_COUNT, "ScanPlanner: refine span is narrower than the window");
+
+    /*--------------------------------------------------------------------------
+    Compile-time pattern tables
+    --------------------------------------------------------------------------*/
+    private: template <uint8_t... I> struct Indices {};
+
+    private: template <uint8_t N, uint8_t... I>
+    struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+    private: template <uint8_t... I>
+    struct MakeIndices<0, I...> { typedef Indices<I...> Type; };
+
+    /// <summary>COUNT angles from START in steps of STEP</summary>
+    private: template <int8_t START, int8_t STEP, uint8_t COUNT, class = typename MakeIndices<COUNT>::Type>
+    struct Sweep;
+
+    private: template <int8_t START, int8_t STEP, uint8_t COUNT, uint8_t... I>
+    struct Sweep<START, STEP, COUNT, Indices<I...>>
+    {
+        static constexpr int8_t angles[COUNT] PROGMEM = { int8_t(START + STEP * I)... };
+    };
+
+    private: typedef Sweep<-MAX_ANGLE, COARSE_STEP, COARSE_COUNT> CoarsePattern;
+    private: typedef Sweep<-REFINE_SPAN, FINE_STEP, FINE_COUNT> FinePattern;
+
+    /*--------------------------------------------------------------------------
+    Constructors
+    --------------------------------------------------------------------------*/
+    public: ScanPlanner() {};
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+
+    //**************************************************************************
+    /// <summary>
+    /// Starts a new scan. The coarse pass runs in the opposite direction to
+    /// the previous scan's.
+    /// </summary>
+    //**************************************************************************
+    public: void Begin()
+    {
+        _direction = -_direction;
+        _step = 0;
+        _pings = 0;
+        _bestAngle = 0;
+        _bestPing = 0;
+    }
+
+    //**************************************************************************
+    /// <summary>
+    /// Gets the next angle to ping at.
+    /// </summary>
+    /// <returns>false when the scan is complete</returns>
+    //**************************************************************************
+    public: bool Next(int16_t& angle)
+    {
+        // Coarse pass
+        if (_step < COARSE_COUNT)
+        {
+            angle = CoarseAngle(_step);
+            return true;
+        }
+
+        if (_step == COARSE_COUNT) SelectCandidates();
+
+        // Fine pass, skipping angles already pinged or outside the scan range
+        for (; _step < COARSE_COUNT + CANDIDATES * FINE_COUNT; _step++)
+        {
+            auto k = _step - COARSE_COUNT;
+
+            angle = FineAngle(k / FINE_COUNT, k % FINE_COUNT);
+
+            if (angle >= -MAX_ANGLE && angle <= MAX_ANGLE && !Pinged(k, angle)) return true;
+
+            *FineSlot(k) = Reading(angle);
+        }
+
+        if (_step == COARSE_COUNT + CANDIDATES * FINE_COUNT) SelectBest();
+
+        return false;
+    }
+
+    //**************************************************************************
+    /// <summary>
+    /// Records the ping (in cm, 0 if it failed) for the angle returned by the
+    /// last call to Next().
+    /// </summary>
+    //**************************************************************************
+    public: void Record(uint16_t ping)
+    {
+        if (_step < COARSE_COUNT)
+            _coarse[_direction > 0 ? _step : COARSE_COUNT - 1 - _step] = ping;
+        else
+            *FineSlot(_step - COARSE_COUNT) = ping;
+
+        _step++;
+        _pings++;
+    }
+
+    /// <summary>Center of the best window found (valid once Next() returns false)</summary>
+    public: int16_t BestAngle() const { return _bestAngle; };
+
+    /// <summary>Average ping of the best window found (valid once Next() returns false)</summary>
+    public: uint16_t BestPing() const { return _bestPing; };
+
+    /// <summary>Number of pings taken by the current scan</summary>
+    public: uint8_t Pings() const { return _pings; };
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+
+    /// <summary>Angle of the i-th coarse ping in the current direction</summary>
+    private: int16_t CoarseAngle(uint8_t i) const
+    {
+        if (_direction < 0) i = COARSE_COUNT - 1 - i;
+
+        return int8_t(pgm_read_byte(&CoarsePattern::angles[i]));
+    }
+
+    /// <summary>
+    /// Angle of the j-th fine ping of the c-th candidate. Candidates and the
+    /// pings within them run against the coarse direction, back from where
+    /// the coarse pass ended.
+    /// </summary>
+    private: int16_t FineAngle(uint8_t c, uint8_t j) const
+    {
+        if (_direction > 0) j = FINE_COUNT - 1 - j;
+
+        return _candidate[c] + int8_t(pgm_read_byte(&FinePattern::angles[j]));
+    }
+
+    /// <summary>Where the k-th fine ping is stored (in ascending angle order per candidate)</summary>
+    private: uint16_t* FineSlot(uint8_t k)
+    {
+        auto c = k / FINE_COUNT;
+        auto j = k % FINE_COUNT;
+
+        return &_fine[c][_direction > 0 ? FINE_COUNT - 1 - j : j];
+    }
+
+    /// <summary>True if the angle was pinged by the coarse pass or an earlier candidate</summary>
+    private: bool Pinged(uint8_t k, int16_t angle) const
+    {
+        if ((angle + MAX_ANGLE) % COARSE_STEP == 0) return true;
+
+        for (uint8_t c = 0; c < k / FINE_COUNT; c++)
+        {
+            auto offset = angle - _candidate[c];
+
+            if (offset >= -REFINE_SPAN && offset <= REFINE_SPAN) return true;
+        }
+
+        return false;
+    }
+
+    /// <summary>The ping already taken at an angle (0 if out of range)</summary>
+    private: uint16_t Reading(int16_t angle) const
+    {
+        if (angle < -MAX_ANGLE || angle > MAX_ANGLE) return 0;
+
+        if ((angle + MAX_ANGLE) % COARSE_STEP == 0) return _coarse[(angle + MAX_ANGLE) / COARSE_STEP];
+
+        for (uint8_t c = 0; c < CANDIDATES; c++)
+        {
+            auto offset = angle - _candidate[c];
+
+            if (offset >= -REFINE_SPAN && offset <= REFINE_SPAN) return _fine[c][(offset + REFINE_SPAN) / FINE_STEP];
+        }
+
+        return 0;
+    }
+
+    //**************************************************************************
+    /// <summary>
+    /// Picks the best coarse angles to refine, ordered so the fine pass moves
+    /// back from the end the coarse pass finished at.
+    /// </summary>
+    //**************************************************************************
+    private: void SelectCandidates()
+    {
+        uint8_t chosen[CANDIDATES];
+
+        for (uint8_t c = 0; c < CANDIDATES; c++)
+        {
+            chosen[c] = COARSE_COUNT;
+
+            for (uint8_t i = 0; i < COARSE_COUNT; i++)
+            {
+                auto taken = false;
+
+                for (uint8_t d = 0; d < c; d++) taken |= chosen[d] == i;
+
+                if (!taken && (chosen[c] == COARSE_COUNT || _coarse[i] > _coarse[chosen[c]])) chosen[c] = i;
+            }
+        }
+
+        // Sort into sweep order (descending angle when the coarse pass went up)
+        for (uint8_t c = 1; c < CANDIDATES; c++)
+        {
+            for (uint8_t d = c; d > 0 && (_direction > 0 ? chosen[d] > chosen[d - 1] : chosen[d] < chosen[d - 1]); d--)
+            {
+                auto swap = chosen[d];
+
+                chosen[d] = chosen[d - 1];
+                chosen[d - 1] = swap;
+            }
+        }
+
+        for (uint8_t c = 0; c < CANDIDATES; c++) _candidate[c] = -MAX_ANGLE + chosen[c] * COARSE_STEP;
+    }
+
+    //**************************************************************************
+    /// <summary>
+    /// Finds the window of WINDOW_COUNT fine pings with the highest average
+    /// around each candidate.
+    /// </summary>
+    /// <remarks>
+    /// This isn't a Filters.h stage: it searches stored pings for the best
+    /// window rather than smoothing a stream, and it averages (a median would
+    /// hide a narrow opening that shows up in only one of the three pings).
+    /// </remarks>
+    //**************************************************************************
+    private: void SelectBest()
+    {
+        for (uint8_t c = 0; c < CANDIDATES; c++)
+        {
+            for (uint8_t j = 0; j + WINDOW_COUNT <= FINE_COUNT; j++)
+            {
+                uint16_t sum = 0;
+
+                for (uint8_t w = 0; w < WINDOW_COUNT; w++) sum += _fine[c][j + w];
+
+                auto average = sum / WINDOW_COUNT;
+
+                if (average > _bestPing)
+                {
+                    _bestPing = average;
+                    _bestAngle = _candidate[c] - REFINE_SPAN + (j + WINDOW_COUNT / 2) * FINE_STEP;
+                }
+            }
+        }
+    }
+
+    private: uint16_t _coarse[COARSE_COUNT];        // Coarse pings, in ascending angle order
+    private: uint16_t _fine[CANDIDATES][FINE_COUNT];// Fine pings around each candidate, ascending
+    private: int16_t _candidate[CANDIDATES];        // Coarse angles being refined, in sweep order
+    private: int8_t _direction = -1;                // Coarse pass direction (+1 = right to left)
+    private: uint8_t _step = 0;                     // Position in the scan (coarse, then fine)
+    private: uint8_t _pings = 0;
+    private: int16_t _bestAngle = 0;
+    private: uint16_t _bestPing = 0;
+};
+
+
+template <int8_t START, int8_t STEP, uint8_t COUNT, uint8_t... I>
+constexpr int8_t ScanPlanner::Sweep<START, STEP, COUNT, ScanPlanner::Indices<I...>>::angles[COUNT] PROGMEM;
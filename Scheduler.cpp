@@ -0,0 +1,252 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+
+#include <RTL_Stdlib.h>
+#include "Scheduler.h"
+
+
+constexpr auto MEASUREMENT_WINDOW = 1000000UL;  // Idle time measurement window (microseconds)
+
+
+//******************************************************************************
+// Wrap-around safe test of whether time t has been reached at time now
+//******************************************************************************
+static inline bool Reached(uint32_t now, uint32_t t)
+{
+    return int32_t(now - t) >= 0;
+}
+
+
+//******************************************************************************
+// PeriodicTask
+//******************************************************************************
+PeriodicTask::PeriodicTask(uint16_t period, uint16_t phase, uint16_t deadline)
+{
+    _period = period * 1000UL;
+    _phase = phase * 1000UL;
+    _deadline = (deadline != 0) ? deadline * 1000UL : _period;
+    _due = _phase;
+}
+
+
+void PeriodicTask::SetPeriod(uint16_t period, uint16_t phase)
+{
+    _period = period * 1000UL;
+    _phase = phase * 1000UL;
+    _deadline = _period;
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Suspends the task and takes it out of the ready list.
+/// </summary>
+//******************************************************************************
+void PeriodicTask::Suspend()
+{
+    TaskBase::Suspend();
+    Scheduler::Remove(this);
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Resumes the task and puts it back in the ready list, first run one phase
+/// from now. Resuming a running task leaves its schedule alone.
+/// </summary>
+//******************************************************************************
+void PeriodicTask::Resume()
+{
+    if (IsRunning()) return;
+
+    TaskBase::Resume();
+    Restart();
+}
+
+
+void PeriodicTask::Restart()
+{
+    Scheduler::Remove(this);
+    _due = micros() + _phase;
+    Scheduler::Insert(this);
+}
+
+
+//******************************************************************************
+// Scheduler
+//******************************************************************************
+DEFINE_CLASSNAME(Scheduler);
+
+PeriodicTask* Scheduler::_head = nullptr;
+uint32_t Scheduler::_windowStart = 0;
+uint32_t Scheduler::_taskTime = 0;
+uint16_t Scheduler::_missed = 0;
+uint8_t Scheduler::_idlePercent = 100;
+uint8_t Scheduler::_taskPercent = 0;
+uint16_t Scheduler::_loopFloor = 0xFFFF;
+uint32_t Scheduler::_lastPass = 0;
+uint32_t Scheduler::_loopTime = 0;
+uint32_t Scheduler::_loopCount = 0;
+uint16_t Scheduler::_loopMax = 0;
+uint16_t Scheduler::_loopAverage = 0;
+uint16_t Scheduler::_loopPeak = 0;
+
+
+void Scheduler::SetTaskList(PeriodicTask* const* taskList)
+{
+    // Suspend the tasks of the previous task set
+    while (_head != nullptr)
+    {
+        auto pTask = _head;
+
+        _head = pTask->_next;
+        pTask->_next = nullptr;
+
+        if (pTask->IsRunning()) pTask->Suspend();
+    }
+
+    if (taskList == nullptr) return;
+
+    // Activate the new task set. The task list is in flash (PROGMEM).
+    for (auto ppTask = taskList; pgm_read_ptr(ppTask) != nullptr; ppTask++)
+    {
+        auto pTask = (PeriodicTask*)pgm_read_ptr(ppTask);
+
+        pTask->Resume();
+    }
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Runs every task that is due. Called once per pass through the main loop.
+/// </summary>
+/// <remarks>
+/// Only tasks that were due at the start of the call are run so that a task
+/// with a very short period can't starve the rest of the main loop. A task
+/// found suspended (through a TaskBase pointer) is dropped from the list.
+/// </remarks>
+//******************************************************************************
+void Scheduler::Dispatch()
+{
+    auto now = micros();
+
+    // Main loop pass time, from one call to the next
+    auto pass = now - _lastPass;
+
+    _lastPass = now;
+    _loopTime += pass;
+    _loopCount++;
+
+    if (pass > _loopMax) _loopMax = (pass < 0xFFFF) ? pass : 0xFFFF;
+
+    if (pass < _loopFloor) _loopFloor = pass;
+
+    while (_head != nullptr && Reached(now, _head->_due))
+    {
+        auto pTask = _head;
+
+        _head = pTask->_next;
+        pTask->_next = nullptr;
+
+        if (!pTask->IsRunning()) continue;
+
+        if (!Reached(pTask->_due + pTask->_deadline, now))
+        {
+            pTask->_missed++;
+            _missed++;
+        }
+
+        // Stay phase-locked unless we fell a whole period behind
+        pTask->_due += pTask->_period;
+
+        if (Reached(now, pTask->_due)) pTask->_due = now + pTask->_period;
+
+        // Requeue before polling in case the task reschedules or suspends itself
+        Insert(pTask);
+
+        auto t0 = micros();
+
+        pTask->Poll();
+
+        auto runTime = micros() - t0;
+
+        _taskTime += runTime;
+
+        if (runTime > pTask->_maxRunTime) pTask->_maxRunTime = (runTime < 0xFFFF) ? runTime : 0xFFFF;
+    }
+
+    // Update idle time measurement. Each pass spends _loopFloor waiting; the
+    // rest of the window is busy, whatever in the loop it was spent on.
+    if (Reached(now, _windowStart + MEASUREMENT_WINDOW))
+    {
+        auto window = now - _windowStart;
+        auto waiting = _loopCount * _loopFloor;
+
+        _idlePercent = (waiting < window) ? waiting * 100 / window : 100;
+        _taskPercent = (_taskTime < window) ? _taskTime * 100 / window : 100;
+        _taskTime = 0;
+        _windowStart = now;
+
+        _loopAverage = _loopTime / _loopCount;
+        _loopPeak = _loopMax;
+        _loopTime = 0;
+        _loopCount = 0;
+        _loopMax = 0;
+
+        TRACE(Logger(_classname_) << F("idle=") << _idlePercent << F("%, tasks=") << _taskPercent << F("%, missed=") << _missed
+                                  << F(", loop=") << _loopAverage << F("us, peak=") << _loopPeak << F("us") << endl);
+    }
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Prints the CPU budget: idle time, time in tasks, main loop pass times
+/// (including the floor taken as an empty pass), and for each task
+/// in the current set its period, longest run, and deadline misses. The
+/// longest runs are then cleared so the next report covers a fresh interval.
+/// </summary>
+//******************************************************************************
+void Scheduler::Report()
+{
+    Logger(_classname_) << F("idle=") << _idlePercent << F("%, tasks=") << _taskPercent
+                        << F("%, loop=") << _loopAverage << F("us, loopPeak=") << _loopPeak
+                        << F("us, loopFloor=") << _loopFloor << F("us, missed=") << _missed << endl;
+
+    for (auto pTask = _head; pTask != nullptr; pTask = pTask->_next)
+    {
+        Logger(_classname_) << pTask->Name() << F(": period=") << (pTask->_period / 1000)
+                            << F("ms, maxRun=") << pTask->_maxRunTime
+                            << F("us, missed=") << pTask->_missed << endl;
+
+        pTask->_maxRunTime = 0;
+    }
+}
+
+
+void Scheduler::Insert(PeriodicTask* pTask)
+{
+    auto ppLink = &_head;
+
+    // Insert after any tasks due at the same time so equal tasks run round-robin
+    while (*ppLink != nullptr && Reached(pTask->_due, (*ppLink)->_due)) ppLink = &(*ppLink)->_next;
+
+    pTask->_next = *ppLink;
+    *ppLink = pTask;
+}
+
+
+void Scheduler::Remove(PeriodicTask* pTask)
+{
+    for (auto ppLink = &_head; *ppLink != nullptr; ppLink = &(*ppLink)->_next)
+    {
+        if (*ppLink == pTask)
+        {
+            *ppLink = pTask->_next;
+            pTask->_next = nullptr;
+            return;
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <RTL_TaskManager.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Base class for tasks that run at a fixed rate under the Scheduler.
+/// </summary>
+/// <remarks>
+/// A periodic task declares its period, the phase (delay from activation to the
+/// first run), and a deadline (how late a run may start before it is counted
+/// as a miss). All values are in milliseconds; a deadline of 0 means one full
+/// period. The task's Poll() method is only called when the task is due, so a
+/// task no longer needs to gate itself with millis()/micros() timeouts.
+///
+/// Runs are phase-locked to the original schedule (next = previous + period)
+/// rather than to when the previous run actually happened, so jitter in the
+/// main loop does not accumulate as drift.
+///
+/// Suspend() and Resume() hide the TaskBase versions so that a suspended task
+/// is also taken out of the scheduler's ready list, and put back (one phase
+/// from now) when it is resumed. Call them through the task, not a TaskBase
+/// pointer.
+/// </remarks>
+//******************************************************************************
+class PeriodicTask : public TaskBase
+{
+    friend class Scheduler;
+
+    /*--------------------------------------------------------------------------
+    Constructors
+    --------------------------------------------------------------------------*/
+    public: PeriodicTask(uint16_t period, uint16_t phase = 0, uint16_t deadline = 0);
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+    public: void SetPeriod(uint16_t period, uint16_t phase);
+    public: void Suspend();
+    public: void Resume();
+    public: uint16_t DeadlineMisses() { return _missed; };
+    public: uint16_t MaxRunTime() { return _maxRunTime; };
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+    protected: void Restart();          // Next run is one phase from now
+
+    private: uint32_t _period;          // Microseconds between runs
+    private: uint32_t _phase;           // Microseconds from activation to first run
+    private: uint32_t _deadline;        // Microseconds a run may be late
+    private: uint32_t _due;             // micros() time of next run
+    private: uint16_t _missed = 0;      // Number of runs that missed their deadline
+    private: uint16_t _maxRunTime = 0;  // Longest Poll() since the last Report() (microseconds)
+    private: PeriodicTask* _next = nullptr; // Next task in the scheduler's ready list
+};
+
+
+//******************************************************************************
+/// <summary>
+/// Rate-based cooperative scheduler for periodic tasks.
+/// </summary>
+/// <remarks>
+/// The tasks for the current state are kept in an intrusive singly-linked list
+/// ordered by next due time, so Dispatch() only has to look at the head of the
+/// list to know whether anything needs to run. A task that is not due costs
+/// nothing on a pass through the main loop, and a suspended task is not in the
+/// list at all.
+///
+/// Each state hands its task set to SetTaskList() when it activates, in the
+/// same way it used to call TaskManager::SetTaskList(). Tasks that were in the
+/// previous set are suspended and the tasks in the new set are resumed. The
+/// task set is a nullptr terminated array kept in flash (PROGMEM).
+///
+/// The scheduler also measures the CPU budget: the average and longest pass
+/// through the main loop (the time between calls to Dispatch()), and the
+/// longest run of each task. A task with a 10ms period only really runs every
+/// 10ms if no loop pass takes longer than that.
+///
+/// The idle time (headroom) is the time the main loop spends just waiting
+/// for something to do. The shortest pass seen is taken as the cost of a
+/// loop pass with nothing to do, so each pass is that much waiting and the
+/// rest of it busy. This counts everything that runs in the loop - state
+/// Poll() methods, TaskManager::Dispatch(), blocking I2C and pulseIn calls -
+/// not just the Scheduler's tasks, whose share is reported separately.
+/// Report() prints them; it is triggered by sending 'c' on the serial port.
+/// </remarks>
+//******************************************************************************
+class Scheduler
+{
+    DECLARE_CLASSNAME;
+    friend class PeriodicTask;
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+    public: static void SetTaskList(PeriodicTask* const* taskList);
+    public: static void Dispatch();
+
+    public: static uint8_t IdlePercent() { return _idlePercent; };
+    public: static uint8_t TaskPercent() { return _taskPercent; };
+    public: static uint16_t DeadlineMisses() { return _missed; };
+    public: static uint16_t LoopAverage() { return _loopAverage; };
+    public: static uint16_t LoopPeak() { return _loopPeak; };
+    public: static void Report();
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+    private: static void Insert(PeriodicTask* pTask);
+    private: static void Remove(PeriodicTask* pTask);
+
+    private: static PeriodicTask* _head;    // Ready list, ordered by due time
+    private: static uint32_t _windowStart;  // Start of the current idle measurement window
+    private: static uint32_t _taskTime;     // Microseconds spent in tasks during the window
+    private: static uint16_t _missed;       // Total deadline misses
+    private: static uint8_t _idlePercent;   // Idle time over the last complete window
+    private: static uint8_t _taskPercent;   // Time in tasks over the last complete window
+    private: static uint16_t _loopFloor;    // Shortest main loop pass seen - a pass with nothing to do (microseconds)
+    private: static uint32_t _lastPass;     // micros() at the previous Dispatch()
+    private: static uint32_t _loopTime;     // Total main loop time during the window
+    private: static uint32_t _loopCount;    // Main loop passes during the window
+    private: static uint16_t _loopMax;      // Longest main loop pass during the window
+    private: static uint16_t _loopAverage;  // Average main loop pass over the last complete window (microseconds)
+    private: static uint16_t _loopPeak;     // Longest main loop pass over the last complete window (microseconds)
+};
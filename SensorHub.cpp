@@ -0,0 +1,88 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+
+#include <RTL_Stdlib.h>
+#include <RTL_I2C.h>
+#include "SensorHub.h"
+
+
+namespace SensorHub
+{
+    const uint16_t HUB_PING_TIME = 26;      // Longest a hub ping takes, trigger to result (its 25ms echo timeout)
+
+    uint8_t status = 0;
+
+    SensorHubSnapshot latest;               // Last snapshot read for a ping
+    bool isLatestFresh = false;             // PingReady() has just found a new ping in it
+    uint8_t usedCount = 0;                  // PingCount of the last ping handed out
+
+
+    void Update(uint8_t hubStatus)
+    {
+        if (hubStatus != status) TRACE(Logger(F("SensorHub")) << F("status=0x") << _HEX(hubStatus) << endl);
+        status = hubStatus;
+    }
+
+
+    bool ReadSnapshot(SensorHubSnapshot& snapshot)
+    {
+        I2c.write(IR_REMOTE_I2C_ADDRESS, HUB_REG_SENSORS);
+        I2c.read(IR_REMOTE_I2C_ADDRESS, snapshot);
+
+        if (IR_REMOTE_PROTOCOL_MAJOR(snapshot.Version) != IR_REMOTE_PROTOCOL_MAJOR(IR_REMOTE_PROTOCOL_VERSION)) return false;
+
+        status = snapshot.Sensors;
+        return true;
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Reads the hub once, and returns true if it has a ping that hasn't been
+    /// used yet and started after the given millis() time.
+    /// </summary>
+    /// <remarks>
+    /// The hub reports how long ago its last ping finished. A ping that
+    /// finished more than HUB_PING_TIME after the given time must also have
+    /// started after it, so it was taken with the servo where the caller put it.
+    /// </remarks>
+    //**************************************************************************
+    bool PingReady(uint32_t since)
+    {
+        isLatestFresh = false;
+
+        if (!ReadSnapshot(latest)) return false;
+
+        auto finished = millis() - latest.RangeAge;
+
+        isLatestFresh = latest.PingCount != usedCount && int32_t(finished - since) >= int32_t(HUB_PING_TIME);
+
+        return isLatestFresh;
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Returns the range (cm) of the hub's latest ping, or HUB_NO_ECHO. This is
+    /// the ping PingReady() just found, if it found one, or else whatever the
+    /// hub has now. It never waits for a new ping.
+    /// </summary>
+    //**************************************************************************
+    uint16_t Ping()
+    {
+        if (!isLatestFresh && !ReadSnapshot(latest)) return HUB_NO_ECHO;
+
+        isLatestFresh = false;
+        usedCount = latest.PingCount;
+
+        return latest.Range;
+    }
+
+
+    // Hub count of the ping Ping() last returned
+    uint8_t PingCount()
+    {
+        return usedCount;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+#include "RTL_IR_RemoteDecoder\RTL_IR_RemoteDecoder.h"
+
+
+//******************************************************************************
+/// <summary>
+/// Main board side of the sensor hub running on the IR remote decoder board.
+/// </summary>
+/// <remarks>
+/// The hub samples the proximity and step sensors (and optionally runs the
+/// sonar) in its own interrupts and reports the debounced sensor bits in the
+/// header of every IR remote batch. It pulls the IR ready line low whenever the
+/// bits change, so TaskIRRemote reads the batch straight away and passes the
+/// bits to Update(). The sensor tasks then use Sensors() instead of sampling
+/// the pins themselves.
+///
+/// If the hub owns the sonar it pings on its own, continuously. Nothing here
+/// waits for a ping: PingReady() reads the hub once and says whether it has a
+/// ping that started after a given time (when the servo settled) and hasn't
+/// been used yet, and Ping() hands out the latest range. Sonar::Ready() and
+/// the Sonar::Ping() functions are built on them.
+///
+/// If the hub doesn't report the sensors (an older decoder, or one built
+/// without HUB_SENSORS because the sensors aren't wired to it), HasSensors()
+/// and HasSonar() are false and the main board samples its own sensors.
+/// </remarks>
+//******************************************************************************
+namespace SensorHub
+{
+    //**************************************************************************
+    // Function declarations
+    //**************************************************************************
+    void Update(uint8_t status);
+    bool ReadSnapshot(SensorHubSnapshot& snapshot);
+    bool PingReady(uint32_t since);
+    uint16_t Ping();
+    uint8_t PingCount();
+
+    //**************************************************************************
+    // Variables
+    //**************************************************************************
+    extern uint8_t status;      // Status bits (HUB_xxx) from the last batch
+
+    inline bool HasSensors() { return (status & HUB_SENSORS_VALID) != 0; }
+    inline bool HasSonar() { return (status & HUB_SONAR_VALID) != 0; }
+    inline uint8_t Sensors() { return status & (HUB_PROX_RIGHT | HUB_PROX_FRONT | HUB_PROX_LEFT | HUB_STEP); }
+}
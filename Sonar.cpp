@@ -1,15 +1,29 @@
 #define DEBUG 0
 
 #include <Arduino.h>
+#include <avr/wdt.h>
+#include <EEPROM.h>
 #include <Servo.h>
 
 
 #include "Robot_9_Tank.h"
+#include "Safety.h"
 #include "Sonar.h"
 
 namespace Sonar
 {
     const int SERVO_PIN = 9;            // Servo on Arduino pin 9
+    const int TRIGGER_PIN = 3;          // Ultrasonic sensor trigger on Arduino pin 3
+    const int ECHO_PIN = 4;             // Ultrasonic sensor echo on Arduino pin 4
+
+    // Echo timing: the round trip takes about 58us per cm of range, and the
+    // sensor raises the echo line about 500us after it is triggered.
+    const uint16_t US_PER_CM = 58;
+    const uint16_t ECHO_START = 500;
+
+    // Quiet time after a gated ping before the next one, so echoes from beyond
+    // the range limit have died away (microseconds)
+    const uint32_t PING_INTERVAL = 10000;
 
     // Sonar pan servo center position bias. This is the value you have to send to
     // the servo to set it to the centered position. Ideally, this should be 90 since
@@ -18,16 +32,81 @@ namespace Sonar
     // of the servo motor and how accurately the ultrasonic sensor can be mounted and
     // aligned to the true center position of the servo shaft. 
     // Values > 90 bias to the left, values < 90 bias to the right.
+    // CalibrateServo() measures it and saves it in EEPROM; this is the default.
     const int SERVO_BIAS = 94;
 
-    SonarSensor sonar(3, 4);            // Ultrasonic sensor, trigger pin=3, echo pin=4
+    // Default servo model (used until the servo has been calibrated): 2ms per
+    // degree and no settle time, which is what the pings have always waited.
+    const ServoModel DEFAULT_SERVO_MODEL = { 2000, 0, SERVO_BIAS };
+
+    const uint16_t SERVO_MODEL_MAGIC = 0x5356;  // Marks a valid record in EEPROM
+
+    struct ServoModelRecord
+    {
+        uint16_t magic;
+        ServoModel model;
+        uint8_t checksum;
+    };
+
+    SonarSensor sonar(TRIGGER_PIN, ECHO_PIN);   // Ultrasonic sensor
     Servo panServo;                     // For panning the ultrasonic sensor left and right
 
+    ServoModel servoModel = DEFAULT_SERVO_MODEL;
     int16_t sonarAngle = 0;
+    uint32_t lastPing = 0;              // micros() at the end of the last gated ping
+    uint32_t settledAt = 0;             // millis() when the servo will have settled where it was last sent
+
+
+    static uint8_t Checksum(const ServoModel& model)
+    {
+        auto p = (const uint8_t*)&model;
+        uint8_t sum = 0;
+
+        for (uint8_t i = 0; i < sizeof(model); i++) sum += p[i];
+
+        return ~sum;
+    }
+
+
+    //**************************************************************************
+    // Loads the servo model from EEPROM, keeping the defaults if the robot has
+    // never been calibrated (or the record looks wrong).
+    //**************************************************************************
+    static void LoadServoModel()
+    {
+        ServoModelRecord record;
+
+        EEPROM.get(EEPROM_SERVO_MODEL, record);
+
+        if (record.magic != SERVO_MODEL_MAGIC || record.checksum != Checksum(record.model)) return;
+
+        if (record.model.usPerDegree < 500 || record.model.usPerDegree > 10000) return;
+
+        if (record.model.bias < 60 || record.model.bias > 120) return;
+
+        servoModel = record.model;
+    }
+
+
+    static void SaveServoModel()
+    {
+        ServoModelRecord record;
+
+        record.magic = SERVO_MODEL_MAGIC;
+        record.model = servoModel;
+        record.checksum = Checksum(servoModel);
+        EEPROM.put(EEPROM_SERVO_MODEL, record);
+    }
 
 
     void SonarBegin()
     {
+        LoadServoModel();
+        Logger(F("Sonar")) << F("Servo model: ") << servoModel.usPerDegree << F("us/deg, settle=")
+                           << servoModel.settleTime << F("ms, bias=") << servoModel.bias << endl;
+
+        pinMode(TRIGGER_PIN, OUTPUT);
+        pinMode(ECHO_PIN, INPUT);
         panServo.attach(SERVO_PIN);
         PanSonar(-90);                  // Pan sonar through full range
         delay(1000);
@@ -42,52 +121,418 @@ namespace Sonar
     //**************************************************************************
     void PanSonar(int angle)
     {
-        panServo.write(SERVO_BIAS + angle);
+        if (angle != sonarAngle)
+        {
+            auto settled = millis() + ServoDelay(angle);
+
+            if (int32_t(settled - settledAt) > 0) settledAt = settled;
+        }
+
+        panServo.write(servoModel.bias + angle);
         sonarAngle = angle;
     }
 
 
+    //**************************************************************************
+    // Waits (servicing the reflex) for the servo to finish its last move
+    //**************************************************************************
+    static void WaitSettled()
+    {
+        auto remaining = int32_t(settledAt - millis());
+
+        if (remaining > 0) Safety::Delay(remaining);
+    }
+
+
+    //**************************************************************************
+    // Servo wait for a step of the given size, and for a full TaskScanSonar
+    // sweep (swing to one end, then 12 steps of 15 degrees to the other end)
+    //**************************************************************************
+    static uint32_t StepWait(const ServoModel& model, uint16_t degrees)
+    {
+        return (uint32_t(degrees) * model.usPerDegree + 999) / 1000 + model.settleTime;
+    }
+
+
+    static uint32_t ScanWait(const ServoModel& model)
+    {
+        return StepWait(model, 90) + 12 * StepWait(model, 15);
+    }
+
+
+    //**************************************************************************
+    // Time (in milliseconds) for the servo to move from its current position to
+    // the given angle and settle there.
+    //**************************************************************************
+    uint16_t ServoDelay(int16_t angle)
+    {
+        return (angle != sonarAngle) ? StepWait(servoModel, abs(angle - sonarAngle)) : 0;
+    }
+
+
+    //**************************************************************************
+    // Length of the echo pulse (microseconds), or 0 if it hasn't ended by the
+    // timeout. Like pulseIn(), but the reflex is serviced while waiting, since
+    // the wait is the longest thing in the main loop while driving forward. A
+    // reflex stop during the pulse spoils that one reading.
+    //**************************************************************************
+    static uint32_t EchoTime(uint32_t timeout)
+    {
+        auto t0 = micros();
+
+        while (digitalRead(ECHO_PIN) == LOW)
+        {
+            if ((micros() - t0) >= timeout) return 0;
+
+            Safety::Service();
+        }
+
+        auto start = micros();
+
+        while (digitalRead(ECHO_PIN) == HIGH)
+        {
+            if ((micros() - t0) >= timeout) return 0;
+
+            Safety::Service();
+        }
+
+        return micros() - start;
+    }
+
+
     //**************************************************************************
     // Do one ultrasonic sensor ping.
     //**************************************************************************
     uint16_t Ping()
     {
+        if (SensorHub::HasSonar()) return SensorHub::Ping();
+
         uint16_t ping = sonar.PingCentimeters();
 
         return ping;
     }
 
 
+    //**************************************************************************
+    /// <summary>
+    /// Does one ultrasonic sensor ping that only waits for echoes from up to
+    /// maxRange centimeters away.
+    /// </summary>
+    /// <returns>
+    /// The range in centimeters, BEYOND_RANGE if there was no echo from within
+    /// maxRange, or PING_FAILED if the sensor hub could not be read
+    /// </returns>
+    /// <remarks>
+    /// The sensor keeps its echo line high until it gives up on an echo, which
+    /// can be long after this returns. Ready() is false until then, so check it
+    /// before pinging.
+    /// </remarks>
+    //**************************************************************************
+    uint16_t Ping(uint16_t maxRange)
+    {
+        if (SensorHub::HasSonar())
+        {
+            auto range = SensorHub::Ping();
+
+            return (range != PING_FAILED && range > maxRange) ? BEYOND_RANGE : range;
+        }
+
+        digitalWrite(TRIGGER_PIN, LOW);
+        delayMicroseconds(2);
+        digitalWrite(TRIGGER_PIN, HIGH);
+        delayMicroseconds(10);
+        digitalWrite(TRIGGER_PIN, LOW);
+
+        auto echo = EchoTime(ECHO_START + uint32_t(maxRange) * US_PER_CM);
+
+        lastPing = micros();
+
+        if (echo == 0) return BEYOND_RANGE;
+
+        uint16_t range = echo / US_PER_CM;
+
+        return (range <= maxRange) ? range : BEYOND_RANGE;
+    }
+
+
     //**************************************************************************
     // Do one ultrasonic sensor ping at specified angle.
     //**************************************************************************
     uint16_t PingAt(int16_t angle)
     {
-        uint32_t servoDelay = abs(2 * (angle - sonarAngle));  // Assume 4ms per degree
-
         PanSonar(angle);        // Move to ping position
-        delay(servoDelay);      // Delay for servo to move to next position
+        WaitSettled();          // Wait for the servo to get there (and any earlier move to finish)
 
         return Ping();
     }
 
 
+    uint16_t PingAt(int16_t angle, uint16_t maxRange)
+    {
+        PanSonar(angle);        // Move to ping position
+        WaitSettled();          // Wait for the servo to get there (and any earlier move to finish)
+
+        return Ping(maxRange);
+    }
+
+
+    //**************************************************************************
+    // True if the sensor can be pinged: the last ping's echo line has dropped
+    // and the quiet time after a gated ping has passed. With the hub running
+    // the sonar, true once the hub has a new ping taken since the servo
+    // settled where it was last sent - so aim first, then poll this.
+    //**************************************************************************
+    bool Ready()
+    {
+        if (SensorHub::HasSonar()) return int32_t(millis() - settledAt) >= 0 && SensorHub::PingReady(settledAt);
+
+        return digitalRead(ECHO_PIN) == LOW && (micros() - lastPing) >= PING_INTERVAL && sonar.Ready();
+    }
+
+
     //**************************************************************************
     // Do a multiple ping measurement.
     //**************************************************************************
     uint16_t MultiPing()
     {
+        if (SensorHub::HasSonar()) return SensorHub::Ping();
+
         return sonar.MultiPing();
     }
 
 
     uint16_t MultiPingAt(int16_t angle)
     {
-        uint32_t servoDelay = abs(2 * (angle - sonarAngle));  // Assume 4ms per degree
-
         PanSonar(angle);        // Move to ping position
-        delay(servoDelay);      // Delay for servo to move to next position
+        WaitSettled();          // Wait for the servo to get there (and any earlier move to finish)
 
-        return sonar.MultiPing();
+        return MultiPing();
+    }
+
+
+    //**************************************************************************
+    // Waits for a new ping and returns it, with the time (millis()) it was
+    // taken. With the hub, the time is when the new ping was seen, so it is
+    // only as fine as the hub's ping interval.
+    //**************************************************************************
+    static uint16_t TimedPing(uint32_t& time)
+    {
+        if (SensorHub::HasSonar())
+        {
+            auto count = SensorHub::PingCount();
+            auto t0 = millis();
+            uint16_t range;
+
+            do
+            {
+                wdt_reset();
+                range = SensorHub::Ping();
+            } while (SensorHub::PingCount() == count && (millis() - t0) < 100);
+
+            time = millis();
+
+            return range;
+        }
+
+        time = millis();
+
+        return Ping();
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Measures the pan servo's centre offset, slew rate and start-up lag, and
+    /// saves them in EEPROM.
+    /// </summary>
+    /// <returns>true if the servo was calibrated</returns>
+    /// <remarks>
+    /// The robot must be stopped with a narrow upright target (a broom handle
+    /// or a chair leg) about 30-80cm straight ahead, and nothing else at that
+    /// range. A flat wall won't do: the sensor's ~15 degree beam sees a wall
+    /// at the same range over a wide spread of angles.
+    ///
+    /// 1. Centre: the sonar is swept slowly across the target. The target is
+    ///    seen over a spread of angles as wide as the beam, centred on the
+    ///    angle where the sonar points straight at it; the middle of that
+    ///    spread is the true centre.
+    ///
+    /// 2. Slew: the sonar is swung from one side right through the target to
+    ///    the other, pinging as fast as it can. The target comes into the beam
+    ///    half a beam width before the sonar points at it and leaves half a
+    ///    beam width after, so the middle of the times it was seen is when the
+    ///    sonar pointed straight at it - half way through the swing, with the
+    ///    beam width cancelled out. This is repeated for several swing sizes
+    ///    in both directions, and a straight line is fitted to that time
+    ///    versus half the swing: the slope is the slew rate and the intercept
+    ///    the servo's lag in getting going, which is used as the settle time
+    ///    (the wait is the same whether the time is lost at the start or the
+    ///    end of a move).
+    ///
+    /// Before and after figures for a full TaskScanSonar sweep are printed so
+    /// the change in scan time can be seen, along with how far short of its
+    /// target the servo was when the old fixed wait ran out. Tools/ServoCalSim
+    /// compares this with timing the servo's arrival against a wall.
+    /// </remarks>
+    //**************************************************************************
+    bool CalibrateServo()
+    {
+        const int16_t BIAS_SWEEP = 15;              // Degrees either side of centre for the bias sweep
+        const int16_t SWINGS[] = { 20, 45, 90 };    // Half swing sizes for the slew measurement
+        const uint8_t REPEATS = 2;                  // Times each swing is measured in each direction
+        const uint16_t TOLERANCE = 2;               // Range tolerance (cm) for "target seen"
+        const uint16_t SLEW_TIMEOUT = 1500;         // Longest a swing may take (ms)
+
+        auto before = servoModel;
+        uint32_t time;
+
+        Logger(F("Sonar")) << F("Calibrating pan servo") << endl;
+
+        //----------------------------------------------------------------------
+        // 1. Centre bias
+        //----------------------------------------------------------------------
+        uint16_t ranges[2 * BIAS_SWEEP + 1];
+        uint16_t minRange = PING_FAILED;
+
+        PanSonar(-BIAS_SWEEP);
+        Safety::Delay(500);
+
+        for (int16_t angle = -BIAS_SWEEP; angle <= BIAS_SWEEP; angle++)
+        {
+            PanSonar(angle);
+            Safety::Delay(60);
+
+            auto range = TimedPing(time);
+
+            ranges[angle + BIAS_SWEEP] = range;
+
+            if (range != PING_FAILED && range < minRange) minRange = range;
+        }
+
+        if (minRange == PING_FAILED)
+        {
+            Logger(F("Sonar")) << F("Calibration failed: no target") << endl;
+            PanSonar(0);
+            return false;
+        }
+
+        int16_t angleSum = 0;
+        int16_t angleCount = 0;
+
+        for (int16_t angle = -BIAS_SWEEP; angle <= BIAS_SWEEP; angle++)
+        {
+            if (ranges[angle + BIAS_SWEEP] > minRange + TOLERANCE) continue;
+
+            angleSum += angle;
+            angleCount++;
+        }
+
+        auto centre = int16_t(round(float(angleSum) / angleCount));
+
+        servoModel.bias = before.bias + centre;
+
+        //----------------------------------------------------------------------
+        // 2. Slew rate and lag, timed by the target crossing the beam
+        //----------------------------------------------------------------------
+        PanSonar(0);
+        Safety::Delay(500);
+
+        auto reference = TimedPing(time);
+
+        if (reference == PING_FAILED)
+        {
+            Logger(F("Sonar")) << F("Calibration failed: no target ahead") << endl;
+            servoModel = before;
+            PanSonar(0);
+            return false;
+        }
+
+        // Least squares fit of time = lag + rate * swing
+        float n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+        for (auto swing : SWINGS)
+        {
+            for (uint8_t i = 0; i < 2 * REPEATS; i++)
+            {
+                auto start = (i & 1) ? swing : -swing;
+
+                PanSonar(start);
+                Safety::Delay(1000);
+
+                // The target must be out of the beam at the start of the swing
+                auto startRange = TimedPing(time);
+
+                if (startRange != PING_FAILED && uint16_t(abs(int16_t(startRange - reference))) <= TOLERANCE) continue;
+
+                auto t0 = millis();
+                uint32_t seen = 0;          // Time the target came into the beam (0 = not yet)
+                uint32_t lost = 0;          // Time it left again
+
+                PanSonar(-start);
+
+                while ((millis() - t0) < SLEW_TIMEOUT)
+                {
+                    auto range = TimedPing(time);
+                    auto isSeen = (range != PING_FAILED && uint16_t(abs(int16_t(range - reference))) <= TOLERANCE);
+
+                    if (isSeen && seen == 0) seen = time - t0;
+
+                    if (!isSeen && seen != 0)
+                    {
+                        lost = time - t0;
+                        break;
+                    }
+                }
+
+                if (seen == 0 || lost == 0) continue;
+
+                auto crossed = (seen + lost) / 2.0F;
+
+                TRACE(Logger(F("Sonar"), F("CalibrateServo")) << F("swing=") << swing << F(", seen=") << seen
+                                                             << F(", lost=") << lost << endl);
+
+                n += 1;
+                sx += swing;
+                sy += crossed;
+                sxx += float(swing) * swing;
+                sxy += float(swing) * crossed;
+            }
+        }
+
+        auto denominator = n * sxx - sx * sx;
+
+        if (n < 3 || denominator <= 0)
+        {
+            Logger(F("Sonar")) << F("Calibration failed: too few slew measurements") << endl;
+            servoModel = before;
+            PanSonar(0);
+            return false;
+        }
+
+        auto rate = (n * sxy - sx * sy) / denominator;      // ms per degree
+        auto settle = (sy - rate * sx) / n;                 // ms (the lag)
+
+        servoModel.usPerDegree = uint16_t(constrain(rate * 1000, 500.0F, 10000.0F));
+        servoModel.settleTime = uint8_t(constrain(settle, 0.0F, 255.0F));
+
+        SaveServoModel();
+        PanSonar(0);
+
+        //----------------------------------------------------------------------
+        // Before and after
+        //----------------------------------------------------------------------
+        auto oldStep = StepWait(before, 15);
+        auto newStep = StepWait(servoModel, 15);
+        auto shortfall = (newStep > oldStep) ? (newStep - oldStep) * 1000.0F / servoModel.usPerDegree : 0.0F;
+
+        Logger(F("Sonar")) << F("Servo model: ") << servoModel.usPerDegree << F("us/deg (was ") << before.usPerDegree
+                           << F("), settle=") << servoModel.settleTime << F("ms (was ") << before.settleTime
+                           << F("), bias=") << servoModel.bias << F(" (was ") << before.bias << ')' << endl;
+        Logger(F("Sonar")) << F("Full scan servo wait: ") << ScanWait(servoModel) << F("ms (was ") << ScanWait(before)
+                           << F("ms), 15 degree step: ") << newStep << F("ms (was ") << oldStep
+                           << F("ms, up to ") << _FLOAT(shortfall, 1) << F(" degrees short), centre off by ")
+                           << centre << F(" degrees") << endl;
+
+        return true;
     }
-}
\ No newline at end of file
+}
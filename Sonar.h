@@ -1,6 +1,7 @@
 #pragma once
 
 #include <SonarSensor.h>
+#include "SensorHub.h"
 
 
 namespace Sonar
@@ -12,10 +13,36 @@ namespace Sonar
     const uint16_t THRESHOLD2 =  75; // Second sonar threshold distance in centimeters (Obstacle detected)
     const uint16_t THRESHOLD3 = 100; // Third sonar threshold distance in centimeters (Obstacle nearing)
 
+    // Range limits (cm) for gated pings. A ping gives up waiting for the echo
+    // once it could only come from beyond the limit, instead of waiting out the
+    // sensor's own timeout (about 38ms). Ping-ahead mode tracks an obstacle
+    // from this far out so there is time to slow down from FAST_SPEED; scanning
+    // compares directions, so it looks further.
+    const uint16_t PING_AHEAD_RANGE = 150;
+    const uint16_t SCAN_RANGE = 250;
+
+    // Gated ping result when no echo came back from within the range limit
+    const uint16_t BEYOND_RANGE = 0xFFFE;
+
+    //**************************************************************************
+    /// <summary>
+    /// Timing model of the pan servo: moving through d degrees takes
+    /// d * usPerDegree microseconds, plus settleTime milliseconds for the
+    /// servo to stop and the sonar to give a steady reading.
+    /// </summary>
+    //**************************************************************************
+    struct ServoModel
+    {
+        uint16_t usPerDegree;   // Slew time per degree of travel (microseconds)
+        uint8_t settleTime;     // Settle time after a move (milliseconds)
+        uint8_t bias;           // Servo command for the centered position (nominally 90)
+    };
+
     //**************************************************************************
     // Variables
     //**************************************************************************
     extern SonarSensor sonar;     // Ultrasonic sensor on Arduino
+    extern ServoModel servoModel; // Pan servo model (from EEPROM, or the defaults)
 
     //**************************************************************************
     // Function declarations
@@ -23,9 +50,12 @@ namespace Sonar
     void SonarBegin();
     void PanSonar(int angle);
     uint16_t Ping();
+    uint16_t Ping(uint16_t maxRange);
     uint16_t PingAt(int16_t angle);
+    uint16_t PingAt(int16_t angle, uint16_t maxRange);
     uint16_t MultiPing();
     uint16_t MultiPingAt(int16_t angle);
-    
-    bool inline Ready() { return sonar.Ready(); }
+    uint16_t ServoDelay(int16_t angle);
+    bool CalibrateServo();
+    bool Ready();
 }
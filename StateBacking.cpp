@@ -7,14 +7,53 @@
 #include <RTL_TaskManager.h>
 
 #include "Robot_9_Tank.h"
+#include "Scheduler.h"
+#include "Metrics.h"
 #include "Movement.h"
 #include "States.h"
+#include "StateMachine.h"
 #include "Tasks.h"
 
 
 DEFINE_CLASSNAME(StateBacking);
 
 
+//******************************************************************************
+// State description (see StateMachine.h)
+//******************************************************************************
+constexpr StateMachine::Transition<StateBacking> StateBacking::TRANSITIONS[] PROGMEM =
+{
+    { TaskIRRemote::CMD_BACKUP_END_EVENT, nullptr, nullptr, &stoppedState },
+};
+
+constexpr StateMachine::Index StateBacking::INDEX PROGMEM = StateMachine::IndexOf(StateBacking::TRANSITIONS);
+
+// Events this state deliberately does nothing with (checked in OnEvent())
+constexpr uint16_t IGNORED[] =
+{
+    TaskStepDetection::STEP_DETECTED_EVENT,
+    TaskScanSonar::OBSTACLE_NONE_EVENT,
+    TaskScanSonar::OBSTACLE_DETECTED_EVENT,
+    TaskScanSonar::OBSTACLE_DANGER_EVENT,
+    TaskScanSonar::SCAN_COMPLETE_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_NONE_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_LEFT_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_RIGHT_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_BLOCKED_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_FRONT_EVENT,
+    TaskIRRemote::CMD_MOVE_EVENT,
+    TaskIRRemote::CMD_STOP_EVENT,
+    TaskIRRemote::CMD_TURN_BEGIN_EVENT,
+    TaskIRRemote::CMD_TURN_END_EVENT,
+    TaskIRRemote::CMD_BACKUP_BEGIN_EVENT,
+    TaskSpin::SPIN_COMPLETE_EVENT,
+    TaskSpin::SPIN_ABORT_EVENT,
+    TaskTurn::TURN_COMPLETE_EVENT,
+    TaskTurn::TURN_ABORT_EVENT,
+    TaskBackup::BACKUP_COMPLETE_EVENT,
+};
+
+
 StateBacking::StateBacking()
 {
 }
@@ -26,7 +65,8 @@ void StateBacking::StateChanging(TaskState newState)
     {
         case TaskState::Resuming:
             TRACE(Logger(_classname_) << F("Activating") << endl);
-            TaskManager::SetTaskList(nullptr);
+            Metrics::StateEntered(Metrics::BACKING);
+            Scheduler::SetTaskList(nullptr);
             Movement::GoBackward();
             break;
 
@@ -47,15 +87,9 @@ void StateBacking::Poll()
 
 void StateBacking::OnEvent(const Event * pEvent)
 {
-    if (!IsRunning()) return;
+    static_assert(StateMachine::Covers(TRANSITIONS, IGNORED), "StateBacking: every event must be handled or ignored");
 
-    switch (pEvent->EventID)
-    {
-        case TaskIRRemote::CMD_BACKUP_END_EVENT:
-            TRACE(Logger(_classname_) << F("CMD_BACKUP_END_EVENT") << endl);
-            TaskManager::SetCurrentState(stoppedState);
-            break;
-    }
+    StateMachine::Dispatch(*this, TRANSITIONS, INDEX, pEvent);
 }
 
 
@@ -3,6 +3,9 @@
 #include <RTL_TaskManager.h>
 #include <StateBase.h>
 
+#include "Scheduler.h"
+#include "StateMachine.h"
+
 
 class StateBacking : public StateBase
 {
@@ -20,6 +23,12 @@ class StateBacking : public StateBase
     public: void StateChanging(TaskState newState) override;
     public: const __FlashStringHelper* Name() override { return _classname_; };
 
+    /*--------------------------------------------------------------------------
+    State description (in flash, see StateMachine.h)
+    --------------------------------------------------------------------------*/
+    private: static const StateMachine::Transition<StateBacking> TRANSITIONS[];
+    private: static const StateMachine::Index INDEX;
+
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
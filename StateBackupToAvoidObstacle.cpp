@@ -5,9 +5,12 @@
 #include <RTL_TaskManager.h>
 
 #include "Robot_9_Tank.h"
+#include "Scheduler.h"
+#include "Metrics.h"
 #include "Movement.h"
 #include "Sonar.h"
 #include "States.h"
+#include "StateMachine.h"
 #include "Tasks.h"
 
 
@@ -20,7 +23,8 @@ void StateBackupToAvoidObstacle::StateChanging(TaskState newState)
     {
         case TaskState::Resuming:
             TRACE(Logger(_classname_) << F("Activating") << endl);
-            TaskManager::SetTaskList(nullptr);
+            Metrics::StateEntered(Metrics::BACKUP_AVOID);
+            Scheduler::SetTaskList(nullptr);
             Movement::GoBackward();
             _timeout = millis() + 500;  // Backup for no more than 500 ms (1/2 second)
             Sonar::PanSonar(0);
@@ -48,9 +52,35 @@ void StateBackupToAvoidObstacle::Poll()
 
 void StateBackupToAvoidObstacle::OnEvent(const Event * pEvent)
 {
-    switch (pEvent->EventID)
+    // Leaves this state from Poll(), so every event is ignored
+    static constexpr uint16_t ignored[] =
     {
-    }
+        TaskStepDetection::STEP_DETECTED_EVENT,
+        TaskScanSonar::OBSTACLE_NONE_EVENT,
+        TaskScanSonar::OBSTACLE_DETECTED_EVENT,
+        TaskScanSonar::OBSTACLE_DANGER_EVENT,
+        TaskScanSonar::SCAN_COMPLETE_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_NONE_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_LEFT_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_RIGHT_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_BLOCKED_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_FRONT_EVENT,
+        TaskIRRemote::CMD_MOVE_EVENT,
+        TaskIRRemote::CMD_STOP_EVENT,
+        TaskIRRemote::CMD_TURN_BEGIN_EVENT,
+        TaskIRRemote::CMD_TURN_END_EVENT,
+        TaskIRRemote::CMD_BACKUP_BEGIN_EVENT,
+        TaskIRRemote::CMD_BACKUP_END_EVENT,
+        TaskSpin::SPIN_COMPLETE_EVENT,
+        TaskSpin::SPIN_ABORT_EVENT,
+        TaskTurn::TURN_COMPLETE_EVENT,
+        TaskTurn::TURN_ABORT_EVENT,
+        TaskBackup::BACKUP_COMPLETE_EVENT,
+    };
+
+    static_assert(StateMachine::Covers(ignored), "StateBackupToAvoidObstacle: every event must be handled or ignored");
+
+    TRACE(Logger(_classname_) << F("Ignored event 0x") << _HEX(pEvent->EventID) << endl);
 }
 
 
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <RTL_Stdlib.h>
+#include <RTL_TaskManager.h>
+#include <StateBase.h>
+
+#include "EventIndex.h"
+#include "Scheduler.h"
+#include "Tasks.h"
+
+
+//******************************************************************************
+/// <summary>
+/// Table-driven event handling for the robot states.
+/// </summary>
+/// <remarks>
+/// Each state is described by tables in flash (PROGMEM), kept together at the
+/// top of the state's .cpp file as static members of the state:
+///
+///   TASK_LIST   - the periodic tasks that run in the state, handed to
+///                 Scheduler::SetTaskList() when the state activates
+///   TRANSITIONS - how the state reacts to events, instead of a switch
+///                 statement in OnEvent()
+///   INDEX       - where each event's entry is in TRANSITIONS, built from it
+///                 at compile time (IndexOf())
+///
+/// A transition names an event, an optional guard, an optional action, and an
+/// optional target state:
+///
+///   { TaskSpin::SPIN_ABORT_EVENT, nullptr, nullptr, &stoppedState }
+///
+/// When an event arrives the first entry for that event whose guard passes (or
+/// that has no guard) is used: the action runs, then the target state (if any)
+/// becomes the current state. Each event is traced (with DEBUG on in the
+/// state's file) as handled or ignored.
+///
+/// The library TaskManager still delivers events through the virtual OnEvent()
+/// method, so each state keeps a short OnEvent() that hands its tables to
+/// Dispatch().
+///
+/// Every state must also list the events it deliberately ignores (IGNORED,
+/// next to its tables). Covers() checks at compile time that each event in
+/// EVENTS is either in the table or in the ignore list, and that the table
+/// only uses events from EVENTS, so adding a new event without deciding what
+/// every state does with it fails the build instead of being silently
+/// dropped.
+///
+/// Cost: a transition is 12 bytes of flash (the two member function pointers
+/// are 4 bytes each on AVR), and each state's index is EventIndex::SLOTS (64)
+/// bytes. No RAM. EVENTS are hashed without collisions (see EventIndex.h), so
+/// Dispatch() finds an event with a multiply and one byte read whatever the
+/// length of the table, and only the matching entry is read out of flash.
+/// Tools/DispatchBench.cpp compares it with the switch statements it replaced
+/// and with a linear search of the table.
+/// </remarks>
+//******************************************************************************
+namespace StateMachine
+{
+    //**************************************************************************
+    // All events delivered to the states
+    //**************************************************************************
+    constexpr uint16_t EVENTS[] =
+    {
+        TaskStepDetection::STEP_DETECTED_EVENT,
+
+        TaskScanSonar::OBSTACLE_NONE_EVENT,
+        TaskScanSonar::OBSTACLE_DETECTED_EVENT,
+        TaskScanSonar::OBSTACLE_DANGER_EVENT,
+        TaskScanSonar::SCAN_COMPLETE_EVENT,
+
+        TaskNearObstacleDetection::OBSTACLE_NONE_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_LEFT_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_RIGHT_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_BLOCKED_EVENT,
+        TaskNearObstacleDetection::OBSTACLE_FRONT_EVENT,
+
+        TaskIRRemote::CMD_MOVE_EVENT,
+        TaskIRRemote::CMD_STOP_EVENT,
+        TaskIRRemote::CMD_TURN_BEGIN_EVENT,
+        TaskIRRemote::CMD_TURN_END_EVENT,
+        TaskIRRemote::CMD_BACKUP_BEGIN_EVENT,
+        TaskIRRemote::CMD_BACKUP_END_EVENT,
+
+        TaskSpin::SPIN_COMPLETE_EVENT,
+        TaskSpin::SPIN_ABORT_EVENT,
+        TaskTurn::TURN_COMPLETE_EVENT,
+        TaskTurn::TURN_ABORT_EVENT,
+        TaskBackup::BACKUP_COMPLETE_EVENT,
+    };
+
+    const size_t EVENT_COUNT = sizeof(EVENTS) / sizeof(EVENTS[0]);
+
+    // Multiplier that gives every event its own slot in the indexes
+    constexpr uint16_t HASH = EventIndex::Multiplier(EVENTS);
+
+    static_assert(HASH != 0, "StateMachine: no perfect hash for EVENTS (is an event listed twice?)");
+
+    // A state's index into its transition table
+    typedef EventIndex::Entries<EventIndex::SLOTS> Index;
+
+    //**************************************************************************
+    // Transition table entry
+    //**************************************************************************
+    template <class T>
+    struct Transition
+    {
+        uint16_t EventID;
+        bool (T::*Guard)(const Event*);     // nullptr = always
+        void (T::*Action)(const Event*);    // nullptr = no action
+        StateBase* Target;                  // nullptr = stay in this state
+    };
+
+    /// <summary>Builds a state's INDEX from its transition table</summary>
+    template <class T, size_t N>
+    constexpr Index IndexOf(const Transition<T> (&table)[N])
+    {
+        return EventIndex::Build(table, HASH);
+    }
+
+    //**************************************************************************
+    // Compile-time coverage check
+    //**************************************************************************
+    template <size_t N>
+    constexpr bool Lists(const uint16_t (&ids)[N], uint16_t eventID, size_t i = 0)
+    {
+        return i < N && (ids[i] == eventID || Lists(ids, eventID, i + 1));
+    }
+
+    template <class T, size_t N>
+    constexpr bool Handles(const Transition<T> (&table)[N], uint16_t eventID, size_t i = 0)
+    {
+        return i < N && (table[i].EventID == eventID || Handles(table, eventID, i + 1));
+    }
+
+    // Every entry in the table is for an event in EVENTS (others could never be found)
+    template <class T, size_t N>
+    constexpr bool Known(const Transition<T> (&table)[N], size_t i = 0)
+    {
+        return i >= N || (Lists(EVENTS, table[i].EventID) && Known(table, i + 1));
+    }
+
+    /// <summary>True if every event is either in the table or in the ignore list</summary>
+    template <class T, size_t N, size_t M>
+    constexpr bool Covers(const Transition<T> (&table)[N], const uint16_t (&ignored)[M], size_t i = 0)
+    {
+        return i >= EVENT_COUNT
+            ? Known(table)
+            : (Handles(table, EVENTS[i]) || Lists(ignored, EVENTS[i])) && Covers(table, ignored, i + 1);
+    }
+
+    /// <summary>True if the ignore list contains every event (for states that handle none)</summary>
+    template <size_t M>
+    constexpr bool Covers(const uint16_t (&ignored)[M], size_t i = 0)
+    {
+        return i >= EVENT_COUNT || (Lists(ignored, EVENTS[i]) && Covers(ignored, i + 1));
+    }
+
+    //**************************************************************************
+    /// <summary>
+    /// Looks up an event in a state's transition table (in PROGMEM) and performs
+    /// the matching transition.
+    /// </summary>
+    /// <returns>true if a transition was taken, false if the event was ignored</returns>
+    //**************************************************************************
+    template <class T, size_t N>
+    bool Dispatch(T& state, const Transition<T> (&table)[N], const Index& index, const Event* pEvent)
+    {
+        if (!state.IsRunning()) return false;
+
+        auto first = EventIndex::Find(index, HASH, pEvent->EventID);
+
+        // Entries after the first are only for another guard on the same event
+        for (size_t i = first; first != EventIndex::NONE && i < N; i++)
+        {
+            if (pgm_read_word(&table[i].EventID) != pEvent->EventID) continue;
+
+            Transition<T> transition;
+
+            memcpy_P(&transition, &table[i], sizeof(transition));
+
+            if (transition.Guard != nullptr && !(state.*transition.Guard)(pEvent)) continue;
+
+            TRACE(Logger(state.Name()) << F("Event 0x") << _HEX(pEvent->EventID) << endl);
+
+            if (transition.Action != nullptr) (state.*transition.Action)(pEvent);
+
+            if (transition.Target != nullptr) TaskManager::SetCurrentState(transition.Target);
+
+            return true;
+        }
+
+        TRACE(Logger(state.Name()) << F("Ignored event 0x") << _HEX(pEvent->EventID) << endl);
+
+        return false;
+    }
+}
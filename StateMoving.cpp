@@ -7,24 +7,89 @@
 #include <RTL_TaskManager.h>
 
 #include "Robot_9_Tank.h"
+#include "Scheduler.h"
+#include "Metrics.h"
 #include "Movement.h"
+#include "Safety.h"
+#include "ScanLog.h"
 #include "IMU.h"
 #include "States.h"
+#include "StateMachine.h"
 #include "Tasks.h"
 
 
 DEFINE_CLASSNAME(StateMoving);
 
 
-static TaskBase* taskList[] =
+// Obstacles are avoided by steering around them in arcs while still moving.
+// Set to false to go back to stopping and spinning in place for every obstacle
+// (for comparing the two with Metrics::Report()).
+constexpr auto ARC_AVOIDANCE = true;
+
+// While arcing to a new direction the sonar is held on that direction (see
+// TaskHeading), so ping-ahead looks down the new course during the turn.
+// Set to false to keep the sonar pointing along the chassis.
+constexpr auto STABILIZED_SONAR = true;
+
+// While driving straight with a clear path the speed follows the governor in
+// TaskScanSonar: FAST_SPEED in open space, slowing smoothly as an obstacle
+// gets closer. Set to false to stay at CRUISE_SPEED until an obstacle is
+// detected.
+constexpr auto SPEED_GOVERNOR = true;
+
+constexpr int GOVERNOR_STEP = 4;            // Smallest speed change worth making
+
+constexpr int16_t NEAR_CURVATURE = 96;      // Arc away from an obstacle seen by the IR sensors
+constexpr int16_t MIN_ARC_CURVATURE = 32;   // Gentlest arc toward a new direction from a scan
+
+
+//******************************************************************************
+// State description (see StateMachine.h)
+//******************************************************************************
+PeriodicTask* const StateMoving::TASK_LIST[] PROGMEM =
 {
     &scanSonarTask,
     &stepDetectionTask,
     &nearObstacleDetectionTask,
     &correctCourseTask,
+    &spinTask,
+    &turnTask,
+    &headingTask,
     nullptr
 };
 
+constexpr StateMachine::Transition<StateMoving> StateMoving::TRANSITIONS[] PROGMEM =
+{
+    { TaskStepDetection::STEP_DETECTED_EVENT,            nullptr, nullptr,                          &reversingDirectionState },
+    { TaskScanSonar::OBSTACLE_DANGER_EVENT,              nullptr, &StateMoving::OnObstacleDanger,   nullptr },
+    { TaskScanSonar::OBSTACLE_DETECTED_EVENT,            nullptr, &StateMoving::OnObstacleDetected, nullptr },
+    { TaskScanSonar::SCAN_COMPLETE_EVENT,                nullptr, &StateMoving::OnScanComplete,     nullptr },
+    { TaskScanSonar::OBSTACLE_NONE_EVENT,                nullptr, &StateMoving::OnPathClear,        nullptr },
+    { TaskNearObstacleDetection::OBSTACLE_BLOCKED_EVENT, nullptr, nullptr,                          &reversingDirectionState },
+    { TaskNearObstacleDetection::OBSTACLE_FRONT_EVENT,   nullptr, &StateMoving::OnObstacleFront,    nullptr },
+    { TaskNearObstacleDetection::OBSTACLE_LEFT_EVENT,    nullptr, &StateMoving::OnObstacleLeft,     nullptr },
+    { TaskNearObstacleDetection::OBSTACLE_RIGHT_EVENT,   nullptr, &StateMoving::OnObstacleRight,    nullptr },
+    { TaskNearObstacleDetection::OBSTACLE_NONE_EVENT,    nullptr, &StateMoving::OnObstacleNone,     nullptr },
+    { TaskIRRemote::CMD_TURN_BEGIN_EVENT,                nullptr, &StateMoving::OnTurnBegin,        nullptr },
+    { TaskIRRemote::CMD_TURN_END_EVENT,                  nullptr, &StateMoving::OnTurnEnd,          nullptr },
+    { TaskSpin::SPIN_COMPLETE_EVENT,                     nullptr, &StateMoving::OnTurnEnd,          nullptr },
+    { TaskSpin::SPIN_ABORT_EVENT,                        nullptr, nullptr,                          &reversingDirectionState },
+    { TaskTurn::TURN_COMPLETE_EVENT,                     nullptr, &StateMoving::OnTurnEnd,          nullptr },
+    { TaskTurn::TURN_ABORT_EVENT,                        nullptr, nullptr,                          &reversingDirectionState },
+};
+
+constexpr StateMachine::Index StateMoving::INDEX PROGMEM = StateMachine::IndexOf(StateMoving::TRANSITIONS);
+
+// Events this state deliberately does nothing with (checked in OnEvent())
+constexpr uint16_t IGNORED[] =
+{
+    TaskIRRemote::CMD_MOVE_EVENT,
+    TaskIRRemote::CMD_STOP_EVENT,
+    TaskIRRemote::CMD_BACKUP_BEGIN_EVENT,
+    TaskIRRemote::CMD_BACKUP_END_EVENT,
+    TaskBackup::BACKUP_COMPLETE_EVENT,
+};
+
 
 StateMoving::StateMoving()
 {
@@ -37,7 +102,11 @@ void StateMoving::StateChanging(TaskState newState)
     {
         case TaskState::Resuming:
             TRACE(Logger(_classname_) << F("Activating") << endl);
-            TaskManager::SetTaskList(taskList);
+            Metrics::StateEntered(Metrics::MOVING);
+            Scheduler::SetTaskList(TASK_LIST);
+            spinTask.Suspend();         // Not needed until a spin is requested
+            turnTask.Suspend();         // Not needed until an arc is requested
+            correctCourseTask.Retarget();
             GoForward();
             break;
 
@@ -54,92 +123,86 @@ void StateMoving::StateChanging(TaskState newState)
 void StateMoving::Poll()
 {
     //TRACE(Logger(_classname_) << F("I GOT POLLED!") << endl);
+    if (SPEED_GOVERNOR) Govern();
 }
 
 
 void StateMoving::OnEvent(const Event * pEvent)
 {
-    TRACE(Logger(_classname_) << F("Received event: 0x") << _HEX(pEvent->EventID) << endl);
+    static_assert(StateMachine::Covers(TRANSITIONS, IGNORED), "StateMoving: every event must be handled or ignored");
 
-    switch (pEvent->EventID)
-    {
-        case TaskStepDetection::STEP_DETECTED_EVENT:
-            TRACE(Logger(_classname_) << F("STEP_DETECTED_EVENT") << endl);
-            TaskManager::SetCurrentState(reversingDirectionState);
-        break;
-
-        case TaskScanSonar::OBSTACLE_DANGER_EVENT:
-            TRACE(Logger(_classname_) << F("OBSTACLE_DANGER_EVENT") << endl);
-            Movement::Stop();
-            scanSonarTask.SwitchToScanMode();
-        break;
-
-        case TaskScanSonar::OBSTACLE_DETECTED_EVENT:
-            TRACE(Logger(_classname_) << F("OBSTACLE_DETECTED_EVENT") << endl);
-            Movement::GoSlow();
-            scanSonarTask.SwitchToScanMode();
-        break;
-
-        case TaskScanSonar::SCAN_COMPLETE_EVENT:
-            TRACE(Logger(_classname_) << F("SCAN_COMPLETE_EVENT") << endl);
-            DetermineNewDirection();
-            break;
+    StateMachine::Dispatch(*this, TRANSITIONS, INDEX, pEvent);
+}
 
-        case TaskScanSonar::OBSTACLE_NONE_EVENT:
-            TRACE(Logger(_classname_) << F("OBSTACLE_NONE_EVENT") << endl);
-            GoForward();
-        break;
 
-        case TaskNearObstacleDetection::OBSTACLE_BLOCKED_EVENT:
-            TRACE(Logger(_classname_) << F("IR OBSTACLE_BLOCKED_EVENT") << endl);
-            TaskManager::SetCurrentState(reversingDirectionState);
-        break;
+void StateMoving::OnObstacleDanger(const Event*)
+{
+    Movement::Stop();
+    turnTask.Suspend();         // A stop ends any arc in progress; the scan picks the new direction
+    scanSonarTask.SwitchToScanMode();
+}
 
-        case TaskNearObstacleDetection::OBSTACLE_FRONT_EVENT:
-            TRACE(Logger(_classname_) << F("IR OBSTACLE_FRONT_EVENT") << endl);
-            Movement::GoBackward(250);
-            scanSonarTask.SwitchToScanMode();
-            break;
 
-        case TaskNearObstacleDetection::OBSTACLE_LEFT_EVENT:
-            TRACE(Logger(_classname_) << F("IR OBSTACLE_LEFT_EVENT") << endl);
-            Turn('R');
-        break;
-
-        case TaskNearObstacleDetection::OBSTACLE_RIGHT_EVENT:
-            TRACE(Logger(_classname_) << F("IR OBSTACLE_RIGHT_EVENT") << endl);
-            Turn('L');
-        break;
-
-        case TaskNearObstacleDetection::OBSTACLE_NONE_EVENT:
-            TRACE(Logger(_classname_) << F("IR OBSTACLE_NONE_EVENT") << endl);
-            ResumeForward();
-        break;
-
-        case TaskIRRemote::CMD_TURN_BEGIN_EVENT:
-            TRACE(Logger(_classname_) << F("CMD_TURN_BEGIN_EVENT, Direction=") << pEvent->Data.Char << endl);
-            StartSpin(pEvent->Data.Char);
-        break;
-
-        case TaskIRRemote::CMD_TURN_END_EVENT:
-            TRACE(Logger(_classname_) << F("CMD_TURN_END_EVENT") << endl);
-            EndSpin();
-        break;
-
-        case TaskSpin::SPIN_COMPLETE_EVENT:
-            TRACE(Logger(_classname_) << F("SPIN_COMPLETE_EVENT") << endl);
-            EndSpin();
-        break;
-
-        case TaskSpin::SPIN_ABORT_EVENT:
-            TRACE(Logger(_classname_) << F("SPIN_ABORT") << endl);
-            TaskManager::SetCurrentState(reversingDirectionState);
-        break;
+void StateMoving::OnObstacleDetected(const Event*)
+{
+    Movement::GoSlow();
+    scanSonarTask.SwitchToScanMode();
+}
 
-        default:
-            TRACE(Logger(_classname_) << F("Unknown event: 0x") << _HEX(pEvent->EventID) << endl);
-        break;
-    }
+
+void StateMoving::OnScanComplete(const Event*)
+{
+    DetermineNewDirection();
+}
+
+
+void StateMoving::OnPathClear(const Event*)
+{
+    GoForward();
+}
+
+
+void StateMoving::OnObstacleFront(const Event*)
+{
+    Safety::Clear();
+    Movement::GoBackward(250);
+    scanSonarTask.SwitchToScanMode();
+}
+
+
+void StateMoving::OnObstacleLeft(const Event*)
+{
+    Turn('R');
+}
+
+
+void StateMoving::OnObstacleRight(const Event*)
+{
+    Turn('L');
+}
+
+
+void StateMoving::OnObstacleNone(const Event*)
+{
+    ResumeForward();
+}
+
+
+void StateMoving::OnTurnBegin(const Event* pEvent)
+{
+    StartSpin(pEvent->Data.Char);
+}
+
+
+void StateMoving::OnTurnEnd(const Event*)
+{
+    auto isBlocked = _isTurning && scanSonarTask.LookBlocked();
+
+    EndSpin();
+
+    // The sonar looked along the new course during the turn and found it
+    // blocked, so don't drive on into it
+    if (isBlocked) OnObstacleDetected(nullptr);
 }
 
 
@@ -201,7 +264,16 @@ void StateMoving::DetermineNewDirection()
         }
     }
 
-    if (spinAngle != 0)
+    ScanLog::Choose(spinAngle != 0 ? spinAngle : Telemetry::NO_CHOICE);
+
+    if (spinAngle != 0 && ARC_AVOIDANCE && Movement::isMoving)
+    {
+        // Still moving (the obstacle is not in the danger zone) so steer
+        // around it instead of stopping to spin
+        TRACE(Logger(_classname_, F("DetermineNewDirection")) << F("Arcing ") << (spinAngle < 0 ? "right" : "left") << endl);
+        Arc(spinAngle);
+    }
+    else if (spinAngle != 0)
     {
         TRACE(Logger(_classname_, F("DetermineNewDirection")) << F("Spinning ") << (spinAngle < 0 ? "right" : "left") << endl);
         
@@ -210,8 +282,11 @@ void StateMoving::DetermineNewDirection()
 
         // Spin in the turn direction
         if (Movement::Spin(spinAngle))
-            // Resume forward motion after spin completed
+        {
+            // Resume forward motion in the new direction after spin completed
+            correctCourseTask.Retarget();
             GoForward();
+        }
         else
             // Abort to stopped state if spin failed
             TaskManager::SetCurrentState(stoppedState);
@@ -225,6 +300,29 @@ void StateMoving::DetermineNewDirection()
 }
 
 
+//******************************************************************************
+/// <summary>
+/// Follows the governed speed (TaskScanSonar::GovernedSpeed) while driving
+/// straight ahead with nothing detected in the way.
+/// </summary>
+//******************************************************************************
+void StateMoving::Govern()
+{
+    if (_isTurning || !Movement::isMoving || Movement::Curvature() != Movement::STRAIGHT) return;
+
+    if (!scanSonarTask.IsPathClear()) return;
+
+    auto speed = Movement::Speed();
+    auto governed = scanSonarTask.GovernedSpeed();
+
+    if (speed <= 0 || abs(governed - speed) < GOVERNOR_STEP) return;
+
+    TRACE(Logger(_classname_, F("Govern")) << F("speed=") << governed
+                                           << F(", ttc=") << _FLOAT(scanSonarTask.TimeToCollision(), 2) << endl);
+    Movement::Go(governed);
+}
+
+
 void StateMoving::GoForward()
 {
     TRACE(Logger(_classname_, F("GoForward")) << endl);
@@ -244,6 +342,8 @@ void StateMoving::ResumeForward()
 void StateMoving::Reset()
 {
     _isTurning = false;
+    turnTask.Suspend();
+    headingTask.Untrack();
     correctCourseTask.Resume();
     nearObstacleDetectionTask.Resume();
 }
@@ -254,7 +354,31 @@ void StateMoving::Turn(char turnDirection)
     TRACE(Logger(_classname_) << F("Turn(") << turnDirection << ')' << endl);
     _isTurning = true;
     correctCourseTask.Suspend();
-    Movement::Turn(turnDirection);
+
+    if (ARC_AVOIDANCE)
+        Movement::Arc(turnDirection == 'L' ? NEAR_CURVATURE : -NEAR_CURVATURE);
+    else
+        Movement::Turn(turnDirection);
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Turns through an angle along an arc while moving. Larger angles get a
+/// tighter arc, up to stopping the inner track at 90 degrees.
+/// </summary>
+//******************************************************************************
+void StateMoving::Arc(int16_t angle)
+{
+    auto curvature = constrain(int16_t(int32_t(Movement::PIVOT) * abs(angle) / 90), MIN_ARC_CURVATURE, Movement::PIVOT);
+
+    TRACE(Logger(_classname_, F("Arc")) << F("angle=") << angle << F(", curvature=") << curvature << endl);
+    _isTurning = true;
+    correctCourseTask.Suspend();
+    turnTask.Start(angle, curvature);
+
+    // TaskScanSonar keeps the servo, and looks along the track now and then
+    if (STABILIZED_SONAR) headingTask.Track(headingTask.WorldAngle(angle), false);
 }
 
 
@@ -271,6 +395,7 @@ void StateMoving::StartSpin(char direction)
 void StateMoving::EndSpin()
 {
     TRACE(Logger(_classname_, F("EndSpin")) << endl);
+    correctCourseTask.Retarget();   // A deliberate turn - hold the new direction
     ResumeForward();
 }
 
@@ -3,6 +3,9 @@
 #include <RTL_TaskManager.h>
 #include <StateBase.h>
 
+#include "Scheduler.h"
+#include "StateMachine.h"
+
 
 class StateMoving : public StateBase
 {
@@ -20,14 +23,37 @@ class StateMoving : public StateBase
     public: void StateChanging(TaskState newState) override;
     public: const __FlashStringHelper* Name() override { return _classname_; };
 
+    /*--------------------------------------------------------------------------
+    State description (in flash, see StateMachine.h)
+    --------------------------------------------------------------------------*/
+    private: static PeriodicTask* const TASK_LIST[];
+    private: static const StateMachine::Transition<StateMoving> TRANSITIONS[];
+    private: static const StateMachine::Index INDEX;
+
+    /*--------------------------------------------------------------------------
+    Transition actions
+    --------------------------------------------------------------------------*/
+    private: void OnObstacleDanger(const Event* pEvent);
+    private: void OnObstacleDetected(const Event* pEvent);
+    private: void OnScanComplete(const Event* pEvent);
+    private: void OnPathClear(const Event* pEvent);
+    private: void OnObstacleFront(const Event* pEvent);
+    private: void OnObstacleLeft(const Event* pEvent);
+    private: void OnObstacleRight(const Event* pEvent);
+    private: void OnObstacleNone(const Event* pEvent);
+    private: void OnTurnBegin(const Event* pEvent);
+    private: void OnTurnEnd(const Event* pEvent);
+
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
+    private: void Govern();
     private: void GoForward();
     private: void ResumeForward();
     private: void Reset();
     private: void DetermineNewDirection();
     private: void Turn(char turnDirection);
+    private: void Arc(int16_t angle);
     private: void StartSpin(char direction);
     private: void EndSpin();
 
@@ -5,25 +5,64 @@
 #include <RTL_TaskManager.h>
 
 #include "Robot_9_Tank.h"
+#include "Metrics.h"
+#include "Safety.h"
+#include "Scheduler.h"
 #include "States.h"
+#include "StateMachine.h"
 #include "Tasks.h"
 
 
 DEFINE_CLASSNAME(StateReversingDirection);
 
 
-StateReversingDirection::StateReversingDirection()
-{
-}
-
-
-static TaskBase* taskList[] =
+//******************************************************************************
+// State description (see StateMachine.h)
+//******************************************************************************
+PeriodicTask* const StateReversingDirection::TASK_LIST[] PROGMEM =
 {
     &backupTask,
     &spinTask,
     nullptr
 };
 
+constexpr StateMachine::Transition<StateReversingDirection> StateReversingDirection::TRANSITIONS[] PROGMEM =
+{
+    { TaskBackup::BACKUP_COMPLETE_EVENT, nullptr, &StateReversingDirection::OnBackupComplete, nullptr },
+    { TaskSpin::SPIN_COMPLETE_EVENT,     nullptr, nullptr,                                    &movingState },
+    { TaskSpin::SPIN_ABORT_EVENT,        nullptr, nullptr,                                    &stoppedState },
+};
+
+constexpr StateMachine::Index StateReversingDirection::INDEX PROGMEM = StateMachine::IndexOf(StateReversingDirection::TRANSITIONS);
+
+// Events this state deliberately does nothing with (checked in OnEvent())
+constexpr uint16_t IGNORED[] =
+{
+    TaskStepDetection::STEP_DETECTED_EVENT,
+    TaskScanSonar::OBSTACLE_NONE_EVENT,
+    TaskScanSonar::OBSTACLE_DETECTED_EVENT,
+    TaskScanSonar::OBSTACLE_DANGER_EVENT,
+    TaskScanSonar::SCAN_COMPLETE_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_NONE_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_LEFT_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_RIGHT_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_BLOCKED_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_FRONT_EVENT,
+    TaskIRRemote::CMD_MOVE_EVENT,
+    TaskIRRemote::CMD_STOP_EVENT,
+    TaskIRRemote::CMD_TURN_BEGIN_EVENT,
+    TaskIRRemote::CMD_TURN_END_EVENT,
+    TaskIRRemote::CMD_BACKUP_BEGIN_EVENT,
+    TaskIRRemote::CMD_BACKUP_END_EVENT,
+    TaskTurn::TURN_COMPLETE_EVENT,
+    TaskTurn::TURN_ABORT_EVENT,
+};
+
+
+StateReversingDirection::StateReversingDirection()
+{
+}
+
 
 void StateReversingDirection::StateChanging(TaskState newState)
 {
@@ -31,7 +70,9 @@ void StateReversingDirection::StateChanging(TaskState newState)
     {
         case TaskState::Resuming:
             TRACE(Logger(_classname_) << F("Activating") << endl);
-            TaskManager::SetTaskList(taskList);
+            Metrics::StateEntered(Metrics::REVERSING);
+            Safety::Clear();        // Backing away from the fault
+            Scheduler::SetTaskList(TASK_LIST);
             spinTask.Suspend();     // Not needed yet
             backupTask.Start(500);
             break;
@@ -53,20 +94,15 @@ void StateReversingDirection::Poll()
 
 void StateReversingDirection::OnEvent(const Event * pEvent)
 {
-    switch (pEvent->EventID)
-    {
-        case TaskBackup::BACKUP_COMPLETE_EVENT:
-            backupTask.Suspend();       // Done backing up
-            spinTask.Start(180);        // Automatically resumes the spinTask
-            break;
+    static_assert(StateMachine::Covers(TRANSITIONS, IGNORED), "StateReversingDirection: every event must be handled or ignored");
 
-        case TaskSpin::SPIN_COMPLETE_EVENT:
-            TaskManager::SetCurrentState(&movingState);
-            break;
+    StateMachine::Dispatch(*this, TRANSITIONS, INDEX, pEvent);
+}
 
-        case TaskSpin::SPIN_ABORT_EVENT:
-            TaskManager::SetCurrentState(stoppedState);
-            break;
-    }
+
+void StateReversingDirection::OnBackupComplete(const Event*)
+{
+    backupTask.Suspend();       // Done backing up
+    spinTask.Start(180);        // Automatically resumes the spinTask
 }
 
@@ -3,6 +3,9 @@
 #include <RTL_TaskManager.h>
 #include <StateBase.h>
 
+#include "Scheduler.h"
+#include "StateMachine.h"
+
 
 class StateReversingDirection : public StateBase
 {
@@ -20,6 +23,18 @@ class StateReversingDirection : public StateBase
     public: void StateChanging(TaskState newState) override;
     public: const __FlashStringHelper* Name() override { return _classname_; };
 
+    /*--------------------------------------------------------------------------
+    State description (in flash, see StateMachine.h)
+    --------------------------------------------------------------------------*/
+    private: static PeriodicTask* const TASK_LIST[];
+    private: static const StateMachine::Transition<StateReversingDirection> TRANSITIONS[];
+    private: static const StateMachine::Index INDEX;
+
+    /*--------------------------------------------------------------------------
+    Transition actions
+    --------------------------------------------------------------------------*/
+    private: void OnBackupComplete(const Event* pEvent);
+
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
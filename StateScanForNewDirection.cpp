@@ -5,30 +5,75 @@
 #include <RTL_TaskManager.h>
 
 #include "Robot_9_Tank.h"
+#include "ScanPlanner.h"
+#include "Scheduler.h"
 #include "Sonar.h"
+#include "Metrics.h"
 #include "Movement.h"
+#include "ScanLog.h"
+#include "Telemetry.h"
 #include "States.h"
+#include "StateMachine.h"
 #include "Tasks.h"
 
 
 DEFINE_CLASSNAME(StateScanForNewDirection);
 
 
-constexpr auto SCAN_WINDOW_COUNT = 3;
-constexpr auto SCAN_INCREMENT = 5;
-constexpr auto MAX_SCAN_ANGLE = 90;
-constexpr auto MAX_RIGHT_ANGLE = -MAX_SCAN_ANGLE;
-constexpr auto MAX_LEFT_ANGLE = MAX_SCAN_ANGLE;
-constexpr auto SCAN_RIGHT = -1;
-constexpr auto SCAN_LEFT = 1;
+// While spinning to the new direction the sonar is held on it (see
+// TaskHeading) and keeps pinging, so an opening that closes during the spin
+// is caught then rather than after the robot has set off.
+// Set to false to leave the sonar pointing along the chassis during the spin.
+constexpr auto STABILIZED_SONAR = true;
 
+constexpr uint8_t BLOCKED_COUNT = 3;        // Pings inside THRESHOLD2 that mean the opening has closed
+constexpr uint8_t MAX_RESCANS = 2;          // Openings that may close before giving up and turning around
 
-static TaskBase* taskList[] =
+static ScanPlanner planner;
+
+
+//******************************************************************************
+// State description (see StateMachine.h)
+//******************************************************************************
+PeriodicTask* const StateScanForNewDirection::TASK_LIST[] PROGMEM =
 {
     &spinTask,
+    &headingTask,
     nullptr
 };
 
+constexpr StateMachine::Transition<StateScanForNewDirection> StateScanForNewDirection::TRANSITIONS[] PROGMEM =
+{
+    { TaskSpin::SPIN_COMPLETE_EVENT, nullptr, &StateScanForNewDirection::OnSpinComplete, &movingState },
+    { TaskSpin::SPIN_ABORT_EVENT,    nullptr, nullptr,                                   &reversingDirectionState },
+};
+
+constexpr StateMachine::Index StateScanForNewDirection::INDEX PROGMEM = StateMachine::IndexOf(StateScanForNewDirection::TRANSITIONS);
+
+// Events this state deliberately does nothing with (checked in OnEvent())
+constexpr uint16_t IGNORED[] =
+{
+    TaskStepDetection::STEP_DETECTED_EVENT,
+    TaskScanSonar::OBSTACLE_NONE_EVENT,
+    TaskScanSonar::OBSTACLE_DETECTED_EVENT,
+    TaskScanSonar::OBSTACLE_DANGER_EVENT,
+    TaskScanSonar::SCAN_COMPLETE_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_NONE_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_LEFT_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_RIGHT_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_BLOCKED_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_FRONT_EVENT,
+    TaskIRRemote::CMD_MOVE_EVENT,
+    TaskIRRemote::CMD_STOP_EVENT,
+    TaskIRRemote::CMD_TURN_BEGIN_EVENT,
+    TaskIRRemote::CMD_TURN_END_EVENT,
+    TaskIRRemote::CMD_BACKUP_BEGIN_EVENT,
+    TaskIRRemote::CMD_BACKUP_END_EVENT,
+    TaskTurn::TURN_COMPLETE_EVENT,
+    TaskTurn::TURN_ABORT_EVENT,
+    TaskBackup::BACKUP_COMPLETE_EVENT,
+};
+
 
 void StateScanForNewDirection::StateChanging(TaskState newState)
 {
@@ -36,14 +81,17 @@ void StateScanForNewDirection::StateChanging(TaskState newState)
     {
         case TaskState::Resuming:
             TRACE(Logger(_classname_) << F("Activating") << endl);
-            TaskManager::SetTaskList(taskList);
+            Metrics::StateEntered(Metrics::SCANNING);
+            Scheduler::SetTaskList(TASK_LIST);
             spinTask.Suspend();         // Not needed yet
             Movement::Stop();
+            _rescanCount = 0;
             ScanBegin();
             break;
 
         case TaskState::Suspending:
             // Recenter servo to point straight ahead again
+            headingTask.Untrack();
             Sonar::PanSonar(0);
             TRACE(Logger(_classname_) << F("Suspending") << endl);
             break;
@@ -56,78 +104,113 @@ void StateScanForNewDirection::StateChanging(TaskState newState)
 
 void StateScanForNewDirection::Poll()
 {
-    if (!_isScanning) return;
+    if (!_isScanning)
+    {
+        WatchOpening();
+        return;
+    }
+
+    // Aim at the next direction first, so the servo moves while the sensor
+    // gets ready
+    if (!_isAimed)
+    {
+        if (!planner.Next(_scanAngle))
+        {
+            ScanComplete();
+            return;
+        }
+
+        Sonar::PanSonar(_scanAngle);
+        _isAimed = true;
+    }
 
     if (!Sonar::Ready()) return;
 
-    //auto ping = Sonar::MultiPingAt(_scanAngle, 3);
-    auto ping = Sonar::PingAt(_scanAngle);
+    auto scanAngle = _scanAngle;
 
-    TRACE(Logger(_classname_) << _scanAngle << ',' << ping << ',' << _bestPing << ',' << _bestAngle << endl);
+    _isAimed = false;
 
-    if (ping != PING_FAILED)
+    //auto ping = Sonar::MultiPingAt(scanAngle, 3);
+    auto ping = Sonar::PingAt(scanAngle, Sonar::SCAN_RANGE);
+
+    if (Telemetry::enabled)
     {
-        _windowSum += ping;
+        Telemetry::ScanPingRecord record;
 
-        if (++_windowCount >= SCAN_WINDOW_COUNT)
-        {
-            UpdateBestAngle();
-        }
+        record.scanAngle = scanAngle;
+        record.ping = ping;
+        record.bestPing = planner.BestPing();
+        record.bestAngle = planner.BestAngle();
+        Telemetry::Send(record);
     }
 
-    // Update scan angle
-    _scanAngle += (_scanDirection * SCAN_INCREMENT);
+    if (ping == Sonar::BEYOND_RANGE) ping = Sonar::SCAN_RANGE;
 
-    if (_scanAngle > MAX_LEFT_ANGLE)
-    {
-        if (_windowCount > 1) UpdateBestAngle();
+    if (ping == PING_FAILED) ping = 0;
 
-        ScanComplete();
-    }
+    ScanLog::Add(scanAngle, ping);
+    planner.Record(ping);
 }
 
 
-void StateScanForNewDirection::UpdateBestAngle()
+void StateScanForNewDirection::OnEvent(const Event * pEvent)
 {
-    auto windowPing = _windowSum / _windowCount;
+    static_assert(StateMachine::Covers(TRANSITIONS, IGNORED), "StateScanForNewDirection: every event must be handled or ignored");
 
-    if (windowPing > _bestPing)
-    {
-        _bestPing = windowPing;
-        _bestAngle = _scanAngle - (SCAN_INCREMENT*_windowCount / 2);
-    }
+    StateMachine::Dispatch(*this, TRANSITIONS, INDEX, pEvent);
+}
 
-    _windowCount = 0;
-    _windowSum = 0;
+
+void StateScanForNewDirection::OnSpinComplete(const Event*)
+{
+    headingTask.Untrack();
+    Movement::Stop();
 }
 
 
-void StateScanForNewDirection::OnEvent(const Event * pEvent)
+//******************************************************************************
+/// <summary>
+/// Pings the chosen direction while spinning toward it. If the opening closes
+/// the spin is stopped and a new scan is started, up to MAX_RESCANS times;
+/// after that the robot turns around (StateReversingDirection).
+/// </summary>
+//******************************************************************************
+void StateScanForNewDirection::WatchOpening()
 {
-    switch (pEvent->EventID)
-    {
-        case TaskSpin::SPIN_COMPLETE_EVENT:
-            TRACE(Logger(_classname_) << F("SPIN_COMPLETE") << endl);
-            Movement::Stop();
-            TaskManager::SetCurrentState(movingState);
-            break;
+    if (!headingTask.IsTracking() || !spinTask.IsRunning()) return;
 
-        case TaskSpin::SPIN_ABORT_EVENT:
-            TRACE(Logger(_classname_) << F("SPIN_ABORT") << endl);
-            TaskManager::SetCurrentState(reversingDirectionState);
-            break;
+    if (!Sonar::Ready()) return;
+
+    auto ping = Sonar::PingAt(headingTask.TrackAngle(), Sonar::SCAN_RANGE);
+
+    if (ping == PING_FAILED) return;
+
+    _blockedCount = (ping <= Sonar::THRESHOLD2) ? _blockedCount + 1 : 0;
+
+    if (_blockedCount < BLOCKED_COUNT) return;
+
+    TRACE(Logger(_classname_, F("WatchOpening")) << F("Opening closed, ping=") << ping << endl);
+    spinTask.Suspend();
+    headingTask.Untrack();
+    Movement::Stop();
+
+    if (++_rescanCount > MAX_RESCANS)
+    {
+        TRACE(Logger(_classname_, F("WatchOpening")) << F("Too many closed openings") << endl);
+        TaskManager::SetCurrentState(reversingDirectionState);
+        return;
     }
+
+    ScanBegin();
 }
 
 
 void StateScanForNewDirection::ScanBegin()
 {
-    _scanAngle = MAX_RIGHT_ANGLE;
-    _scanDirection = SCAN_LEFT;
-    _bestPing = 0;
-    _bestAngle = 0;
-    _windowSum = 0.0;
-    _windowCount = 0;
+    planner.Begin();
+    ScanLog::Begin(Telemetry::SCAN_PLANNER);
+    _blockedCount = 0;
+    _isAimed = false;
     _isScanning = true;
 
     // Make sure the ultrasonic sensor is ready
@@ -153,9 +236,17 @@ void StateScanForNewDirection::ScanBegin()
 void StateScanForNewDirection::ScanComplete()
 {
     _isScanning = false;
-    Sonar::PanSonar(_bestAngle);
+    _bestAngle = planner.BestAngle();
+    _bestPing = planner.BestPing();
+
+    if (STABILIZED_SONAR)
+        headingTask.Track(headingTask.WorldAngle(_bestAngle));
+    else
+        Sonar::PanSonar(_bestAngle);
+
+    TRACE(Logger(_classname_) << F("bestAngle=") << _bestAngle << F(", bestPing=") << _bestPing << F(", pings=") << planner.Pings() << endl);
 
-    TRACE(Logger(_classname_) << F("bestAngle=") << _bestAngle << F(", bestPing=") << _bestPing << endl);
+    ScanLog::Choose(_bestPing < Sonar::THRESHOLD3 ? Telemetry::NO_CHOICE : _bestAngle);
 
     if (_bestPing < Sonar::THRESHOLD3)
     {
@@ -3,6 +3,9 @@
 #include <RTL_TaskManager.h>
 #include <StateBase.h>
 
+#include "Scheduler.h"
+#include "StateMachine.h"
+
 
 class StateScanForNewDirection : public StateBase
 {
@@ -20,18 +23,30 @@ class StateScanForNewDirection : public StateBase
     public: void StateChanging(TaskState newState) override;
     public: const __FlashStringHelper* Name() override { return _classname_; };
 
+    /*--------------------------------------------------------------------------
+    State description (in flash, see StateMachine.h)
+    --------------------------------------------------------------------------*/
+    private: static PeriodicTask* const TASK_LIST[];
+    private: static const StateMachine::Transition<StateScanForNewDirection> TRANSITIONS[];
+    private: static const StateMachine::Index INDEX;
+
+    /*--------------------------------------------------------------------------
+    Transition actions
+    --------------------------------------------------------------------------*/
+    private: void OnSpinComplete(const Event* pEvent);
+
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
     private: void ScanBegin();
     private: void ScanComplete();
-    private: void UpdateBestAngle();
+    private: void WatchOpening();
 
     private: bool _isScanning;
-    private: float _windowSum;
-    private: int16_t _windowCount;
-    private: int16_t _scanDirection;
+    private: bool _isAimed;             // The sonar has been sent to _scanAngle, the next direction to ping
     private: int16_t _scanAngle;
     private: int16_t _bestAngle;
     private: uint16_t _bestPing;
+    private: uint8_t _blockedCount;
+    private: uint8_t _rescanCount;      // Scans restarted by WatchOpening() since the state was entered
 };
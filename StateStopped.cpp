@@ -6,15 +6,55 @@
 #include <RTL_TaskManager.h>
 
 #include "Robot_9_Tank.h"
+#include "Safety.h"
+#include "Scheduler.h"
 #include "Sonar.h"
+#include "Metrics.h"
 #include "Movement.h"
 #include "States.h"
+#include "StateMachine.h"
 #include "Tasks.h"
 
 
 DEFINE_CLASSNAME(StateStopped);
 
 
+//******************************************************************************
+// State description (see StateMachine.h)
+//******************************************************************************
+constexpr StateMachine::Transition<StateStopped> StateStopped::TRANSITIONS[] PROGMEM =
+{
+    { TaskIRRemote::CMD_MOVE_EVENT,         nullptr, nullptr,                      &movingState },
+    { TaskIRRemote::CMD_TURN_BEGIN_EVENT,   nullptr, &StateStopped::OnTurnBegin,   nullptr },
+    { TaskIRRemote::CMD_TURN_END_EVENT,     nullptr, &StateStopped::OnStop,        nullptr },
+    { TaskIRRemote::CMD_BACKUP_BEGIN_EVENT, nullptr, &StateStopped::OnBackupBegin, nullptr },
+    { TaskIRRemote::CMD_BACKUP_END_EVENT,   nullptr, &StateStopped::OnStop,        nullptr },
+};
+
+constexpr StateMachine::Index StateStopped::INDEX PROGMEM = StateMachine::IndexOf(StateStopped::TRANSITIONS);
+
+// Events this state deliberately does nothing with (checked in OnEvent())
+constexpr uint16_t IGNORED[] =
+{
+    TaskStepDetection::STEP_DETECTED_EVENT,
+    TaskScanSonar::OBSTACLE_NONE_EVENT,
+    TaskScanSonar::OBSTACLE_DETECTED_EVENT,
+    TaskScanSonar::OBSTACLE_DANGER_EVENT,
+    TaskScanSonar::SCAN_COMPLETE_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_NONE_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_LEFT_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_RIGHT_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_BLOCKED_EVENT,
+    TaskNearObstacleDetection::OBSTACLE_FRONT_EVENT,
+    TaskIRRemote::CMD_STOP_EVENT,
+    TaskSpin::SPIN_COMPLETE_EVENT,
+    TaskSpin::SPIN_ABORT_EVENT,
+    TaskTurn::TURN_COMPLETE_EVENT,
+    TaskTurn::TURN_ABORT_EVENT,
+    TaskBackup::BACKUP_COMPLETE_EVENT,
+};
+
+
 StateStopped::StateStopped()
 {
 }
@@ -26,8 +66,10 @@ void StateStopped::StateChanging(TaskState newState)
     {
         case TaskState::Resuming:
             TRACE(Logger(_classname_) << F("Activating") << endl);
-            TaskManager::SetTaskList(nullptr);
+            Metrics::StateEntered(Metrics::STOPPED);
+            Scheduler::SetTaskList(nullptr);
             Movement::Stop();
+            Safety::Clear();
             break;
 
         case Suspending:
@@ -47,33 +89,26 @@ void StateStopped::Poll()
 
 void StateStopped::OnEvent(const Event * pEvent)
 {
-    if (!IsRunning()) return;
+    static_assert(StateMachine::Covers(TRANSITIONS, IGNORED), "StateStopped: every event must be handled or ignored");
 
-    switch (pEvent->EventID)
-    {
-        case TaskIRRemote::CMD_MOVE_EVENT:
-            TRACE(Logger(_classname_) << F("CMD_MOVE_EVENT") << endl);
-            TaskManager::SetCurrentState(movingState);
-            break;
+    StateMachine::Dispatch(*this, TRANSITIONS, INDEX, pEvent);
+}
 
-        case TaskIRRemote::CMD_TURN_BEGIN_EVENT:
-            TRACE(Logger(_classname_) << F("CMD_TURN_BEGIN_EVENT") << F("Direction=") << pEvent->Data.Char << endl);
-            Movement::Spin(pEvent->Data.Char);
-            break;
 
-        case TaskIRRemote::CMD_TURN_END_EVENT:
-            TRACE(Logger(_classname_) << F("CMD_TURN_END_EVENT") << endl);
-            Movement::Stop();
-            break;
+void StateStopped::OnTurnBegin(const Event* pEvent)
+{
+    TRACE(Logger(_classname_) << F("CMD_TURN_BEGIN_EVENT, Direction=") << pEvent->Data.Char << endl);
+    Movement::Spin(pEvent->Data.Char);
+}
 
-        case TaskIRRemote::CMD_BACKUP_BEGIN_EVENT:
-            TRACE(Logger(_classname_) << F("CMD_BACKUP_BEGIN_EVENT") << endl);
-            Movement::GoBackward();
-            break;
 
-        case TaskIRRemote::CMD_BACKUP_END_EVENT:
-            TRACE(Logger(_classname_) << F("CMD_BACKUP_END_EVENT") << endl);
-            Movement::Stop();
-            break;
-    }
+void StateStopped::OnBackupBegin(const Event*)
+{
+    Movement::GoBackward();
+}
+
+
+void StateStopped::OnStop(const Event*)
+{
+    Movement::Stop();
 }
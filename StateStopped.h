@@ -3,6 +3,9 @@
 #include <RTL_TaskManager.h>
 #include <StateBase.h>
 
+#include "Scheduler.h"
+#include "StateMachine.h"
+
 
 class StateStopped : public StateBase
 {
@@ -21,6 +24,15 @@ class StateStopped : public StateBase
     public: const __FlashStringHelper* Name() override { return _classname_; };
 
     /*--------------------------------------------------------------------------
-    Internal implementation
+    State description (in flash, see StateMachine.h)
+    --------------------------------------------------------------------------*/
+    private: static const StateMachine::Transition<StateStopped> TRANSITIONS[];
+    private: static const StateMachine::Index INDEX;
+
+    /*--------------------------------------------------------------------------
+    Transition actions
     --------------------------------------------------------------------------*/
+    private: void OnTurnBegin(const Event* pEvent);
+    private: void OnBackupBegin(const Event* pEvent);
+    private: void OnStop(const Event* pEvent);
 };
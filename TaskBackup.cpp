@@ -31,14 +31,13 @@ void TaskBackup::StateChanging(TaskState newState)
 }
 
 
+//******************************************************************************
+// The task's phase is the backup duration, so the first run means we are done
+//******************************************************************************
 void TaskBackup::Poll()
 {
-    if (millis() >= _timeout)
-    {
-        Suspend();
-        _timeout = 0;
-        EventQueue::Queue(*this, BACKUP_COMPLETE_EVENT, 0);
-    }
+    Suspend();
+    EventQueue::Queue(*this, BACKUP_COMPLETE_EVENT, 0);
 }
 
 
@@ -51,5 +50,6 @@ void TaskBackup::Start(uint16_t duration)
 
 void TaskBackup::SetDuration(uint16_t duration)
 {
-    _timeout = millis() + duration;
+    SetPeriod(duration, duration);
+    Restart();
 }
@@ -1,9 +1,10 @@
 #pragma once
 
 #include <RTL_TaskManager.h>
+#include "Scheduler.h"
 
 
-class TaskBackup : public TaskBase,
+class TaskBackup : public PeriodicTask,
                    public EventSource
 {
     DECLARE_CLASSNAME;
@@ -15,7 +16,7 @@ class TaskBackup : public TaskBase,
     /*--------------------------------------------------------------------------
     Constructors
     --------------------------------------------------------------------------*/
-    public: TaskBackup() {};
+    public: TaskBackup() : PeriodicTask(500, 500) {};
 
     /*--------------------------------------------------------------------------
     Base class overrides
@@ -34,5 +35,4 @@ class TaskBackup : public TaskBase,
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
-    private: uint32_t _timeout = 0;
 };
@@ -1,21 +1,86 @@
 #define DEBUG 0
 
+#include <Arduino.h>
+#include <EEPROM.h>
+
 #include <RTL_Stdlib.h>
+#include "Robot_9_Tank.h"
 #include "IMU.h"
 #include "Movement.h"
-#include "TaskCorrectCourse.h"
+#include "Safety.h"
+#include "Sonar.h"
+#include "Telemetry.h"
+#include "Tasks.h"
+
 
+// The controller runs on every gyro sample taken by TaskHeading (100Hz). It
+// can be run on every 2nd sample (50Hz) by setting this to 20; TaskHeading's
+// period would have to come down to go faster than 100Hz.
+constexpr auto SAMPLE_INTERVAL = 10;   // milliseconds
 
-constexpr auto SAMPLE_INTERVAL = 100;  // milliseconds
+// Default gains, used for every speed until Autotune() has been run. They can
+// also be tuned off-line against recorded CorrectCourse logs with Tools/PidTune.cpp
+// (which gives them for a 100ms interval - the scaling below keeps them valid).
 constexpr auto Kp = 20.00;
 constexpr auto Ki =  2.00 * (SAMPLE_INTERVAL / 1000.0);
 constexpr auto Kd =  0.00 / (SAMPLE_INTERVAL / 1000.0);
 constexpr auto alpha = 0.8;
 
+// Shortest time between writes to the right motor. The correction changes
+// on almost every sample at 100Hz; each write is an I2C transaction to the
+// motor shield and the motors can't follow that fast anyway.
+constexpr uint16_t MOTOR_INTERVAL = 20;     // milliseconds
+
+// Telemetry records are sent at most this often, so streaming them doesn't
+// swamp the serial port (and the loop) at the higher sample rate
+constexpr uint16_t TELEMETRY_INTERVAL = 100;    // milliseconds
+
+// Hold a target heading across avoidance moves (see TaskCorrectCourse.h).
+// Set to false to start a new course each time the task resumes.
+constexpr auto HEADING_HOLD = true;
+
+// Relay auto-tuning (see RelayTuner)
+constexpr int16_t RELAY_AMPLITUDE = 40;     // Trim switched on the right motor
+constexpr float RELAY_HYSTERESIS = 1.0;     // Degrees
+constexpr uint16_t TUNE_TIMEOUT = 15000;    // Longest a speed may take to tune (ms)
+constexpr uint16_t GYRO_INTERVAL = 10;      // Heading integration step while tuning (ms)
+constexpr uint16_t VALIDATE_SETTLE = 2000;  // Validation run: settling time, not measured (ms)
+constexpr uint16_t VALIDATE_TIME = 4000;    // Validation run: time measured (ms)
+constexpr uint8_t VALIDATE_PASSES = 2;      // Validation runs the tuned gains must all win
+
+// Marks a valid record in EEPROM. Records written before the interval was
+// stored (magic 0x4347, 100ms gains) are ignored - re-run Autotune().
+const uint16_t COURSE_GAINS_MAGIC = 0x4348;
+
+struct CourseGainsRecord
+{
+    uint16_t magic;
+    uint16_t interval;          // SAMPLE_INTERVAL the (per-sample) gains are for
+    CourseGains gains[TaskCorrectCourse::SPEED_COUNT];
+    uint8_t checksum;
+};
+
 
 DEFINE_CLASSNAME(TaskCorrectCourse);
 
 
+const int TaskCorrectCourse::TABLE_SPEEDS[SPEED_COUNT] = { Movement::SLOW_SPEED, Movement::CRUISE_SPEED };
+
+
+TaskCorrectCourse::TaskCorrectCourse() : PeriodicTask(SAMPLE_INTERVAL, SAMPLE_INTERVAL),
+                                         _controller({ Kp, Ki, Kd, alpha })
+{
+    for (auto& gains : _gainTable) gains = { Kp, Ki, Kd, alpha };
+}
+
+
+void TaskCorrectCourse::Begin()
+{
+    LoadGains();
+    Report(F("Course gains"));
+}
+
+
 void TaskCorrectCourse::StateChanging(TaskState newState)
 {
     switch (newState)
@@ -39,51 +104,409 @@ void TaskCorrectCourse::Poll()
 {
     if (!Movement::isMoving) return;
 
-    //TRACE(Logger(_classname_) << F("Poll - processing") << endl);
+    // Only act on a new gyro sample - this task and TaskHeading have the same
+    // period but their relative order in the loop isn't fixed
+    auto& sample = headingTask.Sample();
 
-    auto t1 = millis();
+    if (sample.count == _sampleCount) return;
 
-    if (t1 < _timeout) return;
+    _sampleCount = sample.count;
 
-    auto wz = imu.GetGyroRateZ();
-    auto w1 = alpha * _w0 + (1 - alpha)*wz;
-    auto dt = (t1 - _t0) / 1000.0;
-    auto h1 = _h0 + w1 * dt;
-    auto e1 = 0 - h1;    // The current error
+    //TRACE(Logger(_classname_) << F("Poll - processing") << endl);
 
-    _ei += e1;           // The accumulated error (integrated error)
+    auto speed = Movement::Speed();
 
-    auto correction = int16_t(Kp * e1 + Ki * _ei);
+    // Gains and limits follow the commanded speed
+    if (speed != _speed)
+    {
+        _speed = speed;
+        _controller.SetGains(GainsFor(speed));
+        _controller.SetLimits(-abs(speed), Movement::MAX_SPEED - abs(speed));
+        _trim = 0x7FFF;     // Changing speed takes the trim off - write it again
+    }
+
+    // dt is from the sample timestamps, so a late run integrates over the time that really passed
+    auto dt = udiff(sample.time, _t0) / 1000000.0f;
+    auto w0 = _controller.W0();
+    auto h0 = _controller.H0();
+    auto correction = HEADING_HOLD ? _controller.Hold(headingTask.Heading(), _target, dt * 1000 / SAMPLE_INTERVAL)
+                                   : _controller.Update(sample.rate, dt);
 
     // Modify right motor speed to compensate for drift
     // If we are drifting right then the right motor is too slow, so speed it up
     // If we are drifting left then the right motor is too fast, so slow it down
-    Movement::Trim('R', correction);
-
-    TRACE(Logger(_classname_, F("CorrectCourse")) << F("dt=")   << _FLOAT(dt, 3)
-                                                  << F(", w0=") << _FLOAT(_w0, 3)
-                                                  << F(", wz=") << _FLOAT(wz, 3)
-                                                  << F(", w1=") << _FLOAT(w1, 3)
-                                                  << F(", h0=") << _FLOAT(_h0, 3)
-                                                  << F(", h1=") << _FLOAT(h1, 3)
-                                                  << F(", e1=") << _FLOAT(e1, 3)
-                                                  << F(", ei=") << _FLOAT(_ei, 3)
-                                                  << F(", correction=") << correction
-                                                  << endl);
-
-    _w0 = w1;
-    _h0 = h1;
-    _e0 = e1;
-    _t0 = t1;
-    _timeout = t1 + SAMPLE_INTERVAL;
+    auto now = millis();
+
+    if (correction != _trim && (now - _trimTime) >= MOTOR_INTERVAL)
+    {
+        Movement::Trim('R', correction);
+        _trim = correction;
+        _trimTime = now;
+    }
+
+    if (Telemetry::enabled && (now - _telemetryTime) >= TELEMETRY_INTERVAL)
+    {
+        Telemetry::CorrectCourseRecord record;
+
+        record.dt = uint16_t((dt * 1000) + 0.5);
+        record.w0 = Telemetry::Fixed(w0);
+        record.wz = Telemetry::Fixed(sample.rate);
+        record.w1 = Telemetry::Fixed(_controller.W0());
+        record.h0 = Telemetry::Fixed(h0);
+        record.h1 = Telemetry::Fixed(_controller.H0());
+        record.e1 = Telemetry::Fixed(_controller.E0());
+        record.ei = Telemetry::Fixed(_controller.Ei());
+        record.correction = correction;
+        Telemetry::Send(record);
+        _telemetryTime = now;
+    }
+
+    _t0 = sample.time;
 }
 
 
+//******************************************************************************
+/// <summary>
+/// Starts correcting again after the task was suspended. The controller
+/// history is cleared, but in heading-hold mode the target is kept.
+/// </summary>
+//******************************************************************************
 void TaskCorrectCourse::Reset()
 {
-    _ei = 0;
-    _w0 = 0;
-    _h0 = 0;
-    _t0 = millis();
-    _timeout = _t0 + SAMPLE_INTERVAL;
+    _controller.Reset();
+    _t0 = headingTask.Sample().time;
+    _sampleCount = headingTask.Sample().count;
+    _trim = 0x7FFF;     // Force the first correction to be written
+    _trimTime = millis() - MOTOR_INTERVAL;
+    Restart();
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Makes the current heading the one to hold.
+/// </summary>
+//******************************************************************************
+void TaskCorrectCourse::Retarget()
+{
+    _target = headingTask.Heading();
+    TRACE(Logger(_classname_, F("Retarget")) << F("target=") << _FLOAT(_target, 1) << endl);
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Gains for a speed, interpolated between the gain table entries.
+/// </summary>
+//******************************************************************************
+CourseGains TaskCorrectCourse::GainsFor(int speed)
+{
+    speed = abs(speed);
+
+    if (speed <= TABLE_SPEEDS[0]) return _gainTable[0];
+
+    for (uint8_t i = 1; i < SPEED_COUNT; i++)
+    {
+        if (speed > TABLE_SPEEDS[i]) continue;
+
+        auto& g0 = _gainTable[i - 1];
+        auto& g1 = _gainTable[i];
+        auto f = float(speed - TABLE_SPEEDS[i - 1]) / (TABLE_SPEEDS[i] - TABLE_SPEEDS[i - 1]);
+
+        return { g0.Kp + f * (g1.Kp - g0.Kp), g0.Ki + f * (g1.Ki - g0.Ki),
+                 g0.Kd + f * (g1.Kd - g0.Kd), g0.alpha + f * (g1.alpha - g0.alpha) };
+    }
+
+    return _gainTable[SPEED_COUNT - 1];
+}
+
+
+static uint8_t Checksum(const CourseGainsRecord& record)
+{
+    auto p = (const uint8_t*)&record.interval;
+    uint8_t sum = 0;
+
+    for (uint8_t i = 0; i < sizeof(record.interval) + sizeof(record.gains); i++) sum += p[i];
+
+    return ~sum;
+}
+
+
+//******************************************************************************
+// Loads the gain table from EEPROM, keeping the defaults if the robot has
+// never been tuned (or the record looks wrong).
+//******************************************************************************
+void TaskCorrectCourse::LoadGains()
+{
+    CourseGainsRecord record;
+
+    EEPROM.get(EEPROM_COURSE_GAINS, record);
+
+    if (record.magic != COURSE_GAINS_MAGIC || record.checksum != Checksum(record) || record.interval == 0) return;
+
+    for (auto& gains : record.gains)
+    {
+        if (!(gains.Kp > 0 && gains.Kp < 1000 && gains.Ki >= 0 && gains.Ki < 100)) return;
+    }
+
+    // The gains are per sample - rescale them if they were measured at another interval
+    auto f = float(SAMPLE_INTERVAL) / record.interval;
+
+    for (uint8_t i = 0; i < SPEED_COUNT; i++)
+    {
+        auto& gains = record.gains[i];
+
+        _gainTable[i] = { gains.Kp, gains.Ki * f, gains.Kd / f, gains.alpha };
+    }
+
+    _speed = 0;         // Pick up the new gains on the next run
+}
+
+
+void TaskCorrectCourse::SaveGains()
+{
+    CourseGainsRecord record;
+
+    record.magic = COURSE_GAINS_MAGIC;
+    record.interval = SAMPLE_INTERVAL;
+    memcpy(record.gains, _gainTable, sizeof(record.gains));
+    record.checksum = Checksum(record);
+    EEPROM.put(EEPROM_COURSE_GAINS, record);
+}
+
+
+void TaskCorrectCourse::Report(const __FlashStringHelper* label)
+{
+    for (uint8_t i = 0; i < SPEED_COUNT; i++)
+    {
+        auto& gains = _gainTable[i];
+
+        Logger(_classname_) << label << F(": speed=") << TABLE_SPEEDS[i]
+                            << F(", Kp=") << _FLOAT(gains.Kp, 2) << F(", Ki=") << _FLOAT(gains.Ki, 3)
+                            << F(", Kd=") << _FLOAT(gains.Kd, 2) << endl;
+    }
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Measures the course controller gains at each table speed with a relay
+/// test, and saves the ones that hold the course better in EEPROM.
+/// </summary>
+/// <returns>true if every speed was measured</returns>
+/// <remarks>
+/// The robot must be stopped with about 5m of clear floor ahead. At each
+/// speed it drives forward with the right motor trim switched by a relay on
+/// the heading error (see RelayTuner), weaving gently about its starting
+/// heading until the oscillation has been measured - usually about 1m, but up
+/// to 4.5m (TUNE_TIMEOUT at CRUISE_SPEED) - then backs up to where it started.
+/// Motor writes are spaced MOTOR_INTERVAL apart, as when the task runs. The
+/// tuned gains are then raced against the current ones over the same stretch
+/// of floor (see TrackingError), and only replace them if their RMS heading
+/// error is lower on every one of VALIDATE_PASSES passes - a single short run
+/// is too noisy to trust (see Tools/CorridorSim -t). Rejected gains are
+/// logged and dropped. A run stops if the sonar sees anything inside
+/// THRESHOLD2, on a safety fault, or if the oscillation does not settle within
+/// TUNE_TIMEOUT. Gains accepted at earlier speeds are saved even if a later
+/// one fails.
+/// </remarks>
+//******************************************************************************
+bool TaskCorrectCourse::Autotune()
+{
+    uint8_t measured = 0;
+    uint8_t changed = 0;
+
+    Logger(_classname_) << F("Auto-tuning course correction") << endl;
+    Report(F("Before"));
+    Sonar::PanSonar(0);
+
+    for (uint8_t i = 0; i < SPEED_COUNT; i++)
+    {
+        RelayTuner relay(RELAY_AMPLITUDE, RELAY_HYSTERESIS);
+        float heading = 0;
+        auto w0 = imu.GetGyroRateZ();
+        auto t0 = micros();
+        auto start = millis();
+        auto nextSample = start + SAMPLE_INTERVAL;
+        auto trimTime = start - MOTOR_INTERVAL;
+        int16_t trim = 0;
+        auto blocked = false;
+
+        Movement::Go(TABLE_SPEEDS[i]);
+
+        while (!relay.Done() && !blocked && Safety::Faults() == 0 && (millis() - start) < TUNE_TIMEOUT)
+        {
+            Safety::Delay(GYRO_INTERVAL);
+
+            // Trapezoidal integration of the gyro rate, as in TaskHeading
+            auto t1 = micros();
+            auto w1 = imu.GetGyroRateZ();
+
+            heading += (w0 + (w1 - w0) / 2.0) * (udiff(t1, t0) / 1000000.0f);
+            w0 = w1;
+            t0 = t1;
+
+            if (int32_t(millis() - nextSample) < 0) continue;
+
+            nextSample += SAMPLE_INTERVAL;
+
+            // Motor writes no more often than the task makes them
+            auto correction = relay.Update(0 - heading, (millis() - start) / 1000.0f);
+
+            if (correction != trim && (millis() - trimTime) >= MOTOR_INTERVAL)
+            {
+                Movement::Trim('R', correction);
+                trim = correction;
+                trimTime = millis();
+            }
+
+            if (Sonar::Ready()) blocked = Sonar::Ping(Sonar::PING_AHEAD_RANGE) <= Sonar::THRESHOLD2;
+        }
+
+        Movement::Stop();
+
+        auto driven = millis() - start;
+
+        if (!relay.Done())
+        {
+            Logger(_classname_) << F("Auto-tune stopped at speed ") << TABLE_SPEEDS[i]
+                                << (blocked ? F(": obstacle ahead")
+                                    : Safety::Faults() != 0 ? F(": safety fault") : F(": no steady oscillation"))
+                                << endl;
+            break;
+        }
+
+        auto tuned = relay.Gains(SAMPLE_INTERVAL / 1000.0, alpha);
+
+        Logger(_classname_) << F("speed=") << TABLE_SPEEDS[i] << F(", Ku=") << _FLOAT(relay.Ku(), 2)
+                            << F(", Tu=") << _FLOAT(relay.Tu(), 2) << 's' << endl;
+
+        // Back to the start, so the validation runs have the same floor ahead
+        Safety::Delay(500);
+        Movement::GoBackward(driven * TABLE_SPEEDS[i] / Movement::CRUISE_SPEED);
+
+        // Keep the tuned gains only if they hold the course better on every pass
+        auto accepted = true;
+        auto interrupted = false;
+
+        for (uint8_t pass = 0; pass < VALIDATE_PASSES && accepted && !interrupted; pass++)
+        {
+            Safety::Delay(1000);
+
+            auto currentError = TrackingError(TABLE_SPEEDS[i], _gainTable[i]);
+            auto tunedError = (currentError >= 0) ? TrackingError(TABLE_SPEEDS[i], tuned) : -1;
+
+            interrupted = tunedError < 0;
+            accepted = tunedError < currentError;
+
+            Logger(_classname_) << F("speed=") << TABLE_SPEEDS[i] << F(", RMS error current=") << _FLOAT(currentError, 2)
+                                << F(", tuned=") << _FLOAT(tunedError, 2) << endl;
+        }
+
+        if (interrupted)
+        {
+            Logger(_classname_) << F("Auto-tune stopped at speed ") << TABLE_SPEEDS[i] << F(": validation run interrupted") << endl;
+            break;
+        }
+
+        measured++;
+
+        if (accepted)
+        {
+            Logger(_classname_) << F("speed=") << TABLE_SPEEDS[i] << F(": using the tuned gains") << endl;
+            _gainTable[i] = tuned;
+            changed++;
+        }
+        else
+        {
+            Logger(_classname_) << F("speed=") << TABLE_SPEEDS[i] << F(": tuned gains rejected, kept current gains") << endl;
+        }
+
+        Safety::Delay(1000);
+    }
+
+    if (changed > 0)
+    {
+        SaveGains();
+        _speed = 0;     // Pick up the new gains on the next run
+    }
+
+    Report(F("After"));
+
+    return measured == SPEED_COUNT;
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Drives straight holding the starting heading with the given gains, and
+/// returns the RMS heading error (degrees), or -1 if the run was stopped by an
+/// obstacle or a safety fault.
+/// </summary>
+/// <remarks>
+/// The first VALIDATE_SETTLE is left out, while the integral takes up the
+/// difference between the motors, and the error is measured over the next
+/// VALIDATE_TIME. The robot then backs up to where it started, so the gains
+/// being compared drive over the same floor.
+/// </remarks>
+//******************************************************************************
+float TaskCorrectCourse::TrackingError(int speed, const CourseGains& gains)
+{
+    CourseController controller(gains);
+    float heading = 0;
+    float sum = 0;
+    uint16_t count = 0;
+    auto w0 = imu.GetGyroRateZ();
+    auto t0 = micros();
+    auto start = millis();
+    auto nextSample = start + SAMPLE_INTERVAL;
+    auto trimTime = start - MOTOR_INTERVAL;
+    int16_t trim = 0;
+    auto blocked = false;
+
+    controller.SetLimits(-speed, Movement::MAX_SPEED - speed);
+    Movement::Go(speed);
+
+    while (!blocked && Safety::Faults() == 0 && (millis() - start) < VALIDATE_SETTLE + VALIDATE_TIME)
+    {
+        Safety::Delay(GYRO_INTERVAL);
+
+        auto t1 = micros();
+        auto w1 = imu.GetGyroRateZ();
+
+        heading += (w0 + (w1 - w0) / 2.0) * (udiff(t1, t0) / 1000000.0f);
+        w0 = w1;
+        t0 = t1;
+
+        if (int32_t(millis() - nextSample) < 0) continue;
+
+        nextSample += SAMPLE_INTERVAL;
+
+        auto correction = controller.Hold(heading, 0);
+
+        if (correction != trim && (millis() - trimTime) >= MOTOR_INTERVAL)
+        {
+            Movement::Trim('R', correction);
+            trim = correction;
+            trimTime = millis();
+        }
+
+        if (Sonar::Ready()) blocked = Sonar::Ping(Sonar::PING_AHEAD_RANGE) <= Sonar::THRESHOLD2;
+
+        if ((millis() - start) < VALIDATE_SETTLE) continue;
+
+        sum += heading * heading;
+        count++;
+    }
+
+    Movement::Stop();
+
+    if (blocked || Safety::Faults() != 0 || count == 0) return -1;
+
+    auto driven = millis() - start;
+
+    Safety::Delay(500);
+    Movement::GoBackward(driven * speed / Movement::CRUISE_SPEED);
+
+    return sqrtf(sum / count);
 }
@@ -1,15 +1,43 @@
 #pragma once
 
 #include <RTL_TaskManager.h>
+#include "Scheduler.h"
+#include "CourseController.h"
 
 
-class TaskCorrectCourse :  public TaskBase
+//******************************************************************************
+/// <summary>
+/// Holds the robot on a straight course by trimming the right motor.
+/// </summary>
+/// <remarks>
+/// With HEADING_HOLD the course is a target heading (from TaskHeading) that is
+/// kept when the task is suspended and resumed around short avoidance moves,
+/// so the robot comes back to it afterwards. Only Retarget() - called after a
+/// deliberate change of direction - moves it. Without HEADING_HOLD the course
+/// is wherever the robot points each time the task resumes.
+///
+/// The gains are scheduled by speed: there is a set for each speed in
+/// TABLE_SPEEDS, interpolated in between. The table is kept in EEPROM and
+/// can be measured on the robot with Autotune().
+///
+/// The controller runs on the gyro samples TaskHeading takes every 10ms, with
+/// dt from their timestamps. Writes to the motor are rate-limited to
+/// MOTOR_INTERVAL and skipped when the correction hasn't changed.
+/// </remarks>
+//******************************************************************************
+class TaskCorrectCourse :  public PeriodicTask
 {
     DECLARE_CLASSNAME;
+    /*--------------------------------------------------------------------------
+    Constants
+    --------------------------------------------------------------------------*/
+    public: static const uint8_t SPEED_COUNT = 2;
+    public: static const int TABLE_SPEEDS[SPEED_COUNT];    // Speeds the gain table is measured at
+
     /*--------------------------------------------------------------------------
     Constructors
     --------------------------------------------------------------------------*/
-    public: TaskCorrectCourse() {};
+    public: TaskCorrectCourse();
 
     /*--------------------------------------------------------------------------
     Base class overrides
@@ -21,16 +49,29 @@ class TaskCorrectCourse :  public TaskBase
     /*--------------------------------------------------------------------------
     Public interface
     --------------------------------------------------------------------------*/
+    public: void Begin();
     public: void Reset();
+    public: void Retarget();
+    public: bool Autotune();
+    public: float Target() { return _target; };
 
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
-    private: uint32_t _timeout = 0;     // Time to next sample
-    private: uint32_t _t0;              // Time of previous sample
-    private: float _w0;                 // Previous angular rate measurement
-    private: float _h0;                 // Previous heading measurement 
-    private: float _e0;                 // Previous error measurement 
-    private: float _ei;                 // Accumulated error 
+    private: CourseGains GainsFor(int speed);
+    private: void LoadGains();
+    private: void SaveGains();
+    private: float TrackingError(int speed, const CourseGains& gains);
+    private: void Report(const __FlashStringHelper* label);
+
+    private: uint32_t _t0;              // micros() of the previous gyro sample used
+    private: uint16_t _sampleCount;     // GyroSample::count of the previous sample used
+    private: int16_t _trim;             // Correction last written to the motor
+    private: uint32_t _trimTime;        // millis() of the last motor write
+    private: uint32_t _telemetryTime = 0;
+    private: int _speed = 0;            // Speed the controller's gains and limits are set for
+    private: CourseGains _gainTable[SPEED_COUNT];
+    private: float _target = 0;         // Heading to hold (degrees, TaskHeading frame)
+    private: CourseController _controller;
 };
 
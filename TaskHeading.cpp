@@ -0,0 +1,121 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+#include <RTL_Stdlib.h>
+
+#include "IMU.h"
+#include "Sonar.h"
+#include "Tasks.h"
+
+
+DEFINE_CLASSNAME(TaskHeading);
+
+
+void TaskHeading::StateChanging(TaskState newState)
+{
+    switch (newState)
+    {
+        case TaskState::Resuming:
+            TRACE(Logger(_classname_) << F("Resuming") << endl);
+            if (imu.IsActive()) Read();
+            break;
+
+        case Suspending:
+            TRACE(Logger(_classname_) << F("Suspending") << endl);
+            Untrack();
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+void TaskHeading::Poll()
+{
+    if (!imu.IsActive()) return;
+
+    // Trapezoidal integration of the gyro rate, as in TaskSpin
+    auto w0 = _sample.rate;
+    auto t0 = _sample.time;
+
+    Read();
+
+    auto dt = udiff(_sample.time, t0) / 1000000.0f;
+
+    _heading += (w0 + (_sample.rate - w0) / 2.0) * dt;
+
+    if (_heading > 180) _heading -= 360;
+    else if (_heading < -180) _heading += 360;
+
+    if (_isTracking) Aim();
+}
+
+
+// Takes a new gyro sample
+void TaskHeading::Read()
+{
+    _sample.time = micros();
+    _sample.rate = imu.GetGyroRateZ();
+    _sample.count++;
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Points the sonar at a world direction (a heading, see WorldAngle()) and
+/// keeps it there as the robot turns, until Untrack() is called.
+/// </summary>
+/// <remarks>
+/// With panServo false only TrackAngle() is kept up to date, and the servo is
+/// left to whoever owns it - TaskScanSonar pings ahead while moving, and pans
+/// to TrackAngle() itself for its looks (see TaskScanSonar::LookAhead()).
+/// </remarks>
+//******************************************************************************
+void TaskHeading::Track(int16_t worldAngle, bool panServo)
+{
+    TRACE(Logger(_classname_, F("Track")) << F("worldAngle=") << worldAngle << endl);
+
+    _target = Wrap(worldAngle);
+    _isTracking = imu.IsActive();
+    _isPanning = panServo;
+    _trackAngle = 0x7FFF;       // Force the first Aim() to move the servo
+
+    if (_isTracking) Aim();
+}
+
+
+void TaskHeading::Untrack()
+{
+    _isTracking = false;
+    _trackAngle = 0;
+}
+
+
+// Wraps an angle into the range +/-180 degrees
+int16_t TaskHeading::Wrap(float angle)
+{
+    auto wrapped = int16_t(angle) % 360;
+
+    if (wrapped > 180) wrapped -= 360;
+    else if (wrapped < -180) wrapped += 360;
+
+    return wrapped;
+}
+
+
+//******************************************************************************
+// Works out the tracked direction relative to the current heading, and moves
+// the servo there if this task owns it. The servo is only written when the
+// angle changes by a whole degree.
+//******************************************************************************
+void TaskHeading::Aim()
+{
+    auto angle = constrain(Wrap(_target - _heading), -90, 90);
+
+    if (angle == _trackAngle) return;
+
+    _trackAngle = angle;
+
+    if (_isPanning) Sonar::PanSonar(angle);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <RTL_TaskManager.h>
+#include "Scheduler.h"
+
+
+//******************************************************************************
+/// <summary>
+/// One gyro reading, shared by the tasks that need the turn rate.
+/// </summary>
+//******************************************************************************
+struct GyroSample
+{
+    float rate;                 // Gyro Z rate (deg/s, positive to the left)
+    uint32_t time;              // micros() when it was read
+    uint16_t count;             // Incremented with each new sample
+};
+
+
+//******************************************************************************
+/// <summary>
+/// Keeps a running heading from the gyro, and optionally counter-rotates the
+/// sonar pan servo so the sonar points in a fixed world direction while the
+/// robot turns.
+/// </summary>
+/// <remarks>
+/// The heading is integrated from the gyro Z rate every 10ms (the same
+/// trapezoidal integration as TaskSpin) while the task runs. It is in degrees,
+/// positive to the left, wrapped to +/-180, and relative to wherever the robot
+/// was pointing when the heading was last zeroed - only changes in heading
+/// are meaningful.
+///
+/// Track() points the sonar at a world direction (a heading). Every run the
+/// servo is moved to (target - heading), so as the chassis rotates the sonar
+/// keeps looking the same way and pings taken during a spin or turn are
+/// still useful. The pan angle is limited to +/-90 degrees. Re-aiming Track()
+/// step by step sweeps world-fixed sectors in the same way. The servo has one
+/// owner at a time: where another task is pinging (TaskScanSonar while
+/// moving) tracking only works out the angle and leaves the servo alone.
+///
+/// This task is also the robot's gyro sampler: the gyro is read once per run
+/// and the reading, with its timestamp, is available from Sample(). Anything
+/// that runs at the same rate (TaskCorrectCourse) uses it rather than reading
+/// the IMU again, which saves an I2C transaction and means every consumer
+/// sees the same measurement at the same time. The runs are phase-locked to
+/// a fixed 10ms tick by the Scheduler; the gyro can't be read from a timer
+/// interrupt because I2C itself needs interrupts.
+/// </remarks>
+//******************************************************************************
+class TaskHeading : public PeriodicTask
+{
+    DECLARE_CLASSNAME;
+    /*--------------------------------------------------------------------------
+    Constructors
+    --------------------------------------------------------------------------*/
+    public: TaskHeading() : PeriodicTask(10, 10) {};
+
+    /*--------------------------------------------------------------------------
+    Base class overrides
+    --------------------------------------------------------------------------*/
+    public: void Poll() override;
+    public: void StateChanging(TaskState newState) override;
+    public: const __FlashStringHelper* Name() override { return _classname_; };
+
+    /*--------------------------------------------------------------------------
+    Public interface
+    --------------------------------------------------------------------------*/
+    public: float Heading() { return _heading; };
+    public: const GyroSample& Sample() { return _sample; };
+    public: int16_t WorldAngle(int16_t relativeAngle) { return Wrap(_heading + relativeAngle); };
+    public: void Track(int16_t worldAngle, bool panServo = true);
+    public: void Untrack();
+    public: bool IsTracking() { return _isTracking; };
+    public: int16_t TrackAngle() { return _trackAngle; };
+    public: static int16_t Wrap(float angle);
+
+    /*--------------------------------------------------------------------------
+    Internal implementation
+    --------------------------------------------------------------------------*/
+    private: void Aim();
+    private: void Read();
+
+    private: float _heading = 0;           // Degrees, +/-180
+    private: GyroSample _sample = { 0, 0, 0 };  // Last gyro reading
+    private: int16_t _target = 0;          // World direction being tracked
+    private: int16_t _trackAngle = 0;      // Current sonar pan angle while tracking
+    private: bool _isTracking = false;
+    private: bool _isPanning = false;      // Tracking moves the servo (see Track())
+};
@@ -5,7 +5,11 @@
 #include <RTL_I2C.h>
 
 #include "Robot_9_Tank.h"
+#include "EventLanes.h"
+#include "Metrics.h"
 #include "Movement.h"
+#include "SensorHub.h"
+#include "Sonar.h"
 #include "States.h"
 #include "Tasks.h"
 
@@ -31,24 +35,108 @@ void TaskIRRemote::StateChanging(TaskState newState)
 }
 
 
-void TaskIRRemote::Poll()
+// I2C bus time taken by one read of the decoder: address byte plus the batch,
+// 9 bits per byte at 100 kHz (10 microseconds per bit)
+constexpr uint16_t READ_BUS_TIME = (1 + sizeof(IRRemoteBatch)) * 9 * 10;
+
+
+void TaskIRRemote::Begin()
 {
-    IRRemoteCommand response;
+    pinMode(IR_READY_PIN, INPUT_PULLUP);    // Decoder only ever pulls the line low
+}
+
 
-    I2c.read(IR_REMOTE_I2C_ADDRESS, response);
+//******************************************************************************
+/// <summary>
+/// Reads the pending commands from the IR remote decoder and processes them.
+/// </summary>
+/// <remarks>
+/// The decoder pulls IR_READY_PIN low while it has commands waiting, so the
+/// decoder is only read when there is something to read. As a fallback (e.g.
+/// an older decoder without the ready line) it is also read every
+/// FALLBACK_INTERVAL. The decoder returns up to IR_REMOTE_MAX_BATCH commands
+/// per I2C transaction; if a batch comes back full there may be more commands
+/// waiting, so the decoder is read again on the next pass.
+/// </remarks>
+//******************************************************************************
+void TaskIRRemote::Poll()
+{
+    auto now = millis();
+    auto isReady = (digitalRead(IR_READY_PIN) == LOW);
+    uint8_t count = 0;
 
-    if (response.Code != IR_NONE)
+    if (isReady || _more || (now - _lastPoll) >= FALLBACK_INTERVAL)
     {
-        _timeout = millis() + 200;
-        lastResponse = response;
-        ProcessCommand(response);
+        IRRemoteBatch batch;
+
+        _lastPoll = now;
+        _windowReads++;
+        count = ReadCommands(batch);
+        _more = (count == IR_REMOTE_MAX_BATCH);
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            auto& command = batch.Commands[i];
+
+            if (command.Code == IR_NONE) continue;
+
+            _timeout = now + 200;
+            lastResponse = command;
+            ProcessCommand(command);
+        }
+
+        if (count > 0)
+        {
+            // Latency from when the decoder decoded the first command until it was acted on
+            _lastLatency = batch.Header.Age + (millis() - now);
+            _maxLatency = max(_maxLatency, _lastLatency);
+        }
     }
-    else if (lastResponse.Code != IR_NONE && millis() >= _timeout)
+
+    if (count == 0 && lastResponse.Code != IR_NONE && now >= _timeout)
     {
         lastResponse.Type = IRRemoteCommandType::End;
         ProcessCommand(lastResponse);
-        lastResponse = response;
+        lastResponse.Code = IR_NONE;
+    }
+
+    UpdateStatistics(now);
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Reads a batch of commands from the decoder and returns the number of commands.
+/// </summary>
+/// <remarks>
+/// An older (v1) decoder returns a single IRRemoteCommand instead of a batch.
+/// It is recognized by the version byte and moved into the first command slot.
+/// </remarks>
+//******************************************************************************
+uint8_t TaskIRRemote::ReadCommands(IRRemoteBatch& batch)
+{
+    I2c.read(IR_REMOTE_I2C_ADDRESS, batch);
+
+    if (IR_REMOTE_PROTOCOL_MAJOR(batch.Header.Version) != IR_REMOTE_PROTOCOL_MAJOR(IR_REMOTE_PROTOCOL_VERSION))
+    {
+        IRRemoteCommand command;
+
+        memcpy(&command, &batch, sizeof(command));
+        batch.Commands[0] = command;
+
+        return (command.Type != IRRemoteCommandType::None) ? 1 : 0;
+    }
+
+    SensorHub::Update(batch.Header.Sensors);
+
+    if (batch.Header.Overflows != _overflows || batch.Header.Dropped != _dropped)
+    {
+        Logger(_classname_) << F("Decoder lost commands, overflows=") << batch.Header.Overflows << F(", dropped=") << batch.Header.Dropped << endl;
+        _overflows = batch.Header.Overflows;
+        _dropped = batch.Header.Dropped;
     }
+
+    return min(batch.Header.Count, uint8_t(IR_REMOTE_MAX_BATCH));
 }
 
 
@@ -68,7 +156,7 @@ void TaskIRRemote::ProcessCommand(IRRemoteCommand& command)
                 }
                 else
                 {
-                    QueueEvent(CMD_MOVE_EVENT);
+                    EventLanes::Queue(*this, CMD_MOVE_EVENT, 0, EventLanes::NORMAL);
                 }
 
                 _isMoving = !_isMoving;
@@ -85,7 +173,7 @@ void TaskIRRemote::ProcessCommand(IRRemoteCommand& command)
             else if (command.Type == IRRemoteCommandType::End)
             {
                 TRACE(Logger(_classname_) << F("Cancelling back up") << endl);
-                QueueEvent(CMD_BACKUP_END_EVENT);
+                EventLanes::Queue(*this, CMD_BACKUP_END_EVENT, 0, EventLanes::NORMAL);
             }
             break;
 
@@ -93,12 +181,12 @@ void TaskIRRemote::ProcessCommand(IRRemoteCommand& command)
             if (command.Type == IRRemoteCommandType::Normal)
             {
                 TRACE(Logger(_classname_) << F("Turning left") << endl);
-                QueueEvent(CMD_TURN_BEGIN_EVENT, 'L');
+                EventLanes::Queue(*this, CMD_TURN_BEGIN_EVENT, 'L', EventLanes::NORMAL);
             }
             else if (command.Type == IRRemoteCommandType::End)
             {
                 TRACE(Logger(_classname_) << F("Cancelling left turn") << endl);
-                QueueEvent(CMD_TURN_END_EVENT);
+                EventLanes::Queue(*this, CMD_TURN_END_EVENT, 0, EventLanes::NORMAL);
             }
             break;
 
@@ -106,12 +194,12 @@ void TaskIRRemote::ProcessCommand(IRRemoteCommand& command)
             if (command.Type == IRRemoteCommandType::Normal)
             {
                 TRACE(Logger(_classname_) << F("Turning right") << endl);
-                QueueEvent(CMD_TURN_BEGIN_EVENT, 'R');
+                EventLanes::Queue(*this, CMD_TURN_BEGIN_EVENT, 'R', EventLanes::NORMAL);
             }
             else if (command.Type == IRRemoteCommandType::End)
             {
                 TRACE(Logger(_classname_) << F("Cancelling right turn") << endl);
-                QueueEvent(CMD_TURN_END_EVENT);
+                EventLanes::Queue(*this, CMD_TURN_END_EVENT, 0, EventLanes::NORMAL);
             }
             break;
 
@@ -124,6 +212,26 @@ void TaskIRRemote::ProcessCommand(IRRemoteCommand& command)
         case IR_VOL_EQ:       // TODO: Resume normal forward speed
             break;
 
+        case IR_0:            // Report and reset the performance counters (start a new run)
+            if (command.Type == IRRemoteCommandType::Normal)
+            {
+                Metrics::Report();
+                Metrics::Reset();
+            }
+            break;
+
+        case IR_5:            // Calibrate the sonar pan servo (only when stopped)
+            if (command.Type == IRRemoteCommandType::Normal && !_isMoving) Sonar::CalibrateServo();
+            break;
+
+        case IR_7:            // Auto-tune the course correction gains (only when stopped)
+            if (command.Type == IRRemoteCommandType::Normal && !_isMoving) correctCourseTask.Autotune();
+            break;
+
+        case IR_8:            // Report IR remote link statistics
+            if (command.Type == IRRemoteCommandType::Normal) Report();
+            break;
+
         case IR_9:            // Enable/Disable motors
             if (command.Type == IRRemoteCommandType::Normal) Movement::EnableMotors(!Movement::IsMotorsEnabled());
             Logger(_classname_) << F("Motors enabled=") << Movement::IsMotorsEnabled() << endl;
@@ -134,3 +242,27 @@ void TaskIRRemote::ProcessCommand(IRRemoteCommand& command)
     }
 }
 
+
+//******************************************************************************
+/// <summary>
+/// Computes the I2C bus time saved over each one second window compared to
+/// reading the decoder every POLL_INTERVAL.
+/// </summary>
+//******************************************************************************
+void TaskIRRemote::UpdateStatistics(uint32_t now)
+{
+    if ((now - _windowStart) < 1000) return;
+
+    const uint8_t fixedReads = 1000 / POLL_INTERVAL;
+
+    _busTimeSaved = (_windowReads < fixedReads) ? (fixedReads - _windowReads) * READ_BUS_TIME : 0;
+    _windowReads = 0;
+    _windowStart = now;
+}
+
+
+void TaskIRRemote::Report()
+{
+    Logger(_classname_) << F("I2C bus time saved=") << _busTimeSaved << F("us/s, latency=") << _lastLatency
+                        << F("ms, max=") << _maxLatency << F("ms, overflows=") << _overflows << F(", dropped=") << _dropped << endl;
+}
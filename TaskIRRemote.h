@@ -33,13 +33,29 @@ class TaskIRRemote : public TaskBase, // ATask,
     /*--------------------------------------------------------------------------
     Public interface
     --------------------------------------------------------------------------*/
+    public: void Begin();
+    public: void Report();
 
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
+    private: static const uint16_t POLL_INTERVAL = 50;         // Fixed poll rate the ready line replaces (ms)
+    private: static const uint16_t FALLBACK_INTERVAL = 1000;   // Read at least this often (ms) in case the ready line is missed
+
+    private: uint8_t ReadCommands(IRRemoteBatch& batch);
+    private: void UpdateStatistics(uint32_t now);
     private: void ProcessCommand(IRRemoteCommand & command);
 
     private: bool _isMoving = false;
+    private: bool _more = false;            // Last batch was full, so read again right away
+    private: uint32_t _lastPoll = 0;
     private: uint32_t _timeout = 0;
+    private: uint8_t _overflows = 0;        // Decoder overflow count from the last batch
+    private: uint8_t _dropped = 0;          // Decoder dropped count from the last batch
+    private: uint32_t _windowStart = 0;     // Start of the current statistics window
+    private: uint8_t _windowReads = 0;      // Decoder reads in the current window
+    private: uint16_t _busTimeSaved = 0;    // I2C bus time saved over the last window (microseconds)
+    private: uint16_t _lastLatency = 0;     // Decode to action time for the last command (ms)
+    private: uint16_t _maxLatency = 0;      // Worst decode to action time seen (ms)
     private: IRRemoteCommand lastResponse;
 };
@@ -2,9 +2,12 @@
 
 #include <Arduino.h>
 
-#include <RTL_IRProximitySensor.h>
-
 #include "Robot_9_Tank.h"
+#include "EventLanes.h"
+#include "Metrics.h"
+#include "ProximitySampler.h"
+#include "Safety.h"
+#include "SensorHub.h"
 #include "States.h"
 #include "Tasks.h"
 
@@ -12,10 +15,21 @@
 DEFINE_CLASSNAME(TaskNearObstacleDetection);
 
 
-IRProximitySensor proxRight(5);     // Right IR Proximity sensor on pin 5 (for obstacle detection on the right side)
-IRProximitySensor proxFront(6);     // Front IR Proximity sensor on pin 6 (for obstacle detection ahead)
-IRProximitySensor proxLeft(8);      // Left IR Proximity sensor on pin 7 (for obstacle detection on the left side)
-                                    // NOTE: Must use pin 8 instead of pin 7 as the BNO055 IMU reserves pin 7
+// IR proximity sensor pins, in SENSOR_xxx bit order:
+//   Right IR Proximity sensor on pin 5 (for obstacle detection on the right side)
+//   Front IR Proximity sensor on pin 6 (for obstacle detection ahead)
+//   Left IR Proximity sensor on pin 8 (for obstacle detection on the left side)
+//   NOTE: Must use pin 8 instead of pin 7 as the BNO055 IMU reserves pin 7
+static const uint8_t PROXIMITY_PINS[] = { 5, 6, 8 };
+
+// Samples in a row (one per poll) a sensor must agree before its state changes
+constexpr uint8_t DEBOUNCE_SAMPLES = 3;
+
+ProximitySampler proxSensors(PROXIMITY_PINS, sizeof(PROXIMITY_PINS), DEBOUNCE_SAMPLES);
+
+static_assert(TaskNearObstacleDetection::SENSOR_RIGHT == HUB_PROX_RIGHT &&
+              TaskNearObstacleDetection::SENSOR_FRONT == HUB_PROX_FRONT &&
+              TaskNearObstacleDetection::SENSOR_LEFT == HUB_PROX_LEFT, "Sensor bits must match the sensor hub bits");
 
 
 void TaskNearObstacleDetection::StateChanging(TaskState newState)
@@ -24,7 +38,10 @@ void TaskNearObstacleDetection::StateChanging(TaskState newState)
     {
         case TaskState::Resuming:
             TRACE(Logger(_classname_) << F("Resuming") << endl);
-            _triggered = false;
+
+            // Start from clear so an obstacle that is already there is reported
+            proxSensors.Reset();
+            _lastEvent = OBSTACLE_NONE_EVENT;
             break;
 
         case Suspending:
@@ -39,39 +56,48 @@ void TaskNearObstacleDetection::StateChanging(TaskState newState)
 
 void TaskNearObstacleDetection::Poll()
 {
-    auto rightTriggered = proxRight.ReadImmediate();
-    auto frontTriggered = proxFront.ReadImmediate();
-    auto leftTriggered = proxLeft.ReadImmediate();
+    // Use the sensor hub's (already debounced) sensor bits if it has them
+    uint8_t sensors = SensorHub::HasSensors() ? SensorHub::Sensors() & (SENSOR_RIGHT | SENSOR_FRONT | SENSOR_LEFT)
+                                              : proxSensors.Sample();
+    auto reflex = (Safety::Faults() & Safety::FRONT_FAULT) != 0;
 
-    if (frontTriggered)
-    {
-        Logger(_classname_) << F("Front IR sensor triggered") << endl;
-        _triggered = true;
-        QueueEvent(OBSTACLE_FRONT_EVENT);
-    }
-    else if (rightTriggered && leftTriggered)
-    {
-        Logger(_classname_) << F("Both left and right IR sensors triggered.") << endl;
-        _triggered = true;
-        QueueEvent(OBSTACLE_BLOCKED_EVENT);
-    }
-    else if (rightTriggered)
-    {
-        Logger(_classname_) << F("Right IR sensors triggered.") << endl;
-        _triggered = true;
-        QueueEvent(OBSTACLE_RIGHT_EVENT);
-    }
-    else if (leftTriggered)
-    {
-        Logger(_classname_) << F("Left IR sensors triggered.") << endl;
-        _triggered = true;
-        QueueEvent(OBSTACLE_LEFT_EVENT);
-    }
-    else if (_triggered)
-    {
-        Logger(_classname_) << F("Obstacle no longer detected.") << endl;
-        _triggered = false;
-        QueueEvent(OBSTACLE_NONE_EVENT);
-    }
+    // The safety reflex has already stopped the motors for an obstacle ahead,
+    // so report it right away - once for each time the fault is latched, even
+    // if the front sensor had already been reported, until Safety clears it.
+    if (!reflex) _reflexReported = false;
+
+    if (reflex) sensors |= SENSOR_FRONT;
+
+    auto event = Classify(sensors);
+
+    if (event == _lastEvent && (!reflex || _reflexReported)) return;
+
+    TRACE(Logger(_classname_) << F("sensors=0x") << _HEX(sensors) << F(", event=0x") << _HEX(event) << endl);
+
+    if (event != _lastEvent && event != OBSTACLE_NONE_EVENT) Metrics::Obstacle(Metrics::IR_PROXIMITY);
+
+    _lastEvent = event;
+
+    // Tried again on the next poll if the queue had no room
+    if (EventLanes::Queue(*this, event, variant_t(unsigned(sensors)), EventLanes::NORMAL, true) && reflex) _reflexReported = true;
 }
 
+
+//******************************************************************************
+/// <summary>
+/// Maps the sensor bits to the event that describes them. The front sensor has
+/// priority, then both sides together.
+/// </summary>
+//******************************************************************************
+uint16_t TaskNearObstacleDetection::Classify(uint8_t sensors)
+{
+    if (sensors & SENSOR_FRONT) return OBSTACLE_FRONT_EVENT;
+
+    if ((sensors & (SENSOR_LEFT | SENSOR_RIGHT)) == (SENSOR_LEFT | SENSOR_RIGHT)) return OBSTACLE_BLOCKED_EVENT;
+
+    if (sensors & SENSOR_RIGHT) return OBSTACLE_RIGHT_EVENT;
+
+    if (sensors & SENSOR_LEFT) return OBSTACLE_LEFT_EVENT;
+
+    return OBSTACLE_NONE_EVENT;
+}
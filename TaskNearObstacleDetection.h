@@ -1,9 +1,20 @@
 #pragma once
 
 #include <RTL_TaskManager.h>
-
-
-class TaskNearObstacleDetection : public TaskBase,
+#include "Scheduler.h"
+
+
+//******************************************************************************
+/// <summary>
+/// Watches the IR proximity sensors and reports obstacles close to the robot.
+/// </summary>
+/// <remarks>
+/// An event is only sent when the situation changes (e.g. from clear to an
+/// obstacle on the left), not on every poll while a sensor stays triggered.
+/// The event data holds the debounced sensor bits (SENSOR_xxx).
+/// </remarks>
+//******************************************************************************
+class TaskNearObstacleDetection : public PeriodicTask,
                                   public EventSource
 {
     DECLARE_CLASSNAME;
@@ -17,10 +28,17 @@ class TaskNearObstacleDetection : public TaskBase,
     public: static const uint16_t OBSTACLE_BLOCKED_EVENT = EventSourceID::IRProximity | 0x0003;
     public: static const uint16_t OBSTACLE_FRONT_EVENT   = EventSourceID::IRProximity | 0x0004;
 
+    /*--------------------------------------------------------------------------
+    Sensor bits in the event data (Data.UInt)
+    --------------------------------------------------------------------------*/
+    public: static const uint8_t SENSOR_RIGHT = 0x01;
+    public: static const uint8_t SENSOR_FRONT = 0x02;
+    public: static const uint8_t SENSOR_LEFT  = 0x04;
+
     /*--------------------------------------------------------------------------
     Constructors
     --------------------------------------------------------------------------*/
-    public: TaskNearObstacleDetection() {};
+    public: TaskNearObstacleDetection() : PeriodicTask(20) {};
 
     /*--------------------------------------------------------------------------
     Base class overrides
@@ -36,5 +54,8 @@ class TaskNearObstacleDetection : public TaskBase,
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
-    private: bool _triggered = false;
+    private: static uint16_t Classify(uint8_t sensors);
+
+    private: uint16_t _lastEvent = OBSTACLE_NONE_EVENT;  // Last event sent
+    private: bool _reflexReported = false;              // Reflex event sent for the latched FRONT_FAULT
 };
@@ -4,14 +4,44 @@
 
 #include <SonarSensor.h>
 
+#include "IMU.h"
 #include "Sonar.h"
+#include "EventLanes.h"
+#include "Metrics.h"
+#include "Movement.h"
+#include "ScanLog.h"
 #include "States.h"
 #include "Tasks.h"
 
 
+// Ping-ahead also reacts to the time to collision, so the faster the robot is
+// closing the further out it reacts. Set to false to go back to the fixed
+// distance thresholds only (and 3 pings in a row to detect).
+constexpr auto TTC_EVENTS = true;
+
+constexpr float TRACK_ALPHA = 0.3;          // Range tracker gains (see Tools/ApproachSim.cpp)
+constexpr float TRACK_BETA = 0.02;
+constexpr float TTC_DANGER = 1.0;           // Seconds
+constexpr float TTC_DETECT = 2.5;
+constexpr float TTC_CLEAR = 3.5;            // Must be above this (and outside the range below) to clear
+constexpr uint16_t CLEAR_RANGE = Sonar::THRESHOLD2 + 10;
+constexpr uint8_t DETECT_COUNT = TTC_EVENTS ? 1 : 3;    // The median already needs 2 of 3 pings inside
+constexpr uint8_t CLEAR_COUNT = 3;
+
+// Speed governor - the speed is scaled to keep the time to collision at
+// GOVERNOR_TTC, and may only rise by GOVERNOR_RAMP per ping (100/s)
+constexpr float GOVERNOR_TTC = 4.0;
+constexpr int GOVERNOR_RAMP = 2;
+
+
 DEFINE_CLASSNAME(TaskScanSonar);
 
 
+TaskScanSonar::TaskScanSonar() : PeriodicTask(20), _tracker(TRACK_ALPHA, TRACK_BETA)
+{
+}
+
+
 void TaskScanSonar::StateChanging(TaskState newState)
 {
     switch (newState)
@@ -45,19 +75,72 @@ void TaskScanSonar::Poll()
 }
 
 
+//******************************************************************************
+/// <summary>
+/// Pings straight ahead and updates the obstacle state from the range.
+/// </summary>
+/// <remarks>
+/// While a world direction is being tracked during a turn (see TaskHeading),
+/// one ping after every LOOK_INTERVAL pings ahead is a look in that direction
+/// instead. This task owns the servo throughout - the heading task only works
+/// out the angle - so the servo swings out for a look and straight back,
+/// rather than being pulled both ways on every run. Looks only update
+/// LookBlocked(); the obstacle state, the median and the range tracker only
+/// ever see pings along the chassis, which is where the robot is actually
+/// going.
+/// </remarks>
+//******************************************************************************
 void TaskScanSonar::PingAheadMode()
 {
+    if (!headingTask.IsTracking())
+    {
+        _lookBlocked = false;
+        _lookCount = 0;
+    }
+    else if (_lookCount >= LOOK_INTERVAL)
+    {
+        LookAhead();
+        return;
+    }
+
+    Sonar::PanSonar(0);
+
     if (!Sonar::Ready()) return;
 
-    auto ping = Sonar::MultiPingAt(0);
+    auto ping = Sonar::PingAt(0, Sonar::PING_AHEAD_RANGE);
+
+    if (headingTask.IsTracking()) _lookCount++;
 
     TRACE(Logger(_classname_, F("PingAheadMode")) << F(", ping=") << ping << endl);
 
     if (ping == PING_FAILED)
     {
         TRACE(Logger(_classname_, F("PingAheadMode")) << F("PING_FAILED") << endl);
+        return;
     }
-    else if (ping <= Sonar::THRESHOLD1)
+
+    ping = _aheadMedian(ping);
+
+    // Track the range for the closing speed
+    auto now = millis();
+    auto dt = (now - _aheadTime) / 1000.0f;
+
+    _aheadTime = now;
+
+    if (ping == Sonar::BEYOND_RANGE)
+        _tracker.Miss(dt);
+    else
+        _tracker.Update(ping, dt);
+
+    auto ttc = TTC_EVENTS ? _tracker.TimeToCollision() : RangeTracker::NO_COLLISION;
+
+    TRACE(Logger(_classname_, F("PingAheadMode")) << F("range=") << _FLOAT(_tracker.Range(), 1)
+                                                  << F(", rate=") << _FLOAT(_tracker.Rate(), 1)
+                                                  << F(", ttc=") << _FLOAT(ttc, 2) << endl);
+
+    Govern();
+
+    if (ping <= Sonar::THRESHOLD1 || ttc <= TTC_DANGER)
     {
         // Danger zone - an obstacle has been detected that is too close
         _clearCount = 0;
@@ -70,14 +153,14 @@ void TaskScanSonar::PingAheadMode()
             SendNotification(OBSTACLE_DANGER_EVENT, ping, 0);
         }
     }
-    else if (ping <= Sonar::THRESHOLD2)
+    else if (ping <= Sonar::THRESHOLD2 || ttc <= TTC_DETECT)
     {
         // Detection zone - an obstacle has been detected
         _clearCount = 0;
 
         if (_state != OBSTACLE_DETECTED_STATE)
         {
-            if (++_detectCount >= 3)
+            if (++_detectCount >= DETECT_COUNT)
             {
                 TRACE(Logger(_classname_, F("PingAheadMode")) << F("OBSTACLE_DETECTED_STATE") << endl);
                 _state = OBSTACLE_DETECTED_STATE;
@@ -85,13 +168,14 @@ void TaskScanSonar::PingAheadMode()
             }
         }
     }
-    else    // No obstacle detected in range
+    else if (ping > CLEAR_RANGE && ttc > TTC_CLEAR)
     {
+        // No obstacle detected in range (includes BEYOND_RANGE)
         _detectCount = 0;
 
         if (_state != OBSTACLE_NONE_STATE)
         {
-            if (++_clearCount >= 3)
+            if (++_clearCount >= CLEAR_COUNT)
             {
                 TRACE(Logger(_classname_, F("PingAheadMode")) << F("OBSTACLE_NONE_STATE") << endl);
                 _state = OBSTACLE_NONE_STATE;
@@ -99,17 +183,117 @@ void TaskScanSonar::PingAheadMode()
             }
         }
     }
+    else
+    {
+        // Between the detect and clear thresholds - stay in the current state
+        _detectCount = 0;
+        _clearCount = 0;
+    }
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Pans to the tracked direction (TaskHeading::TrackAngle()), pings it, and
+/// remembers whether it is blocked. The only place the servo leaves 0 in
+/// ping-ahead mode.
+/// </summary>
+//******************************************************************************
+void TaskScanSonar::LookAhead()
+{
+    auto angle = headingTask.TrackAngle();
+
+    Sonar::PanSonar(angle);
+
+    if (!Sonar::Ready()) return;
+
+    auto ping = Sonar::PingAt(angle, Sonar::PING_AHEAD_RANGE);
+
+    if (ping == PING_FAILED) return;
+
+    TRACE(Logger(_classname_, F("LookAhead")) << F("angle=") << angle << F(", ping=") << ping << endl);
+
+    _lookBlocked = (ping <= Sonar::THRESHOLD2);
+    _lookCount = 0;
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Updates the governed speed from the time to collision. The speed is scaled
+/// by ttc / GOVERNOR_TTC, so at a steady speed it settles where the time to
+/// collision is GOVERNOR_TTC, and goes back up to FAST_SPEED (gradually)
+/// when nothing is being tracked.
+/// </summary>
+//******************************************************************************
+void TaskScanSonar::Govern()
+{
+    auto speed = Movement::Speed();
+    auto target = _tracker.IsValid() ? int(speed * min(_tracker.TimeToCollision(), 2 * GOVERNOR_TTC) / GOVERNOR_TTC)
+                                     : Movement::FAST_SPEED;
+
+    _governedSpeed = constrain(min(target, speed + GOVERNOR_RAMP), Movement::SLOW_SPEED, Movement::FAST_SPEED);
 }
 
 
 void TaskScanSonar::ScanMode()
 {
+    // Take the sectors that are still fresh from the cache, without moving the servo
+    auto now = millis();
+
+    while (abs(_scanAngle) <= SCAN_STOP_ANGLE && SectorFresh(Sector(_scanAngle), now))
+    {
+        auto sector = Sector(_scanAngle);
+
+        _cacheHits++;
+        ScanLog::Add(_scanAngle, _sectorPing[sector], uint16_t(uint16_t(now / 16) - _sectorTime[sector]) * 16);
+        RecordPing(_sectorPing[sector]);
+        _scanAngle += SCAN_INCREMENT;
+    }
+
+    if (abs(_scanAngle) > SCAN_STOP_ANGLE)
+    {
+        ScanComplete();
+        return;
+    }
+
+    // Aim first, so the servo moves while the sensor gets ready
+    Sonar::PanSonar(_scanAngle);
+
     if (!Sonar::Ready()) return;
 
-    auto ping = Sonar::PingAt(_scanAngle);
+    auto ping = Sonar::PingAt(_scanAngle, Sonar::SCAN_RANGE);
 
     if (ping == PING_FAILED) return;
 
+    if (ping == Sonar::BEYOND_RANGE) ping = Sonar::SCAN_RANGE;
+
+    auto sector = Sector(_scanAngle);
+
+    _cacheMisses++;
+    _sectorPing[sector] = ping;
+    _sectorTime[sector] = millis() / 16;
+    _cachedSectors |= (1 << sector);
+
+    ScanLog::Add(_scanAngle, ping);
+    RecordPing(ping);
+
+    // Set up for next scan
+    _scanAngle += SCAN_INCREMENT;
+
+    // We are done when the scan angle exceeds scan stop angle
+    if (abs(_scanAngle) > SCAN_STOP_ANGLE) ScanComplete();
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Adds the ping for the current scan angle to the left or right area and
+/// best ping.
+/// </summary>
+//******************************************************************************
+void TaskScanSonar::RecordPing(uint16_t ping)
+{
     // Sum areas to left and right (Ignore scan angle == 0)
     if (_scanAngle > 0)
     {
@@ -137,17 +321,53 @@ void TaskScanSonar::ScanMode()
             _rightBestAngle = _scanAngle;
         }
     }
+}
 
-    // Set up for next scan
-    _scanAngle += SCAN_INCREMENT;
 
-    // We are done when the scan angle exceeds scan stop angle
-    if (abs(_scanAngle) > SCAN_STOP_ANGLE)
+void TaskScanSonar::ScanComplete()
+{
+    _scanTime += millis() - _scanStart;
+
+    TRACE(Logger(_classname_, F("ScanComplete")) << F("leftArea=") << _leftArea << F(", rightArea=") << _rightArea << endl);
+    EventLanes::Queue(*this, SCAN_COMPLETE_EVENT, variant_t(_leftArea, _rightArea), EventLanes::NORMAL);
+    SwitchToPingAheadMode();    // Automatically switch back to ping-ahead mode 
+}
+
+
+//******************************************************************************
+/// <summary>
+/// Checks if the cached scan still describes what is around the robot: the
+/// robot must not have turned or moved much since the cached scan started.
+/// If it has, the cache is cleared and a new one is started.
+/// </summary>
+//******************************************************************************
+bool TaskScanSonar::CacheUsable()
+{
+    if (!imu.IsActive())
     {
-        TRACE(Logger(_classname_, F("ScanMode")) << F("ScanComplete, lefArea=") << _leftArea << F(", rightArea=") << _rightArea << endl);
-        QueueEvent(SCAN_COMPLETE_EVENT, variant_t(_leftArea, _rightArea));
-        SwitchToPingAheadMode();    // Automatically switch back to ping-ahead mode 
+        _cachedSectors = 0;     // Can't tell if the robot has turned
+        return false;
     }
+
+    auto heading = int16_t(imu.GetCompassHeading());
+    auto distance = Metrics::Distance();
+    auto turn = ((heading - _cacheHeading + 540) % 360) - 180;
+
+    if (_cachedSectors != 0 && abs(turn) <= CACHE_MAX_TURN && fabs(distance - _cacheDistance) <= CACHE_MAX_TRAVEL) return true;
+
+    _cachedSectors = 0;
+    _cacheHeading = heading;
+    _cacheDistance = distance;
+
+    return false;
+}
+
+
+bool TaskScanSonar::SectorFresh(uint8_t sector, uint32_t now)
+{
+    if ((_cachedSectors & (1 << sector)) == 0) return false;
+
+    return uint16_t(uint16_t(now / 16) - _sectorTime[sector]) < (CACHE_TTL / 16);
 }
 
 
@@ -161,6 +381,13 @@ void TaskScanSonar::SwitchToScanMode()
     _rightBestPing = 0;
     _rightBestAngle = -90;
     _scanAngle = SCAN_START_ANGLE;
+    _scanStart = millis();
+    headingTask.Untrack();     // Scans are relative to the robot
+    ScanLog::Begin(Telemetry::SCAN_SONAR_TASK);
+
+    // Only the sectors that went stale are pinged again
+    if (CacheUsable() && SectorFresh(Sector(_scanAngle), _scanStart)) return;
+
     Sonar::PanSonar(_scanAngle);
 }
 
@@ -173,13 +400,37 @@ void TaskScanSonar::SwitchToPingAheadMode()
     _detectCount = 0;
     _mode = MODE_PING_AHEAD;
     _state = OBSTACLE_NONE_STATE;
-    Sonar::PanSonar(0);
+    _aheadMedian.Reset();
+    _tracker.Reset();
+    _aheadTime = millis();
+    _governedSpeed = Movement::Speed();
+
+    if (!headingTask.IsTracking()) Sonar::PanSonar(0);
+}
+
+
+void TaskScanSonar::Report()
+{
+    auto minutes = millis() / 60000.0F;
+    auto lookups = uint32_t(_cacheHits) + _cacheMisses;
+
+    Logger(_classname_) << F("Scan cache hits=") << _cacheHits << F(", misses=") << _cacheMisses
+                        << F(", hit ratio=") << _FLOAT(lookups > 0 ? 100.0F * _cacheHits / lookups : 0, 1)
+                        << F("%, scanning=") << _FLOAT(minutes > 0 ? _scanTime / 1000.0F / minutes : 0, 1)
+                        << F("s/min") << endl;
 }
 
 
 void TaskScanSonar::SendNotification(uint16_t event, const uint16_t ping, const int16_t scanAngle)
 {
     TRACE(Logger(_classname_, F("SendNotification")) << F("event=0x") << _HEX(event) << endl);
-    QueueEvent(event, variant_t(ping, scanAngle));
+
+    if (event == OBSTACLE_DANGER_EVENT) Metrics::Obstacle(Metrics::SONAR_DANGER);
+    if (event == OBSTACLE_DETECTED_EVENT) Metrics::Obstacle(Metrics::SONAR_DETECTED);
+
+    // An obstacle in the danger zone must not wait behind other events
+    auto lane = (event == OBSTACLE_DANGER_EVENT) ? EventLanes::URGENT : EventLanes::NORMAL;
+
+    EventLanes::Queue(*this, event, variant_t(ping, scanAngle), lane);
 }
 
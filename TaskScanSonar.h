@@ -1,9 +1,31 @@
 #pragma once
 
 #include <RTL_TaskManager.h>
+#include "Filters.h"
+#include "RangeTracker.h"
+#include "Scheduler.h"
 
 
-class TaskScanSonar : public TaskBase,
+//******************************************************************************
+/// <summary>
+/// Watches the path ahead with the sonar (ping-ahead mode), and scans from
+/// side to side for a new direction when asked (scan mode).
+/// </summary>
+/// <remarks>
+/// In ping-ahead mode the range to the obstacle ahead is tracked (see
+/// RangeTracker) to get the closing speed, and from that the time to
+/// collision (TTC). The obstacle events fire on whichever comes first, the
+/// fixed distance thresholds or the TTC thresholds, so the robot reacts
+/// sooner the faster it is closing. The path is only clear again once both
+/// are past their thresholds by a margin (hysteresis), for several pings.
+///
+/// GovernedSpeed() is the speed that keeps the time to collision at about
+/// GOVERNOR_TTC: FAST_SPEED in open space, falling smoothly toward
+/// SLOW_SPEED as an obstacle gets closer. StateMoving follows it while the
+/// path is clear.
+/// </remarks>
+//******************************************************************************
+class TaskScanSonar : public PeriodicTask,
                       public EventSource
 {
     DECLARE_CLASSNAME;
@@ -35,11 +57,22 @@ class TaskScanSonar : public TaskBase,
     public: static constexpr int SCAN_INCREMENT   = 15 * SCAN_DIRECTION;    // Angle increment (degrees) between scan positions    
     public: static constexpr int SCAN_START_ANGLE = 90 * (-SCAN_DIRECTION);
     public: static constexpr int SCAN_STOP_ANGLE  = abs(SCAN_START_ANGLE);
+    public: static constexpr int SCAN_SECTORS     = 2 * SCAN_STOP_ANGLE / abs(SCAN_INCREMENT) + 1;
+
+    // A cached scan result is reused while the robot has not turned or moved
+    // much since the scan, and the sector is not too old
+    public: static constexpr uint16_t CACHE_TTL          = 2000;    // Sector time-to-live (ms)
+    public: static constexpr int16_t  CACHE_MAX_TURN     = 10;      // Heading change that invalidates the cache (degrees)
+    public: static constexpr int16_t  CACHE_MAX_TRAVEL   = 10;      // Distance moved that invalidates the cache (cm)
+
+    // While the sonar is held on a world direction (a turn), it looks that way
+    // once after every this many pings straight ahead
+    public: static constexpr uint8_t LOOK_INTERVAL = 3;
 
     /*--------------------------------------------------------------------------
     Constructors
     --------------------------------------------------------------------------*/
-    public: TaskScanSonar() {};
+    public: TaskScanSonar();
 
     /*--------------------------------------------------------------------------
     Base class overrides
@@ -59,13 +92,26 @@ class TaskScanSonar : public TaskBase,
     public: int RightArea() { return _rightArea; };
     public: int RightPing() { return _rightBestPing; };
     public: int RightAngle() { return _rightBestAngle; };
+    public: void InvalidateCache() { _cachedSectors = 0; };
+    public: bool IsPathClear() { return _mode == MODE_PING_AHEAD && _state == OBSTACLE_NONE_STATE; };
+    public: int GovernedSpeed() { return _governedSpeed; };
+    public: float TimeToCollision() { return _tracker.TimeToCollision(); };
+    public: bool LookBlocked() { return _lookBlocked; };
+    public: void Report();
 
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
     private: void PingAheadMode();
     private: void ScanMode();
+    private: void LookAhead();
+    private: void Govern();
     private: void SendNotification(uint16_t event, const uint16_t ping, const int16_t scanAngle);
+    private: void RecordPing(uint16_t ping);
+    private: bool CacheUsable();
+    private: bool SectorFresh(uint8_t sector, uint32_t now);
+    private: static uint8_t Sector(int16_t angle) { return (angle + SCAN_STOP_ANGLE) / abs(SCAN_INCREMENT); };
+    private: void ScanComplete();
 
     private: static const int8_t MODE_PING_AHEAD = 1;
     private: static const int8_t MODE_SCAN = 2;
@@ -81,4 +127,31 @@ class TaskScanSonar : public TaskBase,
     private: uint8_t  _state = OBSTACLE_NONE_EVENT;
     private: uint8_t  _clearCount = 0;
     private: uint8_t  _detectCount = 0;
+
+    // Ping-ahead pings are gated singles; a running median of the last three
+    // does what MultiPing used to without blocking for three pings in a row
+    private: Filters::Median<uint16_t, 3> _aheadMedian;
+
+    // Forward range tracking, for the time to collision and the speed governor
+    private: RangeTracker _tracker;
+    private: uint32_t _aheadTime;          // millis() of the last ping-ahead reading
+    private: int _governedSpeed = 0;
+
+    // Looks in the held direction during a turn (kept out of the obstacle state)
+    private: uint8_t _lookCount = 0;       // Pings straight ahead since the last look
+    private: bool _lookBlocked = false;    // The last look was inside THRESHOLD2
+
+    // Scan cache - the ping for each sector and when it was taken (millis() / 16),
+    // and the heading and distance traveled when the cached scan was started
+    private: uint16_t _sectorPing[SCAN_SECTORS];
+    private: uint16_t _sectorTime[SCAN_SECTORS];
+    private: uint16_t _cachedSectors = 0;  // Bit n set if sector n has a cached ping
+    private: int16_t  _cacheHeading;
+    private: float    _cacheDistance;
+
+    // Cache statistics
+    private: uint16_t _cacheHits = 0;      // Sectors served from the cache
+    private: uint16_t _cacheMisses = 0;    // Sectors that had to be pinged
+    private: uint32_t _scanStart;          // millis() when the current scan started
+    private: uint32_t _scanTime = 0;       // Total time spent scanning (ms)
 };
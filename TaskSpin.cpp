@@ -3,8 +3,10 @@
 #include <Arduino.h>
 #include <RTL_Stdlib.h>
 
+#include "EventLanes.h"
 #include "IMU.h"
 #include "Movement.h"
+#include "Telemetry.h"
 #include "States.h"
 #include "Tasks.h"
 
@@ -43,18 +45,16 @@ void TaskSpin::Poll()
     // Check timeout
     if (millis() > _timeout)
     {
-        QueueEvent(SPIN_ABORT_EVENT);
+        EventLanes::Queue(*this, SPIN_ABORT_EVENT, 0, EventLanes::NORMAL, true);   // Repeats until handled
         return;
     }
 
     // Get current time (in microseconds) and compute delta-T since last check
     // Use UDIFF to compute difference of unsigned numbers (handles 32-bit wrap-around)
+    // The scheduler runs us every 10ms, which ensures we have an updated measurement
     auto t1 = micros();
     auto deltaT = udiff(t1, _t0);
 
-    // Need at least 10ms between measurements to ensure we have an updated measurement
-    if (deltaT < 10000) return;
-
     // Get new gyro measurement and compute time since last measurement (in seconds)
     auto w1 = imu.GetGyroRateZ();
     auto dt = deltaT / 1000000.0f;
@@ -62,7 +62,16 @@ void TaskSpin::Poll()
     // Update turn angle using trapezoidal integration
     _currentAngle += (_w0 + ((w1 - _w0) / 2.0)) * dt;
 
-    TRACE(Logger(F("TaskSpin::Poll")) << _FLOAT(dt, 6) << ',' << _FLOAT(_w0, 3) << ',' << _FLOAT(w1, 3) << ',' << _FLOAT(_currentAngle, 3) << endl);
+    if (Telemetry::enabled)
+    {
+        Telemetry::SpinRecord record;
+
+        record.dt = deltaT;
+        record.w0 = Telemetry::Fixed(_w0);
+        record.w1 = Telemetry::Fixed(w1);
+        record.angle = Telemetry::Fixed(_currentAngle);
+        Telemetry::Send(record);
+    }
 
     // Update starting values for next iteration
     _w0 = w1;
@@ -85,6 +94,7 @@ void TaskSpin::Start(int16_t spinAngle)
         _timeout = millis() + FULL_SPIN_TIME;
         Movement::Spin(direction);
         Resume();
+        Restart();
     }
     else
     {
@@ -99,5 +109,5 @@ void TaskSpin::Complete()
     Suspend();
     _currentAngle = 0;
     _targetAngle = 0;
-    QueueEvent(SPIN_COMPLETE_EVENT);
+    EventLanes::Queue(*this, SPIN_COMPLETE_EVENT, 0, EventLanes::NORMAL);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <RTL_TaskManager.h>
+#include "Scheduler.h"
 
 
 //******************************************************************************
@@ -49,7 +50,7 @@
 /// NOTE: All calculations are in radians!
 /// <remarks>
 //******************************************************************************
-class TaskSpin : public TaskBase,
+class TaskSpin : public PeriodicTask,
                  public EventSource
 {
     DECLARE_CLASSNAME;
@@ -62,7 +63,7 @@ class TaskSpin : public TaskBase,
     /*--------------------------------------------------------------------------
     Constructors
     --------------------------------------------------------------------------*/
-    public: TaskSpin() {};
+    public: TaskSpin() : PeriodicTask(10, 10) {};
 
     /*--------------------------------------------------------------------------
     Base class overrides
@@ -5,6 +5,10 @@
 #include <RTL_IRProximitySensor.h>
 
 #include "Movement.h"
+#include "Safety.h"
+#include "SensorHub.h"
+#include "EventLanes.h"
+#include "Metrics.h"
 #include "States.h"
 #include "Tasks.h"
 
@@ -36,13 +40,21 @@ void TaskStepDetection::StateChanging(TaskState newState)
 
 void TaskStepDetection::Poll()
 {
-    // Check if sensor triggered (triggered if sensor returns 0 (false))
-    auto stepDetected = !proxStep.Read();
+    // Check if sensor triggered (triggered if sensor returns 0 (false)), or use
+    // the sensor hub's debounced step bit if it has one
+    auto stepDetected = SensorHub::HasSensors() ? (SensorHub::Sensors() & HUB_STEP) != 0 : !proxStep.Read();
 
-    if (stepDetected && Movement::isMoving)
+    // A drop-off latched by the safety reflex has already stopped the motors
+    auto triggered = (stepDetected && Movement::isMoving) || (Safety::Faults() & Safety::STEP_FAULT);
+
+    if (triggered && !_triggered) Metrics::Obstacle(Metrics::STEP);
+
+    _triggered = triggered;
+
+    if (triggered)
     {
         TRACE(Logger() << F("Step sensor triggered") << endl);
-        QueueEvent(STEP_DETECTED_EVENT);
+        EventLanes::Queue(*this, STEP_DETECTED_EVENT, 0, EventLanes::URGENT, true);
     }
 }
 
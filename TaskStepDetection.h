@@ -1,9 +1,10 @@
 #pragma once
 
 #include <RTL_TaskManager.h>
+#include "Scheduler.h"
 
 
-class TaskStepDetection : public TaskBase,
+class TaskStepDetection : public PeriodicTask,
                           public EventSource
 {
     DECLARE_CLASSNAME;
@@ -15,7 +16,7 @@ class TaskStepDetection : public TaskBase,
     /*--------------------------------------------------------------------------
     Constructors
     --------------------------------------------------------------------------*/
-    public: TaskStepDetection() {};
+    public: TaskStepDetection() : PeriodicTask(5) {};
 
     /*--------------------------------------------------------------------------
     Base class overrides
@@ -31,4 +32,5 @@ class TaskStepDetection : public TaskBase,
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
+    private: bool _triggered = false;      // Step seen on the previous poll
 };
@@ -4,6 +4,7 @@
 
 #include <RTL_Stdlib.h>
 
+#include "EventLanes.h"
 #include "IMU.h"
 #include "Movement.h"
 #include "States.h"
@@ -41,14 +42,19 @@ void TaskTurn::Poll()
         return;
     }
 
+    // Check timeout (stalled, or the motors were stopped under the turn)
+    if (millis() > _timeout)
+    {
+        EventLanes::Queue(*this, TURN_ABORT_EVENT, 0, EventLanes::NORMAL, true);   // Repeats until handled
+        return;
+    }
+
     // Get current time and compute delta-T since last check
     // Use UDIFF to compute difference of unsigned numbers (handles 32-bit wrap-around)
+    // The scheduler runs us every 10ms, which ensures we have an updated measurement
     auto t1 = micros();
     auto deltaT = udiff(t1, _t0);
 
-    // Need at least 10ms between measurements to ensure we have an updated measurement
-    if (deltaT < 10000) return;
-
     // Get new gyro measurement and compute time since last measurement (in seconds)
     auto w1 = imu.GetGyroRateZ();
     auto dt = deltaT / 1000000.0f;
@@ -56,7 +62,7 @@ void TaskTurn::Poll()
     // Update turn angle using trapezoidal integration
     _currentAngle += (_w0 + (w1 - _w0) / 2.0) * dt;
 
-    TRACE(Logger(F("TaskTurn::Poll")) << _FLOAT(dt, 6) << ',' << _FLOAT(_w0, 3) << ',' << _FLOAT(w1, 3) << ',' << _FLOAT(_currentAngle*RAD_TO_DEG, 3) << endl);
+    TRACE(Logger(F("TaskTurn::Poll")) << _FLOAT(dt, 6) << ',' << _FLOAT(_w0, 3) << ',' << _FLOAT(w1, 3) << ',' << _FLOAT(_currentAngle, 3) << endl);
 
     // Update starting values for next iteration
     _w0 = w1;
@@ -64,20 +70,39 @@ void TaskTurn::Poll()
 }
 
 
-void TaskTurn::Start(int16_t turnAngle)
+//******************************************************************************
+/// <summary>
+/// Turns through an angle while moving, along an arc of the given curvature.
+/// </summary>
+/// <param>turnAngle - Degrees to turn; negative turns right, positive left</param>
+/// <param>curvature - Magnitude of the curvature (see Movement::Drive). The
+/// default (Movement::PIVOT) stops the inner track.</param>
+/// <remarks>
+/// The gyro reports degrees/second, so the angle is integrated in degrees.
+///
+/// The turn rate is proportional to the speed and the curvature, so the
+/// timeout is FULL_SPIN_TIME (a spin at CRUISE_SPEED) scaled to the angle, the
+/// curvature and the speed. TURN_ABORT_EVENT is sent if the turn takes longer.
+/// </remarks>
+//******************************************************************************
+void TaskTurn::Start(int16_t turnAngle, int16_t curvature)
 {
-    TRACE(Logger(F("TaskTurn"), F("Start")) << F("angle=") << turnAngle << endl);
+    TRACE(Logger(F("TaskTurn"), F("Start")) << F("angle=") << turnAngle << F(", curvature=") << curvature << endl);
 
     if (turnAngle != 0)
     {
-        auto direction = (turnAngle < 0) ? 'R' : 'L';
-
-        _targetAngle = abs(turnAngle)*DEG_TO_RAD;
+        _targetAngle = abs(turnAngle);
         _currentAngle = 0;
         _w0 = imu.GetGyroRateZ();
         _t0 = micros();
-        Movement::Turn(direction);
+        curvature = constrain(abs(curvature), 1, Movement::SPIN);
+        Movement::Arc(turnAngle < 0 ? -curvature : curvature);
+
+        auto speed = max(abs(Movement::Speed()), 1);
+
+        _timeout = millis() + FULL_SPIN_TIME * _targetAngle / 360 * Movement::SPIN / curvature * Movement::CRUISE_SPEED / speed;
         Resume();
+        Restart();
     }
     else
     {
@@ -91,5 +116,5 @@ void TaskTurn::Complete()
     Suspend();
     _currentAngle = 0;
     _targetAngle = 0;
-    QueueEvent(TURN_COMPLETE_EVENT);
+    EventLanes::Queue(*this, TURN_COMPLETE_EVENT, 0, EventLanes::NORMAL);
 }
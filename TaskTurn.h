@@ -1,9 +1,11 @@
 #pragma once
 
 #include <RTL_TaskManager.h>
+#include "Scheduler.h"
+#include "Movement.h"
 
 
-class TaskTurn : public TaskBase,
+class TaskTurn : public PeriodicTask,
                  public EventSource
 {
     DECLARE_CLASSNAME;
@@ -16,7 +18,7 @@ class TaskTurn : public TaskBase,
     /*--------------------------------------------------------------------------
     Constructors
     --------------------------------------------------------------------------*/
-    public: TaskTurn() {};
+    public: TaskTurn() : PeriodicTask(10, 10) {};
 
     /*--------------------------------------------------------------------------
     Base class overrides
@@ -28,15 +30,16 @@ class TaskTurn : public TaskBase,
     /*--------------------------------------------------------------------------
     Public interface
     --------------------------------------------------------------------------*/
-    public: void Start(int16_t turnAngle);
+    public: void Start(int16_t turnAngle, int16_t curvature = Movement::PIVOT);
 
     /*--------------------------------------------------------------------------
     Internal implementation
     --------------------------------------------------------------------------*/
     private: void Complete();
 
-    private: float _targetAngle = 0;
-    private: float _currentAngle = 0;
+    private: float _targetAngle = 0;       // Degrees
+    private: float _currentAngle = 0;      // Degrees
     private: float _w0;
     private: uint32_t _t0;
+    private: uint32_t _timeout;
 };
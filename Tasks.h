@@ -3,6 +3,7 @@
 #include "TaskSpin.h"
 #include "TaskTurn.h"
 #include "TaskBackup.h"
+#include "TaskHeading.h"
 #include "TaskIRRemote.h"
 #include "TaskScanSonar.h"
 #include "TaskStepDetection.h"
@@ -12,6 +13,7 @@
 extern TaskSpin spinTask;
 extern TaskTurn turnTask;
 extern TaskBackup backupTask;
+extern TaskHeading headingTask;
 extern TaskIRRemote irRemoteTask;
 extern TaskScanSonar scanSonarTask;
 extern TaskStepDetection stepDetectionTask;
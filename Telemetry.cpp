@@ -0,0 +1,105 @@
+#define DEBUG 0
+
+#include <Arduino.h>
+
+#include <RTL_Stdlib.h>
+#include "Telemetry.h"
+
+
+namespace Telemetry
+{
+    bool enabled = false;               // Indicates if telemetry records are sent
+    uint16_t dropped = 0;               // Records dropped because the TX buffer was full
+
+
+    void Begin()
+    {
+        enabled = true;
+        dropped = 0;
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Checks if a record of the given size would fit in the serial transmit
+    /// buffer now, for senders that can hold a record back rather than have
+    /// it dropped.
+    /// </summary>
+    //**************************************************************************
+    bool CanSend(uint8_t size)
+    {
+        return enabled && Serial.availableForWrite() >= size + 4;   // Framing adds at most 4 bytes
+    }
+
+
+    //**************************************************************************
+    /// <summary>
+    /// Frames a telemetry record and hands it to the serial port.
+    /// </summary>
+    /// <remarks>
+    /// The frame is only written if it fits entirely in the serial transmit
+    /// buffer, which is drained by the UART data-register-empty interrupt. This
+    /// means Send() never blocks waiting on the UART; if the buffer is too full
+    /// the record is dropped and counted instead. A dropped record is much less
+    /// harmful than a stalled control loop.
+    /// </remarks>
+    //**************************************************************************
+    bool Send(const void* record, uint8_t size)
+    {
+        if (!enabled) return false;
+
+        uint8_t frame[MAX_FRAME_SIZE];
+        auto pData = (const uint8_t*)record;
+        auto pCode = frame + 1;         // Where the current block's code byte goes
+        auto pOut = frame + 2;
+        uint8_t code = 1;
+        uint8_t sum = 0;
+
+        frame[0] = 0;                   // Leading frame delimiter
+
+        // COBS encode the record bytes followed by the checksum byte.
+        // Records are never longer than 254 bytes, so a block never needs to be
+        // split at the 0xFF code limit.
+        for (uint8_t i = 0; i <= size; i++)
+        {
+            uint8_t b;
+
+            if (i < size)
+            {
+                b = pData[i];
+                sum += b;
+            }
+            else
+            {
+                b = uint8_t(-sum);      // Checksum - record bytes + checksum sum to 0
+            }
+
+            if (b == 0)
+            {
+                *pCode = code;
+                pCode = pOut++;
+                code = 1;
+            }
+            else
+            {
+                *pOut++ = b;
+                code++;
+            }
+        }
+
+        *pCode = code;
+        *pOut++ = 0;                    // Trailing frame delimiter
+
+        uint8_t frameSize = pOut - frame;
+
+        if (Serial.availableForWrite() < frameSize)
+        {
+            dropped++;
+            return false;
+        }
+
+        Serial.write(frame, frameSize);
+
+        return true;
+    }
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <stdint.h>
+
+
+//******************************************************************************
+/// <summary>
+/// Compact binary telemetry channel.
+/// </summary>
+/// <remarks>
+/// Formatting floats to text and pushing them out at 115200 baud takes several
+/// milliseconds per line, which is enough to skew the timing of the very loops
+/// being traced. Telemetry records are instead sent as fixed-layout binary
+/// structs carrying raw integer fields. Float values are sent as fixed-point
+/// integers scaled by SCALE (i.e. 3 decimal places, the same resolution as the
+/// _FLOAT(x, 3) text traces).
+///
+/// Each record is framed as:
+///
+///     0x00 + COBS(record bytes + checksum) + 0x00
+///
+/// Consistent Overhead Byte Stuffing (COBS) guarantees that the encoded frame
+/// contains no zero bytes, so a 0x00 delimiter always marks a frame boundary
+/// and a host can resynchronize after any garbage. The leading delimiter keeps
+/// text Logger output sharing the same serial port from being glued onto the
+/// front of the next frame. The checksum is the 8-bit two's complement of the
+/// sum of the record bytes, so the record bytes plus checksum sum to zero.
+///
+/// This header is shared with the host-side decoder (Tools/TelemetryDecode.cpp)
+/// so it must not depend on any Arduino headers outside the ARDUINO section.
+/// </remarks>
+//******************************************************************************
+namespace Telemetry
+{
+    //**************************************************************************
+    // Constants
+    //**************************************************************************
+    const int32_t SCALE = 1000;             // Fixed-point scale for float fields
+    const uint8_t MAX_RECORD_SIZE = 60;     // Largest record (before framing)
+    const uint8_t MAX_FRAME_SIZE = MAX_RECORD_SIZE + 4;  // Delimiters + COBS overhead + checksum
+
+    //**************************************************************************
+    // Record IDs
+    //**************************************************************************
+    enum RecordID : uint8_t
+    {
+        REC_SPIN           = 0x01,      // TaskSpin::Poll integration step
+        REC_CORRECT_COURSE = 0x02,      // TaskCorrectCourse::Poll controller step
+        REC_SCAN_PING      = 0x03,      // StateScanForNewDirection::Poll ping
+        REC_SCAN           = 0x04,      // ScanLog: part of a completed scan
+        REC_SCAN_OUTCOME   = 0x05,      // ScanLog: what happened after a scan
+    };
+
+    //**************************************************************************
+    // Scan record values (see ScanLog.h)
+    //**************************************************************************
+    enum ScanSource : uint8_t
+    {
+        SCAN_SONAR_TASK = 1,            // TaskScanSonar 15 degree sectors, chosen by StateMoving::DetermineNewDirection
+        SCAN_PLANNER    = 2,            // StateScanForNewDirection (ScanPlanner)
+    };
+
+    enum ScanOutcome : uint8_t
+    {
+        OUTCOME_NEXT_SCAN  = 0,         // No obstacle before the next scan started
+        OUTCOME_SONAR_DANGER,           // Obstacle events, in Metrics::Source order
+        OUTCOME_SONAR_DETECTED,
+        OUTCOME_IR_PROXIMITY,
+        OUTCOME_STEP,
+    };
+
+    const int8_t NO_CHOICE = -128;      // ScanRecord::chosenAngle when the robot turned around
+    const uint8_t NO_RANGE = 0;         // ScanPoint::range for a failed ping
+    const uint8_t MAX_RANGE = 255;      // ScanPoint::range for anything at or beyond 255cm
+    const uint8_t SCAN_TIME_UNIT = 16;  // Milliseconds per unit of ScanPoint::time
+    const uint8_t POINTS_PER_RECORD = 12;
+
+    //**************************************************************************
+    // Record layouts (little-endian, packed)
+    //**************************************************************************
+    #pragma pack(push, 1)
+
+    struct RecordHeader
+    {
+        uint8_t  ID;                    // Record ID (see RecordID above)
+        uint32_t Timestamp;             // millis() when the record was sent
+    };
+
+    struct SpinRecord
+    {
+        static const uint8_t ID = REC_SPIN;
+        RecordHeader Header;
+        uint32_t dt;                    // Microseconds since previous sample
+        int32_t  w0;                    // Previous angular rate (deg/s * SCALE)
+        int32_t  w1;                    // Current angular rate (deg/s * SCALE)
+        int32_t  angle;                 // Angle turned so far (deg * SCALE)
+    };
+
+    struct CorrectCourseRecord
+    {
+        static const uint8_t ID = REC_CORRECT_COURSE;
+        RecordHeader Header;
+        uint16_t dt;                    // Milliseconds since previous sample
+        int32_t  w0;                    // Previous filtered angular rate (deg/s * SCALE)
+        int32_t  wz;                    // Measured angular rate (deg/s * SCALE)
+        int32_t  w1;                    // Filtered angular rate (deg/s * SCALE)
+        int32_t  h0;                    // Previous heading (deg * SCALE)
+        int32_t  h1;                    // Current heading (deg * SCALE)
+        int32_t  e1;                    // Current error (deg * SCALE)
+        int32_t  ei;                    // Accumulated error (deg * SCALE)
+        int16_t  correction;            // Trim applied to the right motor
+    };
+
+    struct ScanPingRecord
+    {
+        static const uint8_t ID = REC_SCAN_PING;
+        RecordHeader Header;
+        int16_t  scanAngle;             // Sonar angle of this ping (degrees)
+        uint16_t ping;                  // Ping distance (cm)
+        uint16_t bestPing;              // Best windowed ping so far (cm)
+        int16_t  bestAngle;             // Angle of the best windowed ping (degrees)
+    };
+
+    struct ScanPoint
+    {
+        int8_t   angle;                 // Sonar angle (degrees, positive to the left)
+        uint8_t  range;                 // Ping distance (cm, see NO_RANGE and MAX_RANGE)
+        int8_t   time;                  // When the ping was taken, from the scan start (SCAN_TIME_UNIT ms)
+    };
+
+    struct ScanRecord
+    {
+        static const uint8_t ID = REC_SCAN;
+        RecordHeader Header;
+        uint8_t  scan;                  // Scan number (wraps at 255)
+        uint8_t  source;                // ScanSource
+        uint32_t start;                 // millis() when the scan started
+        int8_t   chosenAngle;           // Direction chosen from the scan (degrees), or NO_CHOICE
+        uint8_t  first;                 // Index in the scan of points[0]
+        uint8_t  total;                 // Points in the whole scan (points past it are unused)
+        ScanPoint points[POINTS_PER_RECORD];
+    };
+
+    struct ScanOutcomeRecord
+    {
+        static const uint8_t ID = REC_SCAN_OUTCOME;
+        RecordHeader Header;
+        uint8_t  scan;                  // Scan number
+        uint8_t  outcome;               // ScanOutcome
+        uint32_t elapsed;               // Milliseconds from the choice to the outcome
+    };
+
+    #pragma pack(pop)
+
+    //**************************************************************************
+    // Fixed-point conversion (rounds half away from zero like Print::print(float))
+    //**************************************************************************
+    inline int32_t Fixed(float value)
+    {
+        return int32_t(value * SCALE + (value < 0 ? -0.5f : 0.5f));
+    }
+
+#ifdef ARDUINO
+    //**************************************************************************
+    // Variables
+    //**************************************************************************
+    extern bool enabled;                // Indicates if telemetry records are sent
+    extern uint16_t dropped;            // Records dropped because the TX buffer was full
+
+    //**************************************************************************
+    // Function declarations
+    //**************************************************************************
+    void Begin();
+    bool Send(const void* record, uint8_t size);
+    bool CanSend(uint8_t size);
+
+    template<typename T> inline bool Send(T& record)
+    {
+        static_assert(sizeof(T) <= MAX_RECORD_SIZE, "Telemetry record too large");
+
+        record.Header.ID = T::ID;
+        record.Header.Timestamp = millis();
+
+        return Send(&record, sizeof(T));
+    }
+#endif
+}
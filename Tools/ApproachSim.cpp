@@ -0,0 +1,207 @@
+/*******************************************************************************
+ ApproachSim
+
+ Host-side simulation of TaskScanSonar's ping-ahead mode on an approach to an
+ obstacle, comparing the fixed distance thresholds with the range tracker
+ (RangeTracker.h), time-to-collision events and the speed governor.
+
+    fixed   - the robot drives at CRUISE_SPEED. Each ping goes through the
+              median of 3, and the obstacle is detected after 3 pings in a row
+              inside THRESHOLD2 (danger at once inside THRESHOLD1).
+    ttc     - the robot cruises at FAST_SPEED in open space, and the governor
+              (TaskScanSonar::Govern) slows it as the time to collision
+              falls. Detection is at THRESHOLD2, or when the time to collision
+              drops to TTC_DETECT. Danger is at THRESHOLD1, or at TTC_DANGER.
+
+ Pings are every 20ms (the task period) with noise, the odd stray short
+ echo, and the odd missing echo. The motors respond with a lag. The robot
+ starts 4m from the obstacle, which is either standing still or coming
+ toward the robot.
+
+ For each case, the results are averaged over a number of runs with
+ different noise. They are the time to cover the first 2m (speed in open
+ space), and the range, speed and true time to collision when the first
+ event fires. The stopping gap is the range left if the robot then stops
+ (DANGER) or slows (DETECTED) and holds that speed, over 1s of scanning.
+
+ Build:
+    g++ -O2 -std=c++11 -I.. -o ApproachSim ApproachSim.cpp
+
+ Usage:
+    ApproachSim [runs]
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <random>
+
+#include "Filters.h"
+#include "RangeTracker.h"
+
+
+// Robot (Sonar.h, Movement.h, Metrics.h, TaskScanSonar.cpp)
+const int THRESHOLD1 = 30;
+const int THRESHOLD2 = 75;
+const int PING_AHEAD_RANGE = 150;
+const int CRUISE_SPEED = 200;
+const int SLOW_SPEED = 120;
+const int FAST_SPEED = 230;
+const double CM_PER_SPEED_SECOND = 0.15;
+const double PING_INTERVAL = 0.02;          // TaskScanSonar period (s)
+const float TRACK_ALPHA = 0.3f;
+const float TRACK_BETA = 0.02f;
+const float TTC_DANGER = 1.0f;
+const float TTC_DETECT = 2.5f;
+const float GOVERNOR_TTC = 4.0f;
+const int GOVERNOR_RAMP = 2;                // Speed units per ping
+const int DETECT_COUNT_FIXED = 3;
+
+// Simulated world
+const double DT = 0.001;
+const double START_RANGE = 400;             // cm
+const double MOTOR_LAG = 0.15;              // s
+const double PING_NOISE = 1.0;              // cm RMS
+const double STRAY_RATE = 0.03;             // Fraction of pings that are a short stray echo
+const double DROP_RATE = 0.03;              // Fraction of pings with no echo
+const double SCAN_TIME = 1.0;               // Time spent scanning after DETECTED (s)
+
+
+enum Event { NONE, DETECTED, DANGER };
+
+struct Result
+{
+    double openTime;        // Time to cover the first 2m (s)
+    Event event;
+    double range;           // At the event (cm)
+    double speed;           // At the event (cm/s)
+    double ttc;             // True time to collision at the event (s)
+    double gap;             // Range left after reacting (cm)
+};
+
+
+static Result Run(bool ttcMode, double obstacleSpeed, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> noise(0, PING_NOISE);
+
+    Filters::Median<uint16_t, 3> median;
+    RangeTracker tracker(TRACK_ALPHA, TRACK_BETA);
+    auto range = START_RANGE, velocity = 0.0, nextPing = 0.0;
+    auto command = ttcMode ? FAST_SPEED : CRUISE_SPEED;
+    int detectCount = 0;
+    Result result = { 0, NONE, 0, 0, 0, 0 };
+
+    for (double t = 0; t < 60 && result.event == NONE; t += DT)
+    {
+        velocity += (command * CM_PER_SPEED_SECOND - velocity) * DT / MOTOR_LAG;
+        range -= (velocity + obstacleSpeed) * DT;
+
+        if (result.openTime == 0 && range <= START_RANGE - 200) result.openTime = t;
+
+        if (t < nextPing) continue;
+
+        nextPing += PING_INTERVAL;
+
+        // The gated ping
+        double reading = range + noise(random);
+        auto r = uniform(random);
+
+        if (r < STRAY_RATE) reading = 10 + uniform(random) * range;
+        else if (r < STRAY_RATE + DROP_RATE) reading = 1e6;
+
+        auto ping = reading > PING_AHEAD_RANGE ? uint16_t(0xFFFE) : uint16_t(std::max(0.0, reading) + 0.5);
+
+        ping = median(ping);
+
+        auto ttc = RangeTracker::NO_COLLISION;
+
+        if (ttcMode)
+        {
+            if (ping == 0xFFFE) tracker.Miss(float(PING_INTERVAL));
+            else tracker.Update(ping, float(PING_INTERVAL));
+
+            ttc = tracker.TimeToCollision();
+        }
+
+        if (ping <= THRESHOLD1 || ttc <= TTC_DANGER) result.event = DANGER;
+        else if (ttcMode && (ping <= THRESHOLD2 || ttc <= TTC_DETECT)) result.event = DETECTED;
+        else if (!ttcMode && ping <= THRESHOLD2 && ++detectCount >= DETECT_COUNT_FIXED) result.event = DETECTED;
+        else if (ping > THRESHOLD2) detectCount = 0;
+
+        // Governor
+        if (ttcMode && result.event == NONE)
+        {
+            auto current = command;
+            auto target = tracker.IsValid() ? int(current * std::min(ttc, 2 * GOVERNOR_TTC) / GOVERNOR_TTC) : FAST_SPEED;
+
+            target = std::max(SLOW_SPEED, std::min(FAST_SPEED, target));
+            command = std::min(target, current + GOVERNOR_RAMP);
+        }
+    }
+
+    result.range = range;
+    result.speed = velocity;
+    result.ttc = range / std::max(1e-6, velocity + obstacleSpeed);
+
+    // React, and keep going through the scan
+    command = result.event == DANGER ? 0 : SLOW_SPEED;
+
+    auto gap = range;
+
+    for (double t = 0; t < SCAN_TIME; t += DT)
+    {
+        velocity += (command * CM_PER_SPEED_SECOND - velocity) * DT / MOTOR_LAG;
+        gap -= (velocity + obstacleSpeed) * DT;
+    }
+
+    result.gap = gap;
+
+    return result;
+}
+
+
+int main(int argc, char* argv[])
+{
+    auto runs = argc > 1 ? atoi(argv[1]) : 200;
+
+    if (runs < 1)
+    {
+        fprintf(stderr, "Usage: ApproachSim [runs]\n");
+        return 1;
+    }
+
+    printf("%d runs of each case\n\n", runs);
+    printf("%-9s %-6s %8s %8s %8s %8s %8s %8s %9s\n",
+           "obstacle", "mode", "open 2m", "danger%", "range", "speed", "ttc", "min ttc", "min gap");
+
+    for (auto obstacleSpeed : { 0.0, 15.0 })
+    {
+        for (auto ttcMode : { false, true })
+        {
+            double openTime = 0, range = 0, speed = 0, ttc = 0, minTtc = 1e9, minGap = 1e9;
+            int danger = 0;
+
+            for (int run = 0; run < runs; run++)
+            {
+                auto result = Run(ttcMode, obstacleSpeed, unsigned(run + 1));
+
+                openTime += result.openTime;
+                range += result.range;
+                speed += result.speed;
+                ttc += result.ttc;
+                minTtc = std::min(minTtc, result.ttc);
+                minGap = std::min(minGap, result.gap);
+                danger += result.event == DANGER;
+            }
+
+            printf("%4.0fcm/s  %-6s %7.2fs %7.0f%% %6.1fcm %6.1f/s %7.2fs %7.2fs %7.1fcm\n",
+                   obstacleSpeed, ttcMode ? "ttc" : "fixed", openTime / runs, 100.0 * danger / runs,
+                   range / runs, speed / runs, ttc / runs, minTtc, minGap);
+        }
+    }
+
+    return 0;
+}
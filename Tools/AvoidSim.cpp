@@ -0,0 +1,422 @@
+/*******************************************************************************
+ AvoidSim
+
+ Host-side simulation of StateMoving's obstacle avoidance in a walled arena
+ with round posts, comparing the two settings of ARC_AVOIDANCE:
+
+    spin    - when a scan finishes the robot spins in place toward the open
+              side (Movement::Spin), then drives on at CRUISE_SPEED
+    arc     - when a scan finishes while the robot is still moving it arcs
+              toward the open side (TaskTurn, curvature from StateMoving::Arc)
+              at its current speed, and only spins after a danger stop
+
+ Both follow TaskScanSonar and StateMoving: the sonar pings ahead every 20ms.
+ Three pings in a row inside THRESHOLD2 slow the robot to SLOW_SPEED and
+ start a scan; a ping inside THRESHOLD1 stops it (danger) and starts a scan.
+ Three clear pings in a row put it back to CRUISE_SPEED. The scan pings -90
+ to 90 degrees in 15 degree steps, and the new direction is chosen from the
+ left and right areas as DetermineNewDirection does. A boxed in robot backs
+ up and turns around (StateReversingDirection). The IR proximity sensors and
+ course correction are not modelled.
+
+ The sonar sees anything within half the beam width (7.5 degrees) of where
+ it points, and the robot moves like CorridorSim's chassis (lagging tracks).
+
+ For each mode the results are averaged over a number of runs with different
+ arenas. They are the average forward speed, the number of stops per minute
+ (the robot's forward speed falling to near zero: a danger stop, a spin in
+ place, or backing up), and the number of collisions per minute.
+
+ Build:
+    g++ -O2 -std=c++11 -o AvoidSim AvoidSim.cpp
+
+ Usage:
+    AvoidSim [seconds] [runs]
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+// Robot (Sonar.h, Movement.h, TaskScanSonar.h, StateMoving.cpp)
+const int THRESHOLD1 = 30;
+const int THRESHOLD2 = 75;
+const int SCAN_RANGE = 250;
+const int CRUISE_SPEED = 200;
+const int SLOW_SPEED = 120;
+const int PIVOT = 128;
+const int SPIN = 256;
+const int MIN_ARC_CURVATURE = 32;
+const int SCAN_INCREMENT = 15;
+const int DETECT_COUNT = 3;
+const double CM_PER_SPEED_SECOND = 0.15;
+const double PING_INTERVAL = 0.02;          // TaskScanSonar period (s)
+const double SCAN_PING_TIME = 0.06;         // Servo move plus ping, per scan position (s)
+const double BACKUP_TIME = 0.5;             // StateReversingDirection (s)
+
+// Simulated world
+const double DT = 0.005;
+const double TRACK_WIDTH = 15;              // cm
+const double MOTOR_LAG = 0.15;              // s
+const double ROBOT_RADIUS = 10;             // cm
+const double BEAM_HALF_ANGLE = 7.5;         // degrees
+const double ARENA = 500;                   // Square arena side (cm)
+const int POSTS = 10;
+const double POST_RADIUS_MIN = 5, POST_RADIUS_MAX = 20;
+
+
+struct Post { double x, y, r; };
+
+struct World
+{
+    std::vector<Post> posts;
+
+    // Range along a ray from (x, y) at heading (deg), to a wall or a post
+    double Ray(double x, double y, double heading) const
+    {
+        auto dx = cos(heading * M_PI / 180), dy = sin(heading * M_PI / 180);
+        auto range = 1e9;
+
+        if (dx > 1e-9) range = std::min(range, (ARENA - x) / dx);
+        if (dx < -1e-9) range = std::min(range, -x / dx);
+        if (dy > 1e-9) range = std::min(range, (ARENA - y) / dy);
+        if (dy < -1e-9) range = std::min(range, -y / dy);
+
+        for (auto& post : posts)
+        {
+            auto px = post.x - x, py = post.y - y;
+            auto along = px * dx + py * dy;
+            auto off2 = px * px + py * py - along * along;
+
+            if (along > 0 && off2 < post.r * post.r) range = std::min(range, along - sqrt(post.r * post.r - off2));
+        }
+
+        return range;
+    }
+
+    // Sonar ping: the nearest echo across the beam, up to maxRange (0 = none)
+    int Ping(double x, double y, double heading, int maxRange) const
+    {
+        auto range = 1e9;
+
+        for (auto a = -BEAM_HALF_ANGLE; a <= BEAM_HALF_ANGLE; a += 2.5) range = std::min(range, Ray(x, y, heading + a));
+
+        return range <= maxRange ? int(range) : 0;
+    }
+
+    bool Collides(double x, double y) const
+    {
+        if (x < ROBOT_RADIUS || y < ROBOT_RADIUS || x > ARENA - ROBOT_RADIUS || y > ARENA - ROBOT_RADIUS) return true;
+
+        for (auto& post : posts)
+        {
+            if (hypot(post.x - x, post.y - y) < post.r + ROBOT_RADIUS) return true;
+        }
+
+        return false;
+    }
+};
+
+
+//******************************************************************************
+// Tracked chassis: commanded track speeds in, position and heading out
+//******************************************************************************
+struct Chassis
+{
+    double x = 0, y = 0, theta = 0;     // Position (cm) and heading (deg)
+    double left = 0, right = 0;         // Actual track speeds (motor units)
+
+    double Forward() const { return (left + right) / 2 * CM_PER_SPEED_SECOND; }
+
+    // Returns false (and doesn't move) if the step would hit something
+    bool Step(const World& world, double leftCommand, double rightCommand)
+    {
+        left += (leftCommand - left) * DT / MOTOR_LAG;
+        right += (rightCommand - right) * DT / MOTOR_LAG;
+
+        auto v = Forward();
+        auto nx = x + v * cos(theta * M_PI / 180) * DT;
+        auto ny = y + v * sin(theta * M_PI / 180) * DT;
+
+        theta += (right - left) * CM_PER_SPEED_SECOND / TRACK_WIDTH * 180 / M_PI * DT;
+
+        if (world.Collides(nx, ny))
+        {
+            left = right = 0;
+            return false;
+        }
+
+        x = nx;
+        y = ny;
+
+        return true;
+    }
+};
+
+
+// Track speeds for a speed and curvature (Movement::DriveMotors)
+static void Tracks(int speed, int curvature, double& left, double& right)
+{
+    auto inner = speed * (PIVOT - std::abs(curvature)) / double(PIVOT);
+
+    left = curvature > 0 ? inner : speed;
+    right = curvature > 0 ? speed : inner;
+}
+
+
+//******************************************************************************
+// One run of StateMoving in an arena
+//******************************************************************************
+struct Result
+{
+    double speed;           // Average forward speed (cm/s)
+    double stops;           // Per minute
+    double collisions;      // Per minute
+};
+
+
+enum Mode { CRUISING, SCANNING, TURNING, SPINNING, BACKING };
+
+
+static World MakeWorld(unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    World world;
+
+    while (int(world.posts.size()) < POSTS)
+    {
+        Post post = { 50 + uniform(random) * (ARENA - 100), 50 + uniform(random) * (ARENA - 100),
+                      POST_RADIUS_MIN + uniform(random) * (POST_RADIUS_MAX - POST_RADIUS_MIN) };
+
+        if (hypot(post.x - ARENA / 2, post.y - ARENA / 2) > post.r + 3 * ROBOT_RADIUS) world.posts.push_back(post);
+    }
+
+    return world;
+}
+
+
+static Result Run(bool arc, double seconds, unsigned seed)
+{
+    auto world = MakeWorld(seed);
+    std::mt19937 random(seed + 1000);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    Chassis chassis;
+
+    chassis.x = chassis.y = ARENA / 2;
+    chassis.theta = uniform(random) * 360;
+
+    auto mode = CRUISING;
+    int speed = CRUISE_SPEED, curvature = 0;
+    bool moving = true;                         // Movement::isMoving
+    int detectCount = 0, clearCount = 0;
+    double nextPing = 0, modeEnd = 0;
+    double turned = 0, turnTarget = 0;
+    int scanAngle = 0, leftArea = 0, rightArea = 0;
+    int leftBest = 0, rightBest = 0, leftAngle = 0, rightAngle = 0;
+    double travel = 0;
+    int stops = 0, collisions = 0;
+    bool stopped = false;
+
+    for (double t = 0; t < seconds; t += DT)
+    {
+        // Motor commands for the current mode
+        double left = 0, right = 0;
+
+        if (mode == SPINNING) Tracks(CRUISE_SPEED, turnTarget < 0 ? -SPIN : SPIN, left, right);
+        else if (mode == BACKING) left = right = -CRUISE_SPEED;
+        else if (moving) Tracks(speed, curvature, left, right);
+
+        auto theta0 = chassis.theta;
+
+        if (!chassis.Step(world, left, right))
+        {
+            // Bumped into something: treat it like a blocked path
+            collisions++;
+            mode = BACKING;
+            modeEnd = t + BACKUP_TIME;
+        }
+
+        travel += std::max(0.0, chassis.Forward()) * DT;
+        turned += chassis.theta - theta0;
+
+        // Stops: forward speed falling to near zero from moving
+        auto isStopped = chassis.Forward() < 0.1 * SLOW_SPEED * CM_PER_SPEED_SECOND;
+
+        if (isStopped && !stopped) stops++;
+
+        stopped = isStopped;
+
+        switch (mode)
+        {
+            case CRUISING:
+            case TURNING:
+                if (t < nextPing) break;
+
+                nextPing = t + PING_INTERVAL;
+
+                {
+                    auto ping = world.Ping(chassis.x, chassis.y, chassis.theta, 150);
+
+                    if (ping > 0 && ping <= THRESHOLD1)
+                    {
+                        // OBSTACLE_DANGER_EVENT: stop (ends any arc) and scan
+                        moving = false;
+                        mode = SCANNING;
+                    }
+                    else if (mode == CRUISING && ping > 0 && ping <= THRESHOLD2 && ++detectCount >= DETECT_COUNT)
+                    {
+                        // OBSTACLE_DETECTED_EVENT: slow down and scan
+                        speed = SLOW_SPEED;
+                        mode = SCANNING;
+                    }
+                    else if (ping == 0 || ping > THRESHOLD2)
+                    {
+                        detectCount = 0;
+
+                        // OBSTACLE_NONE_EVENT: path clear again, back to CRUISE_SPEED
+                        if (mode == CRUISING && speed != CRUISE_SPEED && ++clearCount >= DETECT_COUNT) speed = CRUISE_SPEED;
+                    }
+
+                    if (ping > 0 && ping <= THRESHOLD2) clearCount = 0;
+
+                    if (mode == SCANNING)
+                    {
+                        detectCount = clearCount = 0;
+                        scanAngle = -90;
+                        leftArea = rightArea = leftBest = rightBest = 0;
+                        leftAngle = rightAngle = 0;
+                        modeEnd = t + SCAN_PING_TIME;
+                    }
+                }
+
+                // TaskTurn: turn complete
+                if (mode == TURNING && fabs(turned) >= fabs(turnTarget))
+                {
+                    mode = CRUISING;
+                    curvature = 0;
+                }
+                break;
+
+            case SCANNING:
+                if (t < modeEnd) break;
+
+                {
+                    auto ping = world.Ping(chassis.x, chassis.y, chassis.theta + scanAngle, SCAN_RANGE);
+
+                    if (ping == 0) ping = SCAN_RANGE;
+
+                    if (scanAngle > 0)
+                    {
+                        leftArea += ping;
+                        if (ping > leftBest) { leftBest = ping; leftAngle = scanAngle; }
+                    }
+                    else if (scanAngle < 0)
+                    {
+                        rightArea += ping;
+                        if (ping > rightBest) { rightBest = ping; rightAngle = scanAngle; }
+                    }
+
+                    scanAngle += SCAN_INCREMENT;
+                    modeEnd = t + SCAN_PING_TIME;
+                }
+
+                if (scanAngle <= 90) break;
+
+                // StateMoving::DetermineNewDirection
+                {
+                    auto diff = leftArea - rightArea;
+                    auto ratio = double(diff) / std::max(std::max(leftArea, rightArea), 1);
+                    auto angle = 0;
+
+                    if (fabs(ratio) > 0.1) angle = diff > 0 ? leftAngle : rightAngle;
+                    else if (leftBest > rightBest && leftBest >= 100) angle = leftAngle;
+                    else if (rightBest > leftBest && rightBest >= 100) angle = rightAngle;
+
+                    turned = 0;
+                    turnTarget = angle;
+
+                    if (angle != 0 && arc && moving)
+                    {
+                        // StateMoving::Arc
+                        auto c = std::min(std::max(PIVOT * std::abs(angle) / 90, MIN_ARC_CURVATURE), PIVOT);
+
+                        curvature = angle < 0 ? -c : c;
+                        mode = TURNING;
+                    }
+                    else if (angle != 0)
+                    {
+                        mode = SPINNING;
+                    }
+                    else
+                    {
+                        // StateReversingDirection: back up, then turn around
+                        turnTarget = 180;
+                        mode = BACKING;
+                        modeEnd = t + BACKUP_TIME;
+                    }
+                }
+                break;
+
+            case SPINNING:
+                if (fabs(turned) < fabs(turnTarget)) break;
+
+                // Spin complete: go forward at CRUISE_SPEED
+                mode = CRUISING;
+                moving = true;
+                speed = CRUISE_SPEED;
+                curvature = 0;
+                break;
+
+            case BACKING:
+                if (t < modeEnd) break;
+
+                turned = 0;
+                turnTarget = 180;
+                mode = SPINNING;
+                break;
+        }
+    }
+
+    auto minutes = seconds / 60;
+
+    return { travel / seconds, stops / minutes, collisions / minutes };
+}
+
+
+int main(int argc, char* argv[])
+{
+    auto seconds = argc > 1 ? atof(argv[1]) : 300;
+    auto runs = argc > 2 ? atoi(argv[2]) : 20;
+
+    if (seconds <= 0 || runs < 1)
+    {
+        fprintf(stderr, "Usage: AvoidSim [seconds] [runs]\n");
+        return 1;
+    }
+
+    printf("%g s x %d runs, %dx%d cm arena with %d posts\n\n", seconds, runs, int(ARENA), int(ARENA), POSTS);
+    printf("%-6s %10s %10s %12s\n", "mode", "speed cm/s", "stops/min", "collide/min");
+
+    for (auto arc : { false, true })
+    {
+        Result total = { 0, 0, 0 };
+
+        for (int r = 0; r < runs; r++)
+        {
+            auto result = Run(arc, seconds, r + 1);
+
+            total.speed += result.speed;
+            total.stops += result.stops;
+            total.collisions += result.collisions;
+        }
+
+        printf("%-6s %10.1f %10.2f %12.2f\n", arc ? "arc" : "spin", total.speed / runs, total.stops / runs, total.collisions / runs);
+    }
+
+    return 0;
+}
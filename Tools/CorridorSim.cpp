@@ -0,0 +1,505 @@
+/*******************************************************************************
+ CorridorSim
+
+ Host-side simulation of the course correction (CourseController, run every
+ 100ms with the robot's gains) on a simple tracked chassis: the right track is
+ a little weaker than the left, the motors respond with a lag, and the gyro has
+ noise and a small bias.
+
+ Corridor test (the default) - compares TaskCorrectCourse's two modes:
+
+    reset  - the course restarts wherever the robot points each time course
+             correction resumes (the original behaviour)
+    hold   - a target heading is kept across avoidance turns (HEADING_HOLD)
+
+ The robot sets off along +x. Every few seconds an obstacle is seen on a
+ random side and the robot arcs away from it (StateMoving::Turn at
+ NEAR_CURVATURE) with course correction suspended, then resumes. The hold
+ mode's heading is integrated from the gyro every 10ms as TaskHeading does.
+
+ For each mode the net displacement along the intended axis (x), the final
+ sideways offset, and the ratio of x to the distance driven are averaged over
+ a number of runs with different random obstacles. Hold mode should keep
+ making progress along x; reset mode random-walks.
+
+ Auto-tune test (-t) - runs the relay auto-tune (RelayTuner, as
+ TaskCorrectCourse::Autotune does) on the chassis at SLOW_SPEED and
+ CRUISE_SPEED, then drives straight at each speed with the default and the
+ tuned gains through random yaw disturbances (bumps in the floor), and
+ compares the RMS heading error. Everything runs as on the robot (ROBOT_LOOP):
+ the relay and the controller every 10ms, motor writes at least 20ms apart.
+ The relay run's length and its worst case (TUNE_TIMEOUT) are shown, for the
+ floor space Autotune needs. Autotune only saves the tuned gains if they
+ beat the current ones on every validation pass over the same stretch of
+ floor (with bumps of its own); "accepted" is how often they did, and "RMS
+ saved" is the error with whichever row would have been saved. The rule
+ RelayTuner used to apply ("old rule") is run through the same check.
+
+ Loop rate test (-r) - drives straight at CRUISE_SPEED through the same bumps
+ with the course controller run at different periods (with the default gains
+ rescaled to the period, as TaskCorrectCourse does), with and without loop
+ jitter, and with motor writes rate-limited as TaskCorrectCourse does. The
+ RMS heading error is the controller's tracking error; the sideways offset is
+ mostly the gyro bias drift, which no controller can see.
+
+ Build:
+    g++ -O2 -std=c++11 -I.. -o CorridorSim CorridorSim.cpp
+
+ Usage:
+    CorridorSim [seconds] [runs]
+    CorridorSim -t [seconds] [runs]
+    CorridorSim -r [seconds] [runs]
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <random>
+
+#include "CourseController.h"
+
+
+// Robot (TaskCorrectCourse.cpp, StateMoving.cpp, Movement.h, Metrics.h)
+const double SAMPLE_INTERVAL = 0.1;            // Course correction period (s)
+const CourseGains GAINS = { 20.0f, 2.0f * 0.1f, 0.0f, 0.8f };
+const int MAX_SPEED = 255;
+const int CRUISE_SPEED = 200;
+const int SLOW_SPEED = 120;
+const int PIVOT = 128;
+const int NEAR_CURVATURE = 96;
+const double CM_PER_SPEED_SECOND = 0.15;
+const int16_t RELAY_AMPLITUDE = 40;
+const float RELAY_HYSTERESIS = 1.0f;
+const double VALIDATE_SETTLE = 2;               // Validation run: settling time, not measured (s)
+const double VALIDATE_TIME = 4;                 // Validation run: time measured (s)
+const int VALIDATE_PASSES = 2;                  // Validation runs the tuned gains must all win
+const double TUNE_TIMEOUT = 15;                 // Longest a relay run may take (s)
+
+// Simulated chassis and sensors
+const double DT = 0.01;                         // Simulation step (s) - TaskHeading period
+const double TRACK_WIDTH = 15;                  // cm
+const double RIGHT_TRACK_GAIN = 0.96;           // Right track output relative to the left
+const double MOTOR_LAG = 0.15;                  // Track speed time constant (s)
+const double GYRO_NOISE = 0.5;                  // deg/s RMS
+const double GYRO_BIAS = 0.2;                   // deg/s
+const double AVOID_INTERVAL_MIN = 2, AVOID_INTERVAL_MAX = 8;    // Seconds between obstacles
+const double AVOID_TIME_MIN = 0.2, AVOID_TIME_MAX = 0.6;        // Seconds spent arcing away
+const double BUMP_RATE = 0.5;                   // Floor bumps per second (auto-tune test)
+const double BUMP_SIZE = 3;                     // RMS heading kick of a bump (deg)
+
+
+//******************************************************************************
+// Tracked chassis: commanded track speeds in, position and turn rate out
+//******************************************************************************
+struct Chassis
+{
+    double x = 0, y = 0, theta = 0;     // Position (cm) and true heading (deg)
+    double left = 0, right = 0;         // Actual track speeds (motor units)
+    double rate = 0;                    // Turn rate (deg/s, positive left)
+    double driven = 0;                  // Path length (cm)
+
+    void Step(double leftCommand, double rightCommand, double disturbance = 0)
+    {
+        left += (leftCommand - left) * DT / MOTOR_LAG;
+        right += (rightCommand * RIGHT_TRACK_GAIN - right) * DT / MOTOR_LAG;
+
+        auto vLeft = left * CM_PER_SPEED_SECOND;
+        auto vRight = right * CM_PER_SPEED_SECOND;
+        auto v = (vLeft + vRight) / 2;
+
+        rate = (vRight - vLeft) / TRACK_WIDTH * 180 / M_PI + disturbance;
+        x += v * cos(theta * M_PI / 180) * DT;
+        y += v * sin(theta * M_PI / 180) * DT;
+        theta += rate * DT;
+        driven += fabs(v) * DT;
+    }
+};
+
+
+// Right motor command with a trim, as Movement::Trim gives it
+static double Trimmed(int speed, int correction)
+{
+    return std::max(-double(MAX_SPEED), std::min(double(MAX_SPEED), double(speed + correction)));
+}
+
+
+//******************************************************************************
+// Corridor test
+//******************************************************************************
+struct Result
+{
+    double along;       // Net displacement along x (cm)
+    double across;      // Final |y| (cm)
+    double driven;      // Path length (cm)
+};
+
+
+static Result Run(bool hold, double seconds, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> noise(0, GYRO_NOISE);
+
+    CourseController controller(GAINS);
+    Chassis chassis;
+    double heading = 0, w0 = 0;                     // TaskHeading's integrated heading
+    double target = 0;                              // Heading held in hold mode
+    double nextAvoid = AVOID_INTERVAL_MIN + uniform(random) * (AVOID_INTERVAL_MAX - AVOID_INTERVAL_MIN);
+    double avoidEnd = -1, nextSample = SAMPLE_INTERVAL;
+    int avoidCurvature = 0, correction = 0;
+
+    controller.SetLimits(-CRUISE_SPEED, MAX_SPEED - CRUISE_SPEED);
+
+    for (double t = 0; t < seconds; t += DT)
+    {
+        // Obstacle seen: arc away from it with course correction suspended
+        if (avoidEnd < 0 && t >= nextAvoid)
+        {
+            avoidCurvature = uniform(random) < 0.5 ? NEAR_CURVATURE : -NEAR_CURVATURE;
+            avoidEnd = t + AVOID_TIME_MIN + uniform(random) * (AVOID_TIME_MAX - AVOID_TIME_MIN);
+            correction = 0;
+        }
+
+        // Obstacle gone: resume forward and course correction (TaskCorrectCourse::Reset)
+        if (avoidEnd >= 0 && t >= avoidEnd)
+        {
+            avoidEnd = -1;
+            avoidCurvature = 0;
+            nextAvoid = t + AVOID_INTERVAL_MIN + uniform(random) * (AVOID_INTERVAL_MAX - AVOID_INTERVAL_MIN);
+            nextSample = t + SAMPLE_INTERVAL;
+            controller.Reset();
+        }
+
+        // Track speeds (Movement::DriveMotors, then Movement::Trim on the right)
+        double left = CRUISE_SPEED, right = CRUISE_SPEED;
+        auto inner = double(CRUISE_SPEED) * (PIVOT - abs(avoidCurvature)) / PIVOT;
+
+        if (avoidCurvature > 0) left = inner;
+        else if (avoidCurvature < 0) right = inner;
+        else right = Trimmed(CRUISE_SPEED, correction);
+
+        chassis.Step(left, right);
+
+        // Gyro and TaskHeading
+        auto wz = chassis.rate + GYRO_BIAS + noise(random);
+
+        heading += (w0 + (wz - w0) / 2) * DT;
+        w0 = wz;
+
+        if (heading > 180) heading -= 360;
+        else if (heading < -180) heading += 360;
+
+        // TaskCorrectCourse
+        if (avoidEnd < 0 && t >= nextSample)
+        {
+            correction = hold ? controller.Hold(float(heading), float(target))
+                              : controller.Update(float(wz), float(SAMPLE_INTERVAL));
+            nextSample += SAMPLE_INTERVAL;
+        }
+    }
+
+    Result result = { chassis.x, fabs(chassis.y), chassis.driven };
+
+    return result;
+}
+
+
+static void CorridorTest(double seconds, int runs)
+{
+    printf("%d runs of %.0fs\n\n", runs, seconds);
+    printf("%-6s %10s %10s %10s %8s\n", "mode", "along(m)", "across(m)", "driven(m)", "along%");
+
+    for (auto hold : { false, true })
+    {
+        double along = 0, across = 0, driven = 0;
+
+        for (int run = 0; run < runs; run++)
+        {
+            auto result = Run(hold, seconds, unsigned(run + 1));
+
+            along += result.along;
+            across += result.across;
+            driven += result.driven;
+        }
+
+        printf("%-6s %10.1f %10.1f %10.1f %7.1f%%\n", hold ? "hold" : "reset",
+               along / runs / 100, across / runs / 100, driven / runs / 100, 100 * along / driven);
+    }
+}
+
+
+//******************************************************************************
+// Auto-tune test
+//******************************************************************************
+
+// How TaskCorrectCourse runs: its period, how late the main loop may run it,
+// and the shortest time between motor writes
+struct Loop
+{
+    double interval;    // s
+    double jitter;      // s, uniform 0..jitter
+    double motor;       // s
+};
+
+const Loop SLOW_LOOP = { SAMPLE_INTERVAL, 0, 0 };
+const Loop ROBOT_LOOP = { 0.010, 0, 0.020 };   // TaskCorrectCourse and Autotune now
+
+
+// Relay test at one speed (TaskCorrectCourse::Autotune), run at the loop's
+// period with its motor write limit. Returns false if the oscillation never
+// settled; distance is how far the robot drove (cm).
+static bool Autotune(int speed, unsigned seed, const Loop& loop, CourseGains& gains, RelayTuner& relay, double& distance)
+{
+    std::mt19937 random(seed);
+    std::normal_distribution<double> noise(0, GYRO_NOISE);
+
+    Chassis chassis;
+    double heading = 0, w0 = 0, nextSample = loop.interval, lastWrite = -1;
+    int correction = 0, written = 0;
+
+    for (double t = 0; t < TUNE_TIMEOUT && !relay.Done(); t += DT)
+    {
+        chassis.Step(speed, Trimmed(speed, written));
+
+        auto wz = chassis.rate + GYRO_BIAS + noise(random);
+
+        heading += (w0 + (wz - w0) / 2) * DT;
+        w0 = wz;
+
+        if (t >= nextSample - DT / 2)
+        {
+            correction = relay.Update(float(0 - heading), float(t));
+            nextSample += loop.interval;
+        }
+
+        if (correction != written && t - lastWrite >= loop.motor - DT / 2)
+        {
+            written = correction;
+            lastWrite = t;
+        }
+    }
+
+    distance = chassis.driven;
+
+    if (!relay.Done()) return false;
+
+    gains = relay.Gains(float(loop.interval), GAINS.alpha);
+
+    return true;
+}
+
+
+// Per-sample gains (CourseGains) for another sample interval
+static CourseGains Rescaled(const CourseGains& gains, double interval)
+{
+    auto f = float(interval / SAMPLE_INTERVAL);
+
+    return { gains.Kp, gains.Ki * f, gains.Kd / f, gains.alpha };
+}
+
+
+struct Tracking
+{
+    double heading;     // RMS heading error the controller sees (deg)
+    double offset;      // RMS sideways offset from the starting line (cm)
+};
+
+
+// Drives straight with heading hold through floor bumps; returns the RMS
+// heading error the controller sees (the gyro bias drift is not its doing)
+// and the RMS sideways offset, leaving out the first settle seconds
+static Tracking Straight(int speed, const CourseGains& gains, double seconds, unsigned seed, const Loop& loop = SLOW_LOOP, double settle = 0)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> noise(0, GYRO_NOISE);
+    std::normal_distribution<double> bump(0, BUMP_SIZE);
+
+    CourseController controller(gains);
+    Chassis chassis;
+    double heading = 0, w0 = 0, nextSample = loop.interval, lastSample = 0, lastWrite = -1, sum = 0, sumY = 0;
+    auto due = nextSample + uniform(random) * loop.jitter;
+    int correction = 0, written = 0, count = 0;
+
+    controller.SetLimits(-speed, MAX_SPEED - speed);
+
+    for (double t = 0; t < seconds; t += DT)
+    {
+        // A bump kicks the heading within one step (the gyro sees it)
+        auto kick = uniform(random) < BUMP_RATE * DT ? bump(random) / DT : 0;
+
+        chassis.Step(speed, Trimmed(speed, written), kick);
+
+        auto wz = chassis.rate + GYRO_BIAS + noise(random);
+
+        heading += (w0 + (wz - w0) / 2) * DT;
+        w0 = wz;
+
+        // Phase-locked: a late run doesn't move the next one
+        if (t >= due - DT / 2)
+        {
+            correction = controller.Hold(float(heading), 0, float((t - lastSample) / loop.interval));
+            lastSample = t;
+            nextSample += loop.interval;
+            due = nextSample + uniform(random) * loop.jitter;
+        }
+
+        // Rate-limited motor writes
+        if (correction != written && t - lastWrite >= loop.motor - DT / 2)
+        {
+            written = correction;
+            lastWrite = t;
+        }
+
+        if (t < settle) continue;
+
+        sum += heading * heading;
+        sumY += chassis.y * chassis.y;
+        count++;
+    }
+
+    Tracking result = { sqrt(sum / count), sqrt(sumY / count) };
+
+    return result;
+}
+
+
+// Autotune's check before saving a row: the current and the new gains each
+// drive the same stretch of floor (the robot backs up between the runs), and
+// the new gains are kept only if their RMS heading error is lower every pass
+static bool Validate(int speed, const CourseGains& current, const CourseGains& gains, unsigned seed, const Loop& loop)
+{
+    auto seconds = VALIDATE_SETTLE + VALIDATE_TIME;
+
+    for (int pass = 0; pass < VALIDATE_PASSES; pass++)
+    {
+        auto floor = seed + 1000 * pass;
+
+        if (Straight(speed, gains, seconds, floor, loop, VALIDATE_SETTLE).heading
+            >= Straight(speed, current, seconds, floor, loop, VALIDATE_SETTLE).heading) return false;
+    }
+
+    return true;
+}
+
+
+// One line of the auto-tune test: the gains against the defaults over the
+// test runs, how often validation accepted them, and the RMS error with the
+// row that would have been saved
+static void Compare(const char* label, int speed, const CourseGains& gains, const Loop& loop, double seconds, int runs)
+{
+    auto defaults = Rescaled(GAINS, loop.interval);
+    double before = 0, after = 0, saved = 0;
+    int accepted = 0;
+
+    for (int run = 0; run < runs; run++)
+    {
+        auto a = Straight(speed, defaults, seconds, unsigned(run + 1), loop).heading;
+        auto b = Straight(speed, gains, seconds, unsigned(run + 1), loop).heading;
+        auto keep = Validate(speed, defaults, gains, unsigned(10000 + run), loop);     // A different floor
+
+        before += a;
+        after += b;
+        saved += keep ? b : a;
+        accepted += keep ? 1 : 0;
+    }
+
+    printf("%-6d %-9s %8.2f %8.4f  %11.2f%c %11.2f%c %9d%% %11.2f%c\n", speed, label, gains.Kp, gains.Ki,
+           before / runs, 'd', after / runs, 'd', 100 * accepted / runs, saved / runs, 'd');
+}
+
+
+static void AutotuneTest(double seconds, int runs)
+{
+    auto& loop = ROBOT_LOOP;
+
+    printf("%d runs of %.0fs at each speed, validated over %.0fs, controller every %.0fms, motor writes %.0fms apart\n\n",
+           runs, seconds, VALIDATE_TIME, loop.interval * 1000, loop.motor * 1000);
+    printf("%-6s %-9s %8s %8s  %12s %12s %10s %12s\n", "speed", "rule", "Kp", "Ki",
+           "RMS default", "RMS tuned", "accepted", "RMS saved");
+
+    for (auto speed : { SLOW_SPEED, CRUISE_SPEED })
+    {
+        RelayTuner relay(RELAY_AMPLITUDE, RELAY_HYSTERESIS);
+        CourseGains tuned;
+        double distance;
+
+        if (!Autotune(speed, 1, loop, tuned, relay, distance))
+        {
+            printf("%-6d auto-tune did not settle\n", speed);
+            continue;
+        }
+
+        // The Tyreus-Luyben rule RelayTuner used to apply, to show validation catching worse gains
+        auto Ti = 2.2f * relay.Tu();
+        CourseGains old = { relay.Ku() / 3.2f, relay.Ku() / 3.2f / Ti * float(loop.interval), 0, GAINS.alpha };
+
+        Compare("tuned", speed, tuned, loop, seconds, runs);
+        Compare("old rule", speed, old, loop, seconds, runs);
+        printf("%-6s Ku=%.2f Tu=%.2fs, relay run %.1fm (%.1fm if it times out)\n", "", relay.Ku(), relay.Tu(),
+               distance / 100, speed * CM_PER_SPEED_SECOND * TUNE_TIMEOUT / 100);
+    }
+}
+
+
+//******************************************************************************
+// Loop rate test
+//******************************************************************************
+static void RateTest(double seconds, int runs)
+{
+    const Loop loops[] =
+    {
+        { 0.100, 0.000, 0.000 },
+        { 0.100, 0.020, 0.000 },    // The main loop runs it up to 20ms late
+        { 0.020, 0.000, 0.020 },
+        { 0.010, 0.000, 0.020 },    // TaskCorrectCourse now
+        { 0.010, 0.000, 0.010 },
+        { 0.005, 0.000, 0.020 },
+    };
+
+    printf("%d runs of %.0fs at CRUISE_SPEED, default gains\n\n", runs, seconds);
+    printf("%9s %9s %9s  %12s %12s\n", "period", "jitter", "motor", "RMS heading", "RMS offset");
+
+    for (auto& loop : loops)
+    {
+        auto gains = Rescaled(GAINS, loop.interval);
+        double heading = 0, offset = 0;
+
+        for (int run = 0; run < runs; run++)
+        {
+            auto result = Straight(CRUISE_SPEED, gains, seconds, unsigned(run + 1), loop);
+
+            heading += result.heading;
+            offset += result.offset;
+        }
+
+        printf("%7.0fms %7.0fms %7.0fms  %11.2fd %10.1fcm\n", loop.interval * 1000, loop.jitter * 1000,
+               loop.motor * 1000, heading / runs, offset / runs);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    auto mode = argc > 1 && argv[1][0] == '-' ? argv[1][1] : 0;
+    auto arg = mode != 0 ? 2 : 1;
+    auto seconds = argc > arg ? atof(argv[arg]) : (mode != 0 ? 60 : 300);
+    auto runs = argc > arg + 1 ? atoi(argv[arg + 1]) : 20;
+
+    if (seconds <= 0 || runs < 1 || (mode != 0 && mode != 't' && mode != 'r'))
+    {
+        fprintf(stderr, "Usage: CorridorSim [-t|-r] [seconds] [runs]\n");
+        return 1;
+    }
+
+    if (mode == 't')
+        AutotuneTest(seconds, runs);
+    else if (mode == 'r')
+        RateTest(seconds, runs);
+    else
+        CorridorTest(seconds, runs);
+
+    return 0;
+}
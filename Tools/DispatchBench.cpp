@@ -0,0 +1,344 @@
+/*******************************************************************************
+ DispatchBench
+
+ Host-side benchmark for finding a state's transition for an event (see
+ StateMachine.h). The same stream of events is looked up three ways in the
+ tables of the biggest state (StateMoving, 16 transitions) and the smallest
+ one with more than one (StateStopped, 5):
+
+    switch  - the switch statements in OnEvent() the tables replaced
+    linear  - reading each entry's event ID in turn until one matches
+    index   - EventIndex::Find(), as Dispatch() does now: hash the event ID
+              to a slot and read the entry's position from the state's index
+
+ and compared for:
+
+    - agreement: how many events find the same transition as the switch
+    - speed:     nanoseconds per event on the host
+    - reads:     table reads per event (flash reads on the robot), which
+                 with the loop around them are the main cost on the AVR
+    - size:      bytes of code, from nm on this program
+
+ The host can't show the AVR's costs directly - it is far better at both
+ branches and memory than the AVR - so the read counts are the better guide
+ to the robot. The event IDs here are source << 8 | code like the library's,
+ but the real values may differ; that only changes the hash multiplier, not
+ the cost of a lookup. The kernels are plain C++, so the same file can be compiled for the
+ robot to get AVR code sizes (or run in a simulator for cycle counts):
+
+    avr-g++ -Os -mmcu=atmega328p -std=gnu++11 -DKERNELS_ONLY -c DispatchBench.cpp
+    avr-nm -C -S --size-sort DispatchBench.o | grep Kernels
+
+ Build:
+    g++ -O2 -std=c++11 -I.. -o DispatchBench DispatchBench.cpp
+
+ Usage:
+    DispatchBench [events]
+ ******************************************************************************/
+
+#include <stdint.h>
+#include "EventIndex.h"
+
+#ifndef __AVR__
+#define PROGMEM
+#endif
+
+
+//******************************************************************************
+// Kernels. Each processes a whole buffer of event IDs, writing the position of
+// the transition found (or EventIndex::NONE), so the call overhead is not
+// measured.
+//******************************************************************************
+namespace Kernels
+{
+    // The events of StateMachine::EVENTS, in the same order
+    enum : uint16_t
+    {
+        STEP_DETECTED = 0x0310,
+        SONAR_NONE = 0x0400, SONAR_DETECTED = 0x0402, SONAR_DANGER = 0x0403, SCAN_COMPLETE = 0x040A,
+        NEAR_NONE = 0x0300, NEAR_LEFT = 0x0301, NEAR_RIGHT = 0x0302, NEAR_BLOCKED = 0x0303, NEAR_FRONT = 0x0304,
+        CMD_MOVE = 0x0204, CMD_STOP = 0x0205, CMD_TURN_BEGIN = 0x0206, CMD_TURN_END = 0x0207,
+        CMD_BACKUP_BEGIN = 0x0208, CMD_BACKUP_END = 0x0203,
+        SPIN_COMPLETE = 0x0101, SPIN_ABORT = 0x0102, TURN_COMPLETE = 0x0107, TURN_ABORT = 0x0109, BACKUP_COMPLETE = 0x0103,
+    };
+
+    constexpr uint16_t EVENTS[] =
+    {
+        STEP_DETECTED,
+        SONAR_NONE, SONAR_DETECTED, SONAR_DANGER, SCAN_COMPLETE,
+        NEAR_NONE, NEAR_LEFT, NEAR_RIGHT, NEAR_BLOCKED, NEAR_FRONT,
+        CMD_MOVE, CMD_STOP, CMD_TURN_BEGIN, CMD_TURN_END, CMD_BACKUP_BEGIN, CMD_BACKUP_END,
+        SPIN_COMPLETE, SPIN_ABORT, TURN_COMPLETE, TURN_ABORT, BACKUP_COMPLETE,
+    };
+
+    const int EVENT_COUNT = sizeof(EVENTS) / sizeof(EVENTS[0]);
+
+    // A transition as laid out on the AVR: the event ID, two 4 byte member
+    // function pointers and a 2 byte state pointer
+    struct Entry
+    {
+        uint16_t EventID;
+        uint8_t rest[10];
+    };
+
+    // StateMoving's and StateStopped's transitions, in the same order
+    constexpr Entry MOVING[] PROGMEM =
+    {
+        { STEP_DETECTED, {} }, { SONAR_DANGER, {} }, { SONAR_DETECTED, {} }, { SCAN_COMPLETE, {} },
+        { SONAR_NONE, {} }, { NEAR_BLOCKED, {} }, { NEAR_FRONT, {} }, { NEAR_LEFT, {} },
+        { NEAR_RIGHT, {} }, { NEAR_NONE, {} }, { CMD_TURN_BEGIN, {} }, { CMD_TURN_END, {} },
+        { SPIN_COMPLETE, {} }, { SPIN_ABORT, {} }, { TURN_COMPLETE, {} }, { TURN_ABORT, {} },
+    };
+
+    constexpr Entry STOPPED[] PROGMEM =
+    {
+        { CMD_MOVE, {} }, { CMD_TURN_BEGIN, {} }, { CMD_TURN_END, {} }, { CMD_BACKUP_BEGIN, {} }, { CMD_BACKUP_END, {} },
+    };
+
+    constexpr uint16_t HASH = EventIndex::Multiplier(EVENTS);
+    constexpr EventIndex::Entries<EventIndex::SLOTS> MOVING_INDEX PROGMEM = EventIndex::Build(MOVING, HASH);
+    constexpr EventIndex::Entries<EventIndex::SLOTS> STOPPED_INDEX PROGMEM = EventIndex::Build(STOPPED, HASH);
+
+    static_assert(HASH != 0, "DispatchBench: no perfect hash for the events");
+
+    static inline uint16_t ReadWord(const uint16_t* p)
+    {
+#ifdef __AVR__
+        return pgm_read_word(p);
+#else
+        return *p;
+#endif
+    }
+
+    // The switch statements, reduced to which transition each case was
+    static inline uint8_t MovingCase(uint16_t id)
+    {
+        switch (id)
+        {
+            case STEP_DETECTED:  return 0;
+            case SONAR_DANGER:   return 1;
+            case SONAR_DETECTED: return 2;
+            case SCAN_COMPLETE:  return 3;
+            case SONAR_NONE:     return 4;
+            case NEAR_BLOCKED:   return 5;
+            case NEAR_FRONT:     return 6;
+            case NEAR_LEFT:      return 7;
+            case NEAR_RIGHT:     return 8;
+            case NEAR_NONE:      return 9;
+            case CMD_TURN_BEGIN: return 10;
+            case CMD_TURN_END:   return 11;
+            case SPIN_COMPLETE:  return 12;
+            case SPIN_ABORT:     return 13;
+            case TURN_COMPLETE:  return 14;
+            case TURN_ABORT:     return 15;
+            default:             return EventIndex::NONE;
+        }
+    }
+
+    static inline uint8_t StoppedCase(uint16_t id)
+    {
+        switch (id)
+        {
+            case CMD_MOVE:         return 0;
+            case CMD_TURN_BEGIN:   return 1;
+            case CMD_TURN_END:     return 2;
+            case CMD_BACKUP_BEGIN: return 3;
+            case CMD_BACKUP_END:   return 4;
+            default:               return EventIndex::NONE;
+        }
+    }
+
+    template <int N>
+    static inline uint8_t Linear(const Entry (&table)[N], uint16_t id)
+    {
+        for (int i = 0; i < N; i++)
+        {
+            if (ReadWord(&table[i].EventID) == id) return uint8_t(i);
+        }
+
+        return EventIndex::NONE;
+    }
+
+    template <int N>
+    static inline uint8_t Indexed(const Entry (&table)[N], const EventIndex::Entries<EventIndex::SLOTS>& index, uint16_t id)
+    {
+        auto first = EventIndex::Find(index, HASH, id);
+
+        // Dispatch() checks the entry's event ID before using it
+        return (first < N && ReadWord(&table[first].EventID) == id) ? first : EventIndex::NONE;
+    }
+
+    __attribute__((noinline)) void MovingSwitch(const uint16_t* in, uint8_t* out, int n)
+    {
+        for (int i = 0; i < n; i++) out[i] = MovingCase(in[i]);
+    }
+
+    __attribute__((noinline)) void MovingLinear(const uint16_t* in, uint8_t* out, int n)
+    {
+        for (int i = 0; i < n; i++) out[i] = Linear(MOVING, in[i]);
+    }
+
+    __attribute__((noinline)) void MovingIndex(const uint16_t* in, uint8_t* out, int n)
+    {
+        for (int i = 0; i < n; i++) out[i] = Indexed(MOVING, MOVING_INDEX, in[i]);
+    }
+
+    __attribute__((noinline)) void StoppedSwitch(const uint16_t* in, uint8_t* out, int n)
+    {
+        for (int i = 0; i < n; i++) out[i] = StoppedCase(in[i]);
+    }
+
+    __attribute__((noinline)) void StoppedLinear(const uint16_t* in, uint8_t* out, int n)
+    {
+        for (int i = 0; i < n; i++) out[i] = Linear(STOPPED, in[i]);
+    }
+
+    __attribute__((noinline)) void StoppedIndex(const uint16_t* in, uint8_t* out, int n)
+    {
+        for (int i = 0; i < n; i++) out[i] = Indexed(STOPPED, STOPPED_INDEX, in[i]);
+    }
+}
+
+
+#ifndef KERNELS_ONLY
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+//******************************************************************************
+// Table reads per lookup (words and bytes), counted the way each kernel reads
+//******************************************************************************
+template <int N>
+static int LinearReads(const Kernels::Entry (&table)[N], uint16_t id)
+{
+    for (int i = 0; i < N; i++)
+    {
+        if (table[i].EventID == id) return i + 1;
+    }
+
+    return N;
+}
+
+
+static int IndexReads(const EventIndex::Entries<EventIndex::SLOTS>& index, uint16_t id)
+{
+    // The index byte, then the entry's ID if there is an entry
+    return 1 + (EventIndex::Find(index, Kernels::HASH, id) != EventIndex::NONE ? 1 : 0);
+}
+
+
+//******************************************************************************
+// Reads the size of each kernel from the symbol table of this program
+//******************************************************************************
+static unsigned KernelSize(const char* program, const char* kernel)
+{
+    std::string command = std::string("nm -C -S \"") + program + "\"";
+    auto pipe = popen(command.c_str(), "r");
+
+    if (pipe == nullptr) return 0;
+
+    char line[1024];
+    unsigned size = 0;
+    auto name = std::string("Kernels::") + kernel + "(";
+
+    while (fgets(line, sizeof(line), pipe) != nullptr)
+    {
+        unsigned long address, length;
+        char type;
+        int nameStart = 0;
+
+        if (sscanf(line, "%lx %lx %c %n", &address, &length, &type, &nameStart) != 3) continue;
+
+        if (strncmp(line + nameStart, name.c_str(), name.size()) == 0) size = unsigned(length);
+    }
+
+    pclose(pipe);
+
+    return size;
+}
+
+
+typedef void (*Kernel)(const uint16_t*, uint8_t*, int);
+
+static double Time(Kernel kernel, const std::vector<uint16_t>& in, std::vector<uint8_t>& out)
+{
+    const int REPEATS = 50;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int r = 0; r < REPEATS; r++) kernel(in.data(), out.data(), int(in.size()));
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / (double(REPEATS) * in.size());
+}
+
+
+template <int N>
+static void Compare(const char* program, const char* name, const std::vector<uint16_t>& in, const Kernels::Entry (&table)[N],
+                    const EventIndex::Entries<EventIndex::SLOTS>& index, Kernel kernels[3], const char* names[3])
+{
+    std::vector<uint8_t> out[3];
+    double time[3];
+    size_t agree[3] = { 0, 0, 0 };
+    double reads[3] = { 0, 0, 0 };
+
+    for (int k = 0; k < 3; k++)
+    {
+        out[k].resize(in.size());
+        time[k] = Time(kernels[k], in, out[k]);
+    }
+
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        for (int k = 0; k < 3; k++) agree[k] += out[k][i] == out[0][i] ? 1 : 0;
+
+        reads[1] += LinearReads(table, in[i]);
+        reads[2] += IndexReads(index, in[i]);
+    }
+
+    for (int k = 0; k < 3; k++)
+    {
+        printf("%-8s %-7s %6.2f%%  %8.2f  %6s  %6u\n", k == 0 ? name : "", names[k] + strlen(name),
+               100.0 * agree[k] / in.size(), time[k],
+               k == 0 ? "-" : std::to_string(reads[k] / in.size()).substr(0, 4).c_str(), KernelSize(program, names[k]));
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    auto n = argc > 1 ? atoi(argv[1]) : 100000;
+
+    if (n < 1)
+    {
+        fprintf(stderr, "Usage: DispatchBench [events]\n");
+        return 1;
+    }
+
+    // Every event equally often - each state ignores some of them
+    std::vector<uint16_t> events;
+
+    srand(1);
+
+    for (int i = 0; i < n; i++) events.push_back(Kernels::EVENTS[rand() % Kernels::EVENT_COUNT]);
+
+    Kernel moving[3] = { Kernels::MovingSwitch, Kernels::MovingLinear, Kernels::MovingIndex };
+    const char* movingNames[3] = { "MovingSwitch", "MovingLinear", "MovingIndex" };
+    Kernel stopped[3] = { Kernels::StoppedSwitch, Kernels::StoppedLinear, Kernels::StoppedIndex };
+    const char* stoppedNames[3] = { "StoppedSwitch", "StoppedLinear", "StoppedIndex" };
+
+    printf("%d events, %d kinds, hash multiplier %u\n\n", n, Kernels::EVENT_COUNT, Kernels::HASH);
+    printf("%-8s %-7s %7s  %8s  %6s  %6s\n", "state", "lookup", "agree", "ns/event", "reads", "bytes");
+
+    Compare(argv[0], "Moving", events, Kernels::MOVING, Kernels::MOVING_INDEX, moving, movingNames);
+    Compare(argv[0], "Stopped", events, Kernels::STOPPED, Kernels::STOPPED_INDEX, stopped, stoppedNames);
+
+    return 0;
+}
+
+#endif
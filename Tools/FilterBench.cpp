@@ -0,0 +1,302 @@
+/*******************************************************************************
+ FilterBench
+
+ Host-side benchmark for the filter stages in Filters.h. Each filter the robot
+ used to hand-code is run over the same synthetic sensor data both as the
+ original code and as the equivalent Filters.h pipeline, and the two are
+ compared for:
+
+    - agreement: how many samples give the same output
+    - speed:     nanoseconds per sample on the host
+    - size:      bytes of code, from nm on this program
+
+ The kernels are plain C++ with no library calls, so the same file can be
+ compiled for the robot to get AVR code sizes (the host sizes are only a
+ rough guide):
+
+    avr-g++ -Os -mmcu=atmega328p -std=gnu++11 -DKERNELS_ONLY -c FilterBench.cpp
+    avr-nm -C -S --size-sort FilterBench.o | grep Kernels
+
+ Build:
+    g++ -O2 -std=c++11 -I.. -o FilterBench FilterBench.cpp
+
+ Usage:
+    FilterBench [samples]
+ ******************************************************************************/
+
+#include <stdint.h>
+#include "Filters.h"
+
+
+//******************************************************************************
+// Kernels. Each processes a whole buffer so the call overhead is not measured.
+// The hand-written versions are copied from the code they replace(d).
+//******************************************************************************
+namespace Kernels
+{
+    // TaskCorrectCourse / CourseController gyro smoothing (alpha = 0.8)
+    __attribute__((noinline)) void HandEma(const float* in, float* out, int n)
+    {
+        auto alpha = 0.8f;
+        auto w0 = in[0];
+
+        for (int i = 0; i < n; i++) out[i] = w0 = alpha * w0 + (1 - alpha) * in[i];
+    }
+
+    __attribute__((noinline)) void FilterEma(const float* in, float* out, int n)
+    {
+        Filters::Ema<float, 8, 10> ema;
+
+        for (int i = 0; i < n; i++) out[i] = ema(in[i]);
+    }
+
+    // PerformMagCalibration magnetometer smoothing (alpha = 0.1)
+    __attribute__((noinline)) void HandLowPass(const float* in, float* out, int n)
+    {
+        auto alpha = 0.1f;
+        auto beta = 1 - alpha;
+        auto x = in[0];
+
+        for (int i = 0; i < n; i++) out[i] = x = beta * x + alpha * in[i];
+    }
+
+    __attribute__((noinline)) void FilterLowPass(const float* in, float* out, int n)
+    {
+        Filters::Ema<float, 9, 10> ema;
+
+        ema(in[0]);
+
+        for (int i = 0; i < n; i++) out[i] = ema(in[i]);
+    }
+
+    // Median of three sonar pings (compare and swap)
+    __attribute__((noinline)) void HandMedian3(const uint16_t* in, uint16_t* out, int n)
+    {
+        uint16_t a = in[0], b = in[0];
+
+        for (int i = 0; i < n; i++)
+        {
+            auto c = in[i];
+            auto lo = a < b ? a : b;
+            auto hi = a < b ? b : a;
+
+            out[i] = c < lo ? lo : (c > hi ? hi : c);
+            a = b;
+            b = c;
+        }
+    }
+
+    __attribute__((noinline)) void FilterMedian3(const uint16_t* in, uint16_t* out, int n)
+    {
+        Filters::Median<uint16_t, 3> median;
+
+        median(in[0]);
+        median(in[0]);
+
+        for (int i = 0; i < n; i++) out[i] = median(in[i]);
+    }
+
+    // TaskScanSonar "obstacle detected" - 3 consecutive pings inside THRESHOLD2
+    __attribute__((noinline)) void HandDetect(const uint16_t* in, uint8_t* out, int n)
+    {
+        uint8_t detectCount = 0, clearCount = 0;
+        bool detected = false;
+
+        for (int i = 0; i < n; i++)
+        {
+            if (in[i] <= 75)
+            {
+                clearCount = 0;
+
+                if (!detected && ++detectCount >= 3) detected = true;
+            }
+            else
+            {
+                detectCount = 0;
+
+                if (detected && ++clearCount >= 3) detected = false;
+            }
+
+            if (detected) detectCount = 0;
+            if (!detected) clearCount = 0;
+
+            out[i] = detected;
+        }
+    }
+
+    __attribute__((noinline)) void FilterDetect(const uint16_t* in, uint8_t* out, int n)
+    {
+        Filters::Pipeline<Filters::Hysteresis<uint16_t, 75, 76, true>, Filters::Debounce<3>> detected;
+
+        for (int i = 0; i < n; i++) out[i] = detected(in[i]);
+    }
+
+    // Movement::Spin stall detector - 10 samples in a row below 3 deg/s. The
+    // old count went up by 2 per slow sample and restarted at 1, so it stopped
+    // at 20 after 10. Spin returns on a stall, so both start again after one.
+    __attribute__((noinline)) void HandStall(const float* in, uint8_t* out, int n)
+    {
+        auto nospin_count = 0;
+
+        for (int i = 0; i < n; i++)
+        {
+            auto wz = in[i] < 0 ? -in[i] : in[i];
+
+            nospin_count = (wz < 3) ? (nospin_count + 1) : 0;
+            out[i] = ++nospin_count >= 20;      // (counted twice per sample)
+
+            if (out[i]) nospin_count = 0;
+        }
+    }
+
+    __attribute__((noinline)) void FilterStall(const float* in, uint8_t* out, int n)
+    {
+        Filters::Pipeline<Filters::Hysteresis<float, 3, 3>, Filters::Debounce<10, true>> spinning;
+
+        for (int i = 0; i < n; i++)
+        {
+            out[i] = !spinning(in[i] < 0 ? -in[i] : in[i]);
+
+            if (out[i]) spinning.Reset();
+        }
+    }
+}
+
+
+#ifndef KERNELS_ONLY
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+//******************************************************************************
+// Synthetic sensor data
+//******************************************************************************
+struct Data
+{
+    std::vector<float> gyro;        // deg/s: a spin with stalls and noise
+    std::vector<uint16_t> range;    // cm: an approach with spikes and dropouts
+};
+
+
+static Data MakeData(int n)
+{
+    Data data;
+
+    srand(1);
+
+    for (int i = 0; i < n; i++)
+    {
+        auto noise = (rand() % 200 - 100) / 50.0f;
+        auto stalled = (i / 500) % 4 == 3;
+
+        data.gyro.push_back((stalled ? 0.0f : 90.0f) + noise);
+
+        auto range = 20 + (i % 400) / 2 + rand() % 6;
+
+        if (rand() % 20 == 0) range = rand() % 2 ? 0 : 400;     // Spikes / dropouts
+
+        data.range.push_back(uint16_t(range));
+    }
+
+    return data;
+}
+
+
+//******************************************************************************
+// Reads the size of each kernel from the symbol table of this program
+//******************************************************************************
+static unsigned KernelSize(const char* program, const char* kernel)
+{
+    std::string command = std::string("nm -C -S \"") + program + "\"";
+    auto pipe = popen(command.c_str(), "r");
+
+    if (pipe == nullptr) return 0;
+
+    char line[1024];
+    unsigned size = 0;
+    auto name = std::string("Kernels::") + kernel + "(";
+
+    while (fgets(line, sizeof(line), pipe) != nullptr)
+    {
+        unsigned long address, length;
+        char type;
+        int nameStart = 0;
+
+        if (sscanf(line, "%lx %lx %c %n", &address, &length, &type, &nameStart) != 3) continue;
+
+        if (strncmp(line + nameStart, name.c_str(), name.size()) == 0) size = unsigned(length);
+    }
+
+    pclose(pipe);
+
+    return size;
+}
+
+
+template <class In, class Out>
+static double Time(void (*kernel)(const In*, Out*, int), const std::vector<In>& in, std::vector<Out>& out)
+{
+    const int REPEATS = 50;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int r = 0; r < REPEATS; r++) kernel(in.data(), out.data(), int(in.size()));
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / (double(REPEATS) * in.size());
+}
+
+
+template <class In, class Out>
+static void Compare(const char* program, const char* name, const std::vector<In>& in,
+                    void (*hand)(const In*, Out*, int), const char* handName,
+                    void (*filter)(const In*, Out*, int), const char* filterName)
+{
+    std::vector<Out> handOut(in.size()), filterOut(in.size());
+
+    auto handTime = Time(hand, in, handOut);
+    auto filterTime = Time(filter, in, filterOut);
+    size_t agree = 0;
+
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        if (std::fabs(double(handOut[i]) - double(filterOut[i])) <= 1e-3) agree++;
+    }
+
+    printf("%-10s %6.2f%%  %8.2f %8.2f  %6u %6u\n", name, 100.0 * agree / in.size(),
+           handTime, filterTime, KernelSize(program, handName), KernelSize(program, filterName));
+}
+
+
+int main(int argc, char* argv[])
+{
+    auto n = argc > 1 ? atoi(argv[1]) : 100000;
+
+    if (n < 1)
+    {
+        fprintf(stderr, "Usage: FilterBench [samples]\n");
+        return 1;
+    }
+
+    auto data = MakeData(n);
+
+    printf("%d samples\n\n", n);
+    printf("%-10s %7s  %8s %8s  %6s %6s\n", "", "", "ns/sample", "", "bytes", "");
+    printf("%-10s %7s  %8s %8s  %6s %6s\n", "filter", "agree", "hand", "Filters", "hand", "Filters");
+
+    Compare(argv[0], "ema",     data.gyro,  Kernels::HandEma,     "HandEma",     Kernels::FilterEma,     "FilterEma");
+    Compare(argv[0], "lowpass", data.gyro,  Kernels::HandLowPass, "HandLowPass", Kernels::FilterLowPass, "FilterLowPass");
+    Compare(argv[0], "median3", data.range, Kernels::HandMedian3, "HandMedian3", Kernels::FilterMedian3, "FilterMedian3");
+    Compare(argv[0], "detect",  data.range, Kernels::HandDetect,  "HandDetect",  Kernels::FilterDetect,  "FilterDetect");
+    Compare(argv[0], "stall",   data.gyro,  Kernels::HandStall,   "HandStall",   Kernels::FilterStall,   "FilterStall");
+
+    return 0;
+}
+
+#endif
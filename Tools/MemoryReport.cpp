@@ -0,0 +1,227 @@
+/*******************************************************************************
+ MemoryReport
+
+ Build-time SRAM budget report for the sketch. Lists the static RAM (.data and
+ .bss) used by each translation unit and by each object, so the cost of a new
+ buffer or task can be seen before it goes on the robot. The runtime side
+ (stack high-water mark, free RAM) is reported by Memory.cpp over serial.
+
+ The report is made from the files the Arduino build leaves in its build
+ folder (use "Show verbose output during compilation" or the --build-path
+ option of arduino-cli to find it):
+
+    *.o     one per translation unit - sizes from avr-size -A
+    *.elf   the linked program       - symbols from avr-nm -C -S
+
+ Objects are grouped into tasks, states, drivers and other so the big
+ consumers stand out. avr-size and avr-nm must be on the PATH (they come with
+ the Arduino AVR toolchain).
+
+ Build:
+    g++ -O2 -std=c++11 -o MemoryReport MemoryReport.cpp
+
+ Usage:
+    MemoryReport <build-folder>
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+static const unsigned SRAM_SIZE = 2048;     // ATmega328
+
+
+struct Usage
+{
+    std::string name;
+    unsigned data = 0;
+    unsigned bss = 0;
+
+    unsigned Total() const { return data + bss; }
+};
+
+
+//******************************************************************************
+// Runs a command and returns its output lines
+//******************************************************************************
+static std::vector<std::string> Run(const std::string& command)
+{
+    std::vector<std::string> lines;
+    auto pipe = popen(command.c_str(), "r");
+
+    if (pipe == nullptr) return lines;
+
+    char buffer[1024];
+
+    while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
+    {
+        buffer[strcspn(buffer, "\r\n")] = 0;
+        lines.push_back(buffer);
+    }
+
+    pclose(pipe);
+
+    return lines;
+}
+
+
+//******************************************************************************
+// Gets the .data and .bss sizes of an object or ELF file from avr-size -A
+//******************************************************************************
+static Usage SectionSizes(const std::string& file)
+{
+    Usage usage;
+    char section[256];
+    unsigned size;
+
+    usage.name = file;
+
+    for (auto& line : Run("avr-size -A \"" + file + "\""))
+    {
+        if (sscanf(line.c_str(), "%255s %u", section, &size) != 2) continue;
+
+        if (strcmp(section, ".data") == 0) usage.data += size;
+        if (strcmp(section, ".bss") == 0) usage.bss += size;
+    }
+
+    return usage;
+}
+
+
+//******************************************************************************
+// Groups an object by its name
+//******************************************************************************
+static const char* Category(const std::string& name)
+{
+    static const char* drivers[] = { "imu", "sonar", "panServo", "motorController", "leftMotor", "rightMotor",
+                                     "proxSensors", "proxStep", "I2c", "Serial", "Wire", "heartbeat", nullptr };
+
+    if (name.find("Task") != std::string::npos || name.find("task") != std::string::npos) return "task";
+
+    if (name.find("State") != std::string::npos || name.find("state") != std::string::npos) return "state";
+
+    for (auto p = drivers; *p != nullptr; p++)
+    {
+        if (name.find(*p) != std::string::npos) return "driver";
+    }
+
+    return "other";
+}
+
+
+static void PrintRow(const char* category, const Usage& usage)
+{
+    printf("  %-8s %6u %6u %6u  %s\n", category, usage.data, usage.bss, usage.Total(), usage.name.c_str());
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: MemoryReport <build-folder>\n");
+        return 1;
+    }
+
+    std::string folder = argv[1];
+
+    //--------------------------------------------------------------------------
+    // Per translation unit
+    //--------------------------------------------------------------------------
+    std::vector<Usage> units;
+
+    for (auto& file : Run("find \"" + folder + "\" -name '*.o'"))
+    {
+        auto usage = SectionSizes(file);
+
+        if (usage.Total() == 0) continue;
+
+        usage.name = file.substr(folder.size() + 1);
+        units.push_back(usage);
+    }
+
+    std::sort(units.begin(), units.end(), [](const Usage& a, const Usage& b) { return a.Total() > b.Total(); });
+
+    printf("Static RAM by translation unit (bytes)\n");
+    printf("  %-8s %6s %6s %6s  %s\n", "", ".data", ".bss", "total", "file");
+
+    for (auto& unit : units) PrintRow("", unit);
+
+    //--------------------------------------------------------------------------
+    // Per object, from the linked program
+    //--------------------------------------------------------------------------
+    auto elfFiles = Run("find \"" + folder + "\" -maxdepth 1 -name '*.elf'");
+
+    if (elfFiles.empty())
+    {
+        fprintf(stderr, "No .elf file found in %s\n", folder.c_str());
+        return 1;
+    }
+
+    auto& elf = elfFiles.front();
+    std::vector<Usage> objects;
+
+    for (auto& line : Run("avr-nm -C -S --size-sort \"" + elf + "\""))
+    {
+        // Format: address size type name
+        char type;
+        unsigned address, size;
+        int nameStart = 0;
+
+        if (sscanf(line.c_str(), "%x %x %c %n", &address, &size, &type, &nameStart) != 3 || nameStart == 0) continue;
+
+        Usage usage;
+
+        usage.name = line.substr(nameStart);
+
+        switch (type)
+        {
+            case 'd': case 'D': usage.data = size; break;
+            case 'b': case 'B': usage.bss = size; break;
+            default: continue;
+        }
+
+        objects.push_back(usage);
+    }
+
+    std::sort(objects.begin(), objects.end(), [](const Usage& a, const Usage& b) { return a.Total() > b.Total(); });
+
+    printf("\nStatic RAM by object (bytes)\n");
+    printf("  %-8s %6s %6s %6s  %s\n", "group", ".data", ".bss", "total", "object");
+
+    for (auto& object : objects) PrintRow(Category(object.name), object);
+
+    printf("\nTotals by group (bytes)\n");
+
+    for (auto group : { "task", "state", "driver", "other" })
+    {
+        Usage total;
+
+        total.name = group;
+
+        for (auto& object : objects)
+        {
+            if (strcmp(Category(object.name), group) != 0) continue;
+
+            total.data += object.data;
+            total.bss += object.bss;
+        }
+
+        PrintRow("", total);
+    }
+
+    //--------------------------------------------------------------------------
+    // Overall budget
+    //--------------------------------------------------------------------------
+    auto program = SectionSizes(elf);
+
+    printf("\nSRAM budget: .data=%u, .bss=%u, static=%u of %u (%u%%), %u left for heap and stack\n",
+           program.data, program.bss, program.Total(), SRAM_SIZE, program.Total() * 100 / SRAM_SIZE,
+           SRAM_SIZE - std::min(program.Total(), SRAM_SIZE));
+
+    return 0;
+}
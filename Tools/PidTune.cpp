@@ -0,0 +1,433 @@
+/*******************************************************************************
+ PidTune
+
+ Host-side replay and auto-tuning tool for the course correction controller.
+
+ Parses CorrectCourse trace logs (the text TRACE format, e.g.
+ Analysis/CorrectCourse_data_20191228.txt, or the output of TelemetryDecode)
+ and replays the recorded gyro rates through CourseController::Update - the
+ same code TaskCorrectCourse::Poll runs on the robot - for candidate gain sets.
+
+ Since a different gain set produces a different correction than the one that
+ was logged, the replay uses a simple plant model: the measured turn rate is
+ treated as a disturbance plus the effect of the logged correction, i.e.
+
+    wz(candidate) = wz(logged) + b * (correction(candidate) - correction(logged))
+
+ using the previous sample's correction (the trim acts on the next interval).
+ The plant gain b (deg/s per unit of trim) is estimated from the log by least
+ squares unless given with -b. Trim is clipped to what the right motor can
+ actually deliver at the given cruise speed.
+
+ Each candidate is scored as
+
+    cost = RMS(heading error) + effort * RMS(correction)
+
+ A coarse grid over (Kp, Ki, Kd, alpha) is evaluated across all cores and the
+ best grid points are then refined with Nelder-Mead (also in parallel). The
+ result is a ranked table plus the constants to paste into TaskCorrectCourse.cpp.
+
+ Build:
+    g++ -O2 -std=c++11 -pthread -o PidTune PidTune.cpp
+
+ Usage:
+    PidTune [-b plantGain] [-e effortWeight] [-s speed] [-n top] logfile...
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../CourseController.h"
+
+
+const float SAMPLE_INTERVAL = 0.1f;     // Nominal sample interval of TaskCorrectCourse (seconds)
+const int MAX_SPEED = 255;              // Movement::MAX_SPEED
+
+
+struct Sample
+{
+    float dt;
+    float wz;
+    int   correction;
+};
+
+typedef std::vector<Sample> Segment;    // Samples between controller resets
+
+
+struct Candidate
+{
+    CourseGains gains;
+    double cost;
+    double rmsError;
+    double rmsEffort;
+};
+
+
+static std::vector<Segment> segments;
+static double plantGain = NAN;
+static double effortWeight = 0.05;
+static int cruiseSpeed = 200;
+
+
+//******************************************************************************
+// Log parsing
+//******************************************************************************
+static bool GetField(const char* line, const char* name, double& value)
+{
+    auto p = strstr(line, name);
+
+    if (p == nullptr) return false;
+
+    value = atof(p + strlen(name));
+
+    return true;
+}
+
+
+static bool LoadLog(const char* path)
+{
+    auto file = fopen(path, "r");
+
+    if (file == nullptr) return false;
+
+    char line[512];
+
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        if (strstr(line, "CorrectCourse:") == nullptr) continue;
+
+        double dt, w0, wz, h0, correction;
+
+        if (!GetField(line, "dt=", dt) || !GetField(line, " w0=", w0) || !GetField(line, "wz=", wz) ||
+            !GetField(line, " h0=", h0) || !GetField(line, "correction=", correction))
+        {
+            continue;
+        }
+
+        // The first sample after TaskCorrectCourse::Reset() has w0 = h0 = 0
+        if (segments.empty() || (w0 == 0 && h0 == 0)) segments.push_back(Segment());
+
+        segments.back().push_back({ float(dt), float(wz), int(correction) });
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+
+//******************************************************************************
+// Estimates the plant gain b in wz[k] = d + b * correction[k-1]
+//******************************************************************************
+static double EstimatePlantGain()
+{
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+    for (auto& segment : segments)
+    {
+        for (size_t k = 1; k < segment.size(); k++)
+        {
+            double x = segment[k - 1].correction;
+            double y = segment[k].wz;
+
+            n++;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+    }
+
+    auto var = sxx - sx * sx / n;
+
+    return (n > 2 && var > 0) ? (sxy - sx * sy / n) / var : 0;
+}
+
+
+//******************************************************************************
+// Trim that actually reaches the right motor (Movement::Trim adds it to the
+// current speed, which the motor driver limits to +/-MAX_SPEED)
+//******************************************************************************
+static int EffectiveTrim(int correction)
+{
+    return std::max(-MAX_SPEED, std::min(MAX_SPEED, cruiseSpeed + correction)) - cruiseSpeed;
+}
+
+
+//******************************************************************************
+// Replays all segments with the given gains and scores the result
+//******************************************************************************
+static void Evaluate(Candidate& candidate)
+{
+    CourseController controller(candidate.gains);
+    double sumError = 0;
+    double sumEffort = 0;
+    long count = 0;
+
+    for (auto& segment : segments)
+    {
+        controller.Reset();
+
+        auto heading = 0.0;
+        auto lastTrim = 0;
+        auto lastLoggedTrim = 0;
+
+        for (auto& sample : segment)
+        {
+            auto wz = sample.wz + plantGain * (lastTrim - lastLoggedTrim);
+            auto correction = controller.Update(float(wz), sample.dt);
+
+            heading += wz * sample.dt;
+            lastTrim = EffectiveTrim(correction);
+            lastLoggedTrim = EffectiveTrim(sample.correction);
+            sumError += heading * heading;
+            sumEffort += double(lastTrim) * lastTrim;
+            count++;
+        }
+    }
+
+    candidate.rmsError = sqrt(sumError / std::max(count, 1L));
+    candidate.rmsEffort = sqrt(sumEffort / std::max(count, 1L));
+    candidate.cost = candidate.rmsError + effortWeight * candidate.rmsEffort;
+}
+
+
+//******************************************************************************
+// Runs fn(i) for i in [0, count) across all available cores
+//******************************************************************************
+template<typename F> static void ParallelFor(size_t count, F fn)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    auto threadCount = std::max(1U, std::thread::hardware_concurrency());
+
+    for (unsigned t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (size_t i = next++; i < count; i = next++) fn(i);
+        });
+    }
+
+    for (auto& thread : threads) thread.join();
+}
+
+
+//******************************************************************************
+// Nelder-Mead search over (Kp, Ki, Kd, alpha) starting from a grid point
+//******************************************************************************
+static CourseGains Constrain(const double* x)
+{
+    return
+    {
+        float(std::max(0.0, x[0])),
+        float(std::max(0.0, x[1])),
+        float(std::max(0.0, x[2])),
+        float(std::max(0.0, std::min(0.99, x[3])))
+    };
+}
+
+
+static Candidate NelderMead(const Candidate& start)
+{
+    const int N = 4;
+    const double step[N] = { 2.0, 0.05, 1.0, 0.05 };
+    double x[N + 1][N];
+    double f[N + 1];
+
+    auto cost = [](const double* p)
+    {
+        Candidate c;
+        c.gains = Constrain(p);
+        Evaluate(c);
+        return c.cost;
+    };
+
+    const double x0[N] = { start.gains.Kp, start.gains.Ki, start.gains.Kd, start.gains.alpha };
+
+    for (int i = 0; i <= N; i++)
+    {
+        memcpy(x[i], x0, sizeof(x0));
+        if (i > 0) x[i][i - 1] += step[i - 1];
+        f[i] = cost(x[i]);
+    }
+
+    for (int iteration = 0; iteration < 400; iteration++)
+    {
+        // Order vertices best to worst
+        int order[N + 1];
+
+        for (int i = 0; i <= N; i++) order[i] = i;
+
+        std::sort(order, order + N + 1, [&](int a, int b) { return f[a] < f[b]; });
+
+        auto best = order[0];
+        auto worst = order[N];
+        auto second = order[N - 1];
+
+        if (fabs(f[worst] - f[best]) < 1e-6) break;
+
+        double centroid[N] = { 0 };
+
+        for (int i = 0; i <= N; i++)
+            if (i != worst)
+                for (int j = 0; j < N; j++) centroid[j] += x[i][j] / N;
+
+        auto blend = [&](double t, double* out)
+        {
+            for (int j = 0; j < N; j++) out[j] = centroid[j] + t * (x[worst][j] - centroid[j]);
+            return cost(out);
+        };
+
+        double xr[N], xe[N], xc[N];
+        auto fr = blend(-1.0, xr);      // Reflection
+
+        if (fr < f[best])
+        {
+            auto fe = blend(-2.0, xe);  // Expansion
+
+            if (fe < fr) { memcpy(x[worst], xe, sizeof(xe)); f[worst] = fe; }
+            else         { memcpy(x[worst], xr, sizeof(xr)); f[worst] = fr; }
+        }
+        else if (fr < f[second])
+        {
+            memcpy(x[worst], xr, sizeof(xr));
+            f[worst] = fr;
+        }
+        else
+        {
+            auto fc = blend(0.5, xc);   // Contraction
+
+            if (fc < f[worst])
+            {
+                memcpy(x[worst], xc, sizeof(xc));
+                f[worst] = fc;
+            }
+            else                        // Shrink toward the best vertex
+            {
+                for (int i = 0; i <= N; i++)
+                {
+                    if (i == best) continue;
+                    for (int j = 0; j < N; j++) x[i][j] = x[best][j] + 0.5 * (x[i][j] - x[best][j]);
+                    f[i] = cost(x[i]);
+                }
+            }
+        }
+    }
+
+    auto best = std::min_element(f, f + N + 1) - f;
+    Candidate result;
+
+    result.gains = Constrain(x[best]);
+    Evaluate(result);
+
+    return result;
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t topCount = 10;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            plantGain = atof(argv[++i]);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            effortWeight = atof(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            cruiseSpeed = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            topCount = atoi(argv[++i]);
+        else if (!LoadLog(argv[i]))
+        {
+            fprintf(stderr, "Unable to read %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    size_t sampleCount = 0;
+
+    for (auto& segment : segments) sampleCount += segment.size();
+
+    if (sampleCount == 0)
+    {
+        fprintf(stderr, "Usage: PidTune [-b plantGain] [-e effortWeight] [-s speed] [-n top] logfile...\n");
+        return 1;
+    }
+
+    if (std::isnan(plantGain))
+    {
+        plantGain = EstimatePlantGain();
+
+        // A log with almost no correction activity can't identify the plant
+        if (plantGain <= 0)
+        {
+            plantGain = 0.1;
+            fprintf(stderr, "Plant gain could not be estimated from the log, using %.3f\n", plantGain);
+        }
+    }
+
+    printf("%zu samples in %zu segments, plant gain b=%.4f deg/s per trim unit, effort weight=%.3f\n\n",
+           sampleCount, segments.size(), plantGain, effortWeight);
+
+    // Coarse grid
+    std::vector<Candidate> grid;
+
+    for (double kp = 0; kp <= 40; kp += 2.5)
+        for (double ki = 0; ki <= 0.5; ki += 0.05)
+            for (double kd = 0; kd <= 20; kd += 5)
+                for (double alpha = 0; alpha <= 0.9; alpha += 0.15)
+                    grid.push_back({ { float(kp), float(ki), float(kd), float(alpha) }, 0, 0, 0 });
+
+    ParallelFor(grid.size(), [&](size_t i) { Evaluate(grid[i]); });
+
+    auto byCost = [](const Candidate& a, const Candidate& b) { return a.cost < b.cost; };
+
+    std::sort(grid.begin(), grid.end(), byCost);
+
+    // Refine the best grid points
+    auto refineCount = std::min(grid.size(), std::max(topCount, size_t(8)));
+    std::vector<Candidate> refined(refineCount);
+
+    ParallelFor(refineCount, [&](size_t i) { refined[i] = NelderMead(grid[i]); });
+
+    refined.insert(refined.end(), grid.begin(), grid.begin() + refineCount);
+    std::sort(refined.begin(), refined.end(), byCost);
+
+    // Baseline - the gains currently in TaskCorrectCourse.cpp
+    Candidate current = { { 20.0f, 2.0f * SAMPLE_INTERVAL, 0.0f, 0.8f }, 0, 0, 0 };
+
+    Evaluate(current);
+
+    printf("Rank      Cost  RMS err  RMS trim       Kp       Ki       Kd   alpha\n");
+    printf("----  --------  -------  --------  -------  -------  -------  ------\n");
+    printf(" cur  %8.3f  %7.3f  %8.2f  %7.3f  %7.4f  %7.3f  %6.3f\n",
+           current.cost, current.rmsError, current.rmsEffort,
+           current.gains.Kp, current.gains.Ki, current.gains.Kd, current.gains.alpha);
+
+    for (size_t i = 0; i < std::min(topCount, refined.size()); i++)
+    {
+        auto& c = refined[i];
+
+        printf("%4zu  %8.3f  %7.3f  %8.2f  %7.3f  %7.4f  %7.3f  %6.3f\n", i + 1,
+               c.cost, c.rmsError, c.rmsEffort, c.gains.Kp, c.gains.Ki, c.gains.Kd, c.gains.alpha);
+    }
+
+    // Print the best gains in the form used by TaskCorrectCourse.cpp
+    auto& best = refined.front().gains;
+
+    printf("\nconstexpr auto Kp = %.2f;\n", best.Kp);
+    printf("constexpr auto Ki = %5.2f * (SAMPLE_INTERVAL / 1000.0);\n", best.Ki / SAMPLE_INTERVAL);
+    printf("constexpr auto Kd = %5.2f / (SAMPLE_INTERVAL / 1000.0);\n", best.Kd * SAMPLE_INTERVAL);
+    printf("constexpr auto alpha = %.2f;\n", best.alpha);
+
+    return 0;
+}
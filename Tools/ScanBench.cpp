@@ -0,0 +1,580 @@
+/*******************************************************************************
+ ScanBench
+
+ Host-side benchmark of direction-selection algorithms on recorded scans.
+
+ The scans come from the ScanLog telemetry records (see ScanLog.h), decoded to
+ CSV by TelemetryDecode -c: every scan TaskScanSonar and StateScanForNewDirection
+ completed, with the direction the robot chose and the outcome (the time
+ until the next obstacle event). Logs in the older hand-captured format
+ (Analysis/ScanForNewDirectionPingData-01.txt) are read too, as scans with no
+ recorded choice or outcome. Both kinds can be mixed in the input.
+
+ Every scan is run through each algorithm in the table below. An algorithm
+ sees the scan as a function of angle (the nearest recorded ping), so any
+ of them can be run on scans from either source. The algorithms are:
+
+    areas    - StateMoving::DetermineNewDirection on 15 degree sectors (left
+               and right areas, then the longest ping)
+    window   - the 5 degree sweep averaged in blocks of 3, as
+               StateScanForNewDirection's UpdateBestAngle did before the
+               ScanPlanner
+    planner  - ScanPlanner, as StateScanForNewDirection uses now
+    gap      - the middle of the widest opening (an example of a new one)
+
+ Each one returns an angle or NO_CHOICE (turn around). For each algorithm
+ these are reported:
+
+    agree    - how often it makes the same choice as the robot did (both turn
+               around, or within AGREE_ANGLE of each other)
+    turn     - mean size of the turn, and how often it turns around
+    clear    - predicted clearance: the shortest ping within BODY_HALF of the
+               chosen direction, averaged; and how often that is inside
+               THRESHOLD2 (straight into an obstacle)
+    outcome  - mean time to the next obstacle event after the robot's own
+               choice, for the scans where the algorithm agreed with it and
+               where it didn't (only scans with an obstacle outcome count)
+
+ followed by how often each pair of algorithms agree with each other.
+
+ To add an algorithm, write a function taking a Scan and returning an angle
+ (or NO_CHOICE), and add it to ALGORITHMS.
+
+ Build:
+    g++ -O2 -std=c++11 -I.. -o ScanBench ScanBench.cpp
+
+ Usage:
+    TelemetryDecode -c capture.bin | ScanBench
+    ScanBench [-s source] log.csv ...
+ ******************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ScanPlanner.h"
+#include "Telemetry.h"
+
+using namespace Telemetry;
+
+
+// Robot (Sonar.h, TaskScanSonar.h)
+const int THRESHOLD2 = 75;
+const int THRESHOLD3 = 100;
+const int SCAN_RANGE = 250;
+const int MAX_ANGLE = 90;
+const int SECTOR_STEP = 15;
+
+// Benchmark
+const int SOURCE_LEGACY = 0;                // Hand-captured log, no choice recorded
+const int AGREE_ANGLE = 15;                 // Choices this close count as the same
+const int BODY_HALF = 10;                   // Half the angle the robot's width takes up at the clearance
+
+
+struct Point
+{
+    int angle;
+    int range;
+    int time;           // ms from the scan start
+};
+
+
+struct Scan
+{
+    int number;
+    int source;
+    unsigned long start;
+    int chosen = NO_CHOICE;
+    bool hasChoice = false;
+    std::vector<Point> points;
+    int received = 0;
+    int outcome = -1;                       // ScanOutcome, -1 if none recorded
+    unsigned long elapsed = 0;
+};
+
+
+//******************************************************************************
+// Reading the scans
+//******************************************************************************
+
+// Splits a line at a separator
+static std::vector<std::string> Split(const char* line, char separator)
+{
+    std::vector<std::string> fields;
+    std::string field;
+
+    for (auto p = line; *p != 0 && *p != '\n' && *p != '\r'; p++)
+    {
+        if (*p == separator)
+        {
+            fields.push_back(field);
+            field.clear();
+        }
+        else
+        {
+            field += *p;
+        }
+    }
+
+    fields.push_back(field);
+
+    return fields;
+}
+
+
+static void ReadScans(FILE* file, std::vector<Scan>& scans)
+{
+    char line[2048];
+    std::vector<Scan*> open;                // Telemetry scans still receiving records
+    int lastDir = 0;
+    bool inLegacy = false;
+
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        if (strncmp(line, "Scan,", 5) == 0)
+        {
+            // Scan,timestamp,scan,source,start,chosen,first,total, then angle,range,time...
+            auto f = Split(line, ',');
+
+            if (f.size() < 8) continue;
+
+            auto number = atoi(f[2].c_str());
+            auto start = strtoul(f[4].c_str(), nullptr, 10);
+            auto first = atoi(f[6].c_str());
+            auto total = atoi(f[7].c_str());
+            Scan* scan = nullptr;
+
+            for (auto s : open) if (s->number == number && s->start == start) scan = s;
+
+            if (scan == nullptr)
+            {
+                scans.push_back(Scan());
+                scan = &scans.back();
+                scan->number = number;
+                scan->source = atoi(f[3].c_str());
+                scan->start = start;
+                scan->chosen = atoi(f[5].c_str());
+                scan->hasChoice = true;
+                scan->points.resize(total);
+                open.clear();               // Pointers into scans are no longer valid
+                open.push_back(scan);
+            }
+
+            for (size_t i = 8; i + 2 < f.size() && first < total; i += 3, first++)
+            {
+                scan->points[first] = { atoi(f[i].c_str()), atoi(f[i + 1].c_str()), atoi(f[i + 2].c_str()) };
+                scan->received++;
+            }
+
+            inLegacy = false;
+        }
+        else if (strncmp(line, "ScanOutcome,", 12) == 0)
+        {
+            // ScanOutcome,timestamp,scan,outcome,elapsed - for the latest scan with that number
+            auto f = Split(line, ',');
+
+            if (f.size() < 5) continue;
+
+            auto number = atoi(f[2].c_str());
+
+            for (auto i = scans.rbegin(); i != scans.rend(); ++i)
+            {
+                if (i->source == SOURCE_LEGACY || i->number != number) continue;
+
+                i->outcome = atoi(f[3].c_str());
+                i->elapsed = strtoul(f[4].c_str(), nullptr, 10);
+                break;
+            }
+        }
+        else
+        {
+            // Old StateScanForNewDirection::Poll trace: Time, State, Method, Dir, ScanAngle, Ping, ...
+            // A new sweep starts when Dir changes.
+            auto f = Split(line, '\t');
+
+            if (f.size() < 6 || f[2].find("Poll") == std::string::npos) continue;
+
+            auto dir = atoi(f[3].c_str());
+            auto time = strtoul(f[0].c_str(), nullptr, 10);
+
+            if (!inLegacy || dir != lastDir)
+            {
+                scans.push_back(Scan());
+                scans.back().number = int(scans.size());
+                scans.back().source = SOURCE_LEGACY;
+                scans.back().start = time;
+                open.clear();
+            }
+
+            auto& scan = scans.back();
+
+            scan.points.push_back({ atoi(f[4].c_str()), std::min(atoi(f[5].c_str()), SCAN_RANGE), int(time - scan.start) });
+            scan.received++;
+            lastDir = dir;
+            inLegacy = true;
+        }
+    }
+}
+
+
+//******************************************************************************
+// A scan as a function of angle
+//******************************************************************************
+
+// The ping nearest an angle
+static int RangeAt(const Scan& scan, int angle)
+{
+    int best = 0, bestDistance = 1000;
+
+    for (auto& p : scan.points)
+    {
+        auto distance = abs(p.angle - angle);
+
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            best = p.range;
+        }
+    }
+
+    return best;
+}
+
+
+// Predicted clearance in a direction: the shortest ping across the robot's width
+static int Clearance(const Scan& scan, int angle)
+{
+    auto clearance = RangeAt(scan, angle);
+    auto found = false;
+
+    for (auto& p : scan.points)
+    {
+        if (abs(p.angle - angle) > BODY_HALF) continue;
+
+        clearance = found ? std::min(clearance, p.range) : p.range;
+        found = true;
+    }
+
+    return clearance;
+}
+
+
+//******************************************************************************
+// Direction-selection algorithms
+//******************************************************************************
+
+// StateMoving::DetermineNewDirection, on TaskScanSonar's 15 degree sectors
+static int Areas(const Scan& scan)
+{
+    int leftArea = 0, rightArea = 0, leftPing = 0, rightPing = 0, leftAngle = 90, rightAngle = -90;
+
+    for (int angle = MAX_ANGLE; angle >= -MAX_ANGLE; angle -= SECTOR_STEP)
+    {
+        auto ping = RangeAt(scan, angle);
+
+        if (angle > 0)
+        {
+            leftArea += ping;
+
+            if (ping > leftPing || (ping == leftPing && angle < leftAngle))
+            {
+                leftPing = ping;
+                leftAngle = angle;
+            }
+        }
+        else if (angle < 0)
+        {
+            rightArea += ping;
+
+            if (ping > rightPing || (ping == rightPing && angle > rightAngle))
+            {
+                rightPing = ping;
+                rightAngle = angle;
+            }
+        }
+    }
+
+    auto diff = leftArea - rightArea;
+    auto ratio = float(diff) / std::max(std::max(leftArea, rightArea), 1);
+
+    if (fabs(ratio) > 0.1) return diff > 0 ? leftAngle : rightAngle;
+
+    if (leftPing > rightPing && leftPing >= 100) return leftAngle;
+
+    if (rightPing > leftPing && rightPing >= 100) return rightAngle;
+
+    return NO_CHOICE;
+}
+
+
+// StateScanForNewDirection before ScanPlanner: 5 degree steps, averaged in blocks of 3
+static int Window(const Scan& scan)
+{
+    const int STEP = 5, COUNT = 3;
+    int sum = 0, count = 0, bestPing = 0, bestAngle = 0;
+
+    for (int angle = -MAX_ANGLE; angle <= MAX_ANGLE; angle += STEP)
+    {
+        sum += RangeAt(scan, angle);
+
+        if (++count >= COUNT || angle + STEP > MAX_ANGLE)
+        {
+            if (count > 1 && sum / count > bestPing)
+            {
+                bestPing = sum / count;
+                bestAngle = angle + STEP - (STEP * count / 2);
+            }
+
+            sum = count = 0;
+        }
+    }
+
+    return bestPing < THRESHOLD3 ? NO_CHOICE : bestAngle;
+}
+
+
+// StateScanForNewDirection with ScanPlanner
+static int Planner(const Scan& scan)
+{
+    static ScanPlanner planner;
+    int16_t angle;
+
+    planner.Begin();
+
+    while (planner.Next(angle)) planner.Record(uint16_t(RangeAt(scan, angle)));
+
+    return planner.BestPing() < THRESHOLD3 ? NO_CHOICE : planner.BestAngle();
+}
+
+
+// Middle of the widest run of 5 degree directions that are all open past THRESHOLD3
+static int Gap(const Scan& scan)
+{
+    const int STEP = 5, MIN_WIDTH = 15;
+    int bestStart = 0, bestWidth = 0, runStart = 0;
+    bool inRun = false;
+
+    for (int angle = -MAX_ANGLE; angle <= MAX_ANGLE + STEP; angle += STEP)
+    {
+        auto open = angle <= MAX_ANGLE && RangeAt(scan, angle) >= THRESHOLD3;
+
+        if (open && !inRun) runStart = angle;
+
+        if (!open && inRun && angle - runStart > bestWidth)
+        {
+            bestWidth = angle - runStart;
+            bestStart = runStart;
+        }
+
+        inRun = open;
+    }
+
+    if (bestWidth < MIN_WIDTH) return NO_CHOICE;
+
+    // Prefer the least turn within a very wide opening
+    auto middle = bestStart + (bestWidth - STEP) / 2;
+    auto nearest = std::max(bestStart + MIN_WIDTH / 2, std::min(bestStart + bestWidth - STEP - MIN_WIDTH / 2, 0));
+
+    return bestWidth >= 60 ? nearest : middle;
+}
+
+
+struct Algorithm
+{
+    const char* name;
+    int (*choose)(const Scan& scan);
+};
+
+const Algorithm ALGORITHMS[] =
+{
+    { "areas",   Areas },
+    { "window",  Window },
+    { "planner", Planner },
+    { "gap",     Gap },
+};
+
+const int ALGORITHM_COUNT = sizeof(ALGORITHMS) / sizeof(ALGORITHMS[0]);
+
+
+//******************************************************************************
+// Report
+//******************************************************************************
+static bool Agree(int a, int b)
+{
+    if (a == NO_CHOICE || b == NO_CHOICE) return a == b;
+
+    return abs(a - b) <= AGREE_ANGLE;
+}
+
+
+struct Totals
+{
+    int scans = 0, compared = 0, agreed = 0, turns = 0, reversals = 0, blocked = 0;
+    double turn = 0, clearance = 0;
+    int agreeOutcomes = 0, differOutcomes = 0;
+    double agreeTime = 0, differTime = 0;
+
+    void Add(const Scan& scan, int choice, bool isRecorded)
+    {
+        scans++;
+
+        if (choice == NO_CHOICE)
+        {
+            reversals++;
+        }
+        else
+        {
+            auto clear = Clearance(scan, choice);
+
+            turns++;
+            turn += abs(choice);
+            clearance += clear;
+            blocked += clear < THRESHOLD2;
+        }
+
+        if (isRecorded || !scan.hasChoice) return;
+
+        auto agree = Agree(choice, scan.chosen);
+
+        compared++;
+        agreed += agree;
+
+        // Only an obstacle ends an outcome; a following scan just cuts it short
+        if (scan.outcome <= OUTCOME_NEXT_SCAN) return;
+
+        if (agree)
+        {
+            agreeOutcomes++;
+            agreeTime += scan.elapsed / 1000.0;
+        }
+        else
+        {
+            differOutcomes++;
+            differTime += scan.elapsed / 1000.0;
+        }
+    }
+
+    void Print(const char* name, bool isRecorded)
+    {
+        char agree[16], agreeOutcome[16], differOutcome[16];
+
+        if (isRecorded || compared == 0) strcpy(agree, "-");
+        else sprintf(agree, "%.1f%%", 100.0 * agreed / compared);
+
+        if (agreeOutcomes == 0) strcpy(agreeOutcome, "-");
+        else sprintf(agreeOutcome, "%.1fs/%d", agreeTime / agreeOutcomes, agreeOutcomes);
+
+        if (differOutcomes == 0) strcpy(differOutcome, "-");
+        else sprintf(differOutcome, "%.1fs/%d", differTime / differOutcomes, differOutcomes);
+
+        printf("%-9s %7s %7.1fd %7.1f%% %8.0fcm %7.1f%% %11s %11s\n", name, agree,
+               turns > 0 ? turn / turns : 0, scans > 0 ? 100.0 * reversals / scans : 0,
+               turns > 0 ? clearance / turns : 0, turns > 0 ? 100.0 * blocked / turns : 0,
+               agreeOutcome, differOutcome);
+    }
+};
+
+
+int main(int argc, char* argv[])
+{
+    std::vector<Scan> scans;
+    int source = -1;
+    bool haveInput = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            source = atoi(argv[++i]);
+            continue;
+        }
+
+        auto file = fopen(argv[i], "r");
+
+        if (file == nullptr)
+        {
+            fprintf(stderr, "ScanBench: can't open %s\n", argv[i]);
+            fprintf(stderr, "Usage: ScanBench [-s source] [log ...]\n");
+            return 1;
+        }
+
+        ReadScans(file, scans);
+        fclose(file);
+        haveInput = true;
+    }
+
+    if (!haveInput) ReadScans(stdin, scans);
+
+    // Only complete scans (every record received), from the chosen source
+    std::vector<Scan> complete;
+    int bySource[3] = { 0, 0, 0 }, outcomes = 0;
+
+    for (auto& scan : scans)
+    {
+        if (scan.points.empty() || scan.received != int(scan.points.size())) continue;
+
+        if (source >= 0 && scan.source != source) continue;
+
+        complete.push_back(scan);
+        bySource[std::min(std::max(scan.source, 0), 2)]++;
+        outcomes += scan.outcome > OUTCOME_NEXT_SCAN;
+    }
+
+    printf("%zu scans (%d TaskScanSonar, %d StateScanForNewDirection, %d hand-captured), %d ended by an obstacle\n\n",
+           complete.size(), bySource[SCAN_SONAR_TASK], bySource[SCAN_PLANNER], bySource[SOURCE_LEGACY], outcomes);
+
+    if (complete.empty()) return 0;
+
+    printf("%-9s %7s %8s %8s %10s %8s %11s %11s\n",
+           "", "agree", "turn", "reverse", "clearance", "blocked", "agreed:obst", "differ:obst");
+
+    Totals recorded;
+    Totals totals[ALGORITHM_COUNT];
+    std::vector<std::vector<int>> choices(complete.size(), std::vector<int>(ALGORITHM_COUNT));
+
+    for (size_t s = 0; s < complete.size(); s++)
+    {
+        auto& scan = complete[s];
+
+        if (scan.hasChoice) recorded.Add(scan, scan.chosen, true);
+
+        for (int a = 0; a < ALGORITHM_COUNT; a++)
+        {
+            choices[s][a] = ALGORITHMS[a].choose(scan);
+            totals[a].Add(scan, choices[s][a], false);
+        }
+    }
+
+    if (recorded.scans > 0) recorded.Print("recorded", true);
+
+    for (int a = 0; a < ALGORITHM_COUNT; a++) totals[a].Print(ALGORITHMS[a].name, false);
+
+    // Pairwise agreement
+    printf("\n%-9s", "agreement");
+
+    for (auto& algorithm : ALGORITHMS) printf(" %8s", algorithm.name);
+
+    printf("\n");
+
+    for (int a = 0; a < ALGORITHM_COUNT; a++)
+    {
+        printf("%-9s", ALGORITHMS[a].name);
+
+        for (int b = 0; b < ALGORITHM_COUNT; b++)
+        {
+            int agreed = 0;
+
+            for (auto& c : choices) agreed += Agree(c[a], c[b]);
+
+            printf(" %7.1f%%", 100.0 * agreed / complete.size());
+        }
+
+        printf("\n");
+    }
+
+    return 0;
+}
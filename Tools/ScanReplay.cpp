@@ -0,0 +1,239 @@
+/*******************************************************************************
+ ScanReplay
+
+ Host-side check of the coarse-to-fine scan planner (ScanPlanner.h) against
+ logged full-resolution scans such as Analysis/ScanForNewDirectionPingData-01.txt.
+
+ The log is the tab separated TRACE output of StateScanForNewDirection::Poll
+ (Time, State, Method, Dir, ScanAngle, Ping, ...) for sweeps at 1 degree
+ steps. Each sweep is split out (a new sweep starts when Dir changes) and
+ replayed three ways, each ping taken from the log at the requested angle:
+
+    full     - the best 15 degree window (the width of 3 x 5 degree pings)
+               at 1 degree resolution. This is the reference answer.
+    sweep    - the old StateScanForNewDirection scan: 5 degree steps from
+               -90 to 90, averaged in blocks of 3.
+    planner  - ScanPlanner, with its direction alternating between sweeps.
+
+ For sweep and planner the number of pings, the best angle and its error from
+ the reference, and the reference's average at that angle (how open the
+ chosen direction really is) are printed.
+
+ Build:
+    g++ -O2 -std=c++11 -I.. -o ScanReplay ScanReplay.cpp
+
+ Usage:
+    ScanReplay [log.txt]
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "ScanPlanner.h"
+
+
+const int MAX_ANGLE = 90;
+const int SWEEP_STEP = 5;
+const int WINDOW_COUNT = 3;
+const int WINDOW_HALF = SWEEP_STEP * WINDOW_COUNT / 2;      // 7 degrees either side
+
+
+typedef std::map<int, int> Scan;        // angle -> ping
+
+
+//******************************************************************************
+// Reads the sweeps from a log. Lines that don't parse (headers) are skipped.
+//******************************************************************************
+static std::vector<Scan> ReadScans(FILE* file)
+{
+    std::vector<Scan> scans;
+    char line[1024];
+    int lastDir = 0;
+
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        char* fields[6];
+        int count = 0;
+
+        for (char* p = line; count < 6 && p != nullptr; count++)
+        {
+            fields[count] = p;
+            p = strchr(p, '\t');
+
+            if (p != nullptr) *p++ = 0;
+        }
+
+        if (count < 6 || strstr(fields[2], "Poll") == nullptr) continue;
+
+        char* end;
+        auto dir = int(strtol(fields[3], &end, 10));
+        auto angle = int(strtol(fields[4], &end, 10));
+        auto ping = int(strtol(fields[5], &end, 10));
+
+        if (dir != lastDir || scans.empty()) scans.push_back(Scan());
+
+        scans.back()[angle] = ping;
+        lastDir = dir;
+    }
+
+    return scans;
+}
+
+
+// Ping at an angle - the nearest logged one
+static int PingAt(const Scan& scan, int angle)
+{
+    auto i = scan.lower_bound(angle);
+
+    if (i == scan.end()) return (--i)->second;
+
+    if (i != scan.begin() && i->first != angle)
+    {
+        auto j = i;
+
+        if (angle - (--j)->first < i->first - angle) return j->second;
+    }
+
+    return i->second;
+}
+
+
+// Average of the logged pings within a window centered on an angle
+static double WindowAverage(const Scan& scan, int center)
+{
+    double sum = 0;
+    int count = 0;
+
+    for (auto i = scan.lower_bound(center - WINDOW_HALF); i != scan.end() && i->first <= center + WINDOW_HALF; ++i)
+    {
+        sum += i->second;
+        count++;
+    }
+
+    return count > 0 ? sum / count : 0;
+}
+
+
+struct Result
+{
+    int pings;
+    int angle;
+    int ping;
+};
+
+
+static Result Full(const Scan& scan)
+{
+    Result result = { int(scan.size()), 0, 0 };
+    double best = -1;
+
+    for (int angle = -MAX_ANGLE + WINDOW_HALF; angle <= MAX_ANGLE - WINDOW_HALF; angle++)
+    {
+        auto average = WindowAverage(scan, angle);
+
+        if (average > best)
+        {
+            best = average;
+            result.angle = angle;
+        }
+    }
+
+    result.ping = int(best);
+
+    return result;
+}
+
+
+// StateScanForNewDirection before the planner (window arithmetic as it was)
+static Result Sweep(const Scan& scan)
+{
+    Result result = { 0, 0, 0 };
+    int sum = 0, count = 0;
+
+    for (int angle = -MAX_ANGLE; angle <= MAX_ANGLE; angle += SWEEP_STEP)
+    {
+        sum += PingAt(scan, angle);
+        result.pings++;
+
+        if (++count >= WINDOW_COUNT || angle + SWEEP_STEP > MAX_ANGLE)
+        {
+            if (count > 1 && sum / count > result.ping)
+            {
+                result.ping = sum / count;
+                result.angle = angle + SWEEP_STEP - (SWEEP_STEP * count / 2);
+            }
+
+            sum = count = 0;
+        }
+    }
+
+    return result;
+}
+
+
+static Result Plan(ScanPlanner& planner, const Scan& scan)
+{
+    int16_t angle;
+
+    planner.Begin();
+
+    while (planner.Next(angle)) planner.Record(uint16_t(PingAt(scan, angle)));
+
+    Result result = { planner.Pings(), planner.BestAngle(), planner.BestPing() };
+
+    return result;
+}
+
+
+int main(int argc, char* argv[])
+{
+    auto file = argc > 1 ? fopen(argv[1], "r") : stdin;
+
+    if (file == nullptr)
+    {
+        fprintf(stderr, "ScanReplay: can't open %s\n", argv[1]);
+        fprintf(stderr, "Usage: ScanReplay [log.txt]\n");
+        return 1;
+    }
+
+    auto scans = ReadScans(file);
+    ScanPlanner planner;
+    int sweepPings = 0, planPings = 0, sweepError = 0, planError = 0;
+
+    printf("%4s  %-14s  %-22s  %-22s\n", "", "full", "sweep", "planner");
+    printf("%4s  %5s %8s  %5s %5s %5s %5s  %5s %5s %5s %5s\n",
+           "scan", "angle", "open", "pings", "angle", "error", "open", "pings", "angle", "error", "open");
+
+    for (size_t i = 0; i < scans.size(); i++)
+    {
+        auto& scan = scans[i];
+
+        if (scan.size() < 2) continue;
+
+        auto full = Full(scan);
+        auto sweep = Sweep(scan);
+        auto plan = Plan(planner, scan);
+
+        printf("%4zu  %5d %8d  %5d %5d %5d %5d  %5d %5d %5d %5d\n", i + 1,
+               full.angle, full.ping,
+               sweep.pings, sweep.angle, abs(sweep.angle - full.angle), int(WindowAverage(scan, sweep.angle)),
+               plan.pings, plan.angle, abs(plan.angle - full.angle), int(WindowAverage(scan, plan.angle)));
+
+        sweepPings += sweep.pings;
+        planPings += plan.pings;
+        sweepError += abs(sweep.angle - full.angle);
+        planError += abs(plan.angle - full.angle);
+    }
+
+    if (!scans.empty())
+    {
+        printf("\ntotal pings: sweep=%d, planner=%d (%.0f%%)\n", sweepPings, planPings, 100.0 * planPings / sweepPings);
+        printf("mean error:  sweep=%.1f, planner=%.1f degrees\n",
+               double(sweepError) / scans.size(), double(planError) / scans.size());
+    }
+
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*******************************************************************************
+ ServoCalSim
+
+ Host-side simulation of Sonar::CalibrateServo's slew measurement, comparing
+ the two ways of timing the pan servo:
+
+    wall    - the old method: the sonar swings back to a flat wall straight
+              ahead and counts as arrived once two pings in a row match the
+              straight-ahead range
+    edge    - the current method: the sonar swings right through a narrow
+              target straight ahead, and the middle of the times the target
+              was in the beam is when the sonar pointed at it
+
+ The servo starts moving after a lag, then slews at a constant rate. The
+ sonar sees anything within half its beam width (7.5 degrees) of where it
+ points, and takes a ping every 12ms or so. A line is fitted to the times as
+ CalibrateServo does, giving a servo model (rate and settle/lag) for each
+ method. Each model is then used for a full TaskScanSonar sweep (swing to one
+ end, then 12 steps of 15 degrees): the printed scan wait is the servo time
+ the model allows for the sweep, and "short" is how far from its target the
+ real servo still is when the model's wait for a 15 degree step runs out.
+
+ The results are averaged over a number of runs with different servos (rate
+ 2-4 ms/degree, lag 10-40ms) and ping timing.
+
+ Build:
+    g++ -O2 -std=c++11 -o ServoCalSim ServoCalSim.cpp
+
+ Usage:
+    ServoCalSim [runs]
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <random>
+
+
+// Robot (Sonar.cpp)
+const double DEFAULT_RATE = 2.0;            // Default model, ms/degree
+const double DEFAULT_SETTLE = 0;            // Default model, ms
+const int SWINGS[] = { 20, 45, 90 };
+const int REPEATS = 2;
+const double WALL_TOLERANCE = 1;            // cm (the wall method's "arrived")
+const double EDGE_TOLERANCE = 2;            // cm (the edge method's "target seen")
+const double SLEW_TIMEOUT = 1500;           // ms
+
+// Simulated servo, sonar and target
+const double BEAM_HALF_ANGLE = 7.5;         // degrees
+const double PING_TIME = 12;                // ms between pings (echo plus quiet time)
+const double PING_JITTER = 2;               // ms
+const double RANGE_NOISE = 0.3;             // cm RMS
+const double TARGET_RANGE = 50;             // cm
+const double POST_RADIUS = 1.5;             // cm (a broom handle)
+
+
+struct Servo
+{
+    double rate;        // ms/degree
+    double lag;         // ms before it starts moving
+
+    // Angle at time t (ms) into a move from a to b
+    double Angle(double a, double b, double t) const
+    {
+        auto moving = std::max(0.0, t - lag) / rate;
+
+        return fabs(b - a) <= moving ? b : a + (b > a ? moving : -moving);
+    }
+};
+
+
+// Range (cm) the sonar reports pointing at angle (deg), 0 = no echo
+static double Range(bool wall, double angle, std::mt19937& random)
+{
+    std::normal_distribution<double> noise(0, RANGE_NOISE);
+
+    if (wall)
+    {
+        // Nearest point of the wall inside the beam
+        auto off = std::max(0.0, fabs(angle) - BEAM_HALF_ANGLE) * M_PI / 180;
+
+        return TARGET_RANGE / cos(off) + noise(random);
+    }
+
+    auto halfWidth = BEAM_HALF_ANGLE + asin(POST_RADIUS / TARGET_RANGE) * 180 / M_PI;
+
+    return fabs(angle) <= halfWidth ? TARGET_RANGE - POST_RADIUS + noise(random) : 0;
+}
+
+
+struct Model { double rate, settle; };
+
+// StepWait() in ms
+static double StepWait(const Model& model, double degrees) { return degrees * model.rate + model.settle; }
+
+static double ScanWait(const Model& model) { return StepWait(model, 90) + 12 * StepWait(model, 15); }
+
+
+//******************************************************************************
+// One calibration with either method
+//******************************************************************************
+static bool Calibrate(bool wall, const Servo& servo, std::mt19937& random, Model& model)
+{
+    std::uniform_real_distribution<double> jitter(-PING_JITTER, PING_JITTER);
+    auto reference = wall ? TARGET_RANGE : TARGET_RANGE - POST_RADIUS;
+    auto tolerance = wall ? WALL_TOLERANCE : EDGE_TOLERANCE;
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+    for (auto swing : SWINGS)
+    {
+        for (int i = 0; i < 2 * REPEATS; i++)
+        {
+            double start = (i & 1) ? swing : -swing;
+            double end = wall ? 0 : -start;
+            double time = -1;
+
+            if (fabs(Range(wall, start, random) - reference) <= 2 * tolerance) continue;
+
+            double arrived = -1, seen = -1;
+            int stable = 0;
+
+            for (auto t = PING_TIME * (0.5 + jitter(random) / PING_TIME); t < SLEW_TIMEOUT; t += PING_TIME + jitter(random))
+            {
+                auto range = Range(wall, servo.Angle(start, end, t), random);
+                auto isSeen = fabs(range - reference) <= tolerance;
+
+                if (wall)
+                {
+                    if (!isSeen) { stable = 0; continue; }
+
+                    if (stable++ == 0) arrived = t;
+
+                    if (stable >= 2) { time = arrived; break; }
+                }
+                else
+                {
+                    if (isSeen && seen < 0) seen = t;
+
+                    if (!isSeen && seen >= 0) { time = (seen + t) / 2; break; }
+                }
+            }
+
+            if (time < 0) continue;
+
+            n += 1;
+            sx += swing;
+            sy += time;
+            sxx += double(swing) * swing;
+            sxy += swing * time;
+        }
+    }
+
+    auto denominator = n * sxx - sx * sx;
+
+    if (n < 3 || denominator <= 0) return false;
+
+    model.rate = (n * sxy - sx * sy) / denominator;
+    model.settle = std::max(0.0, (sy - model.rate * sx) / n);
+
+    return true;
+}
+
+
+// Degrees the servo is still short of a 15 degree step when the model's wait runs out
+static double Short(const Model& model, const Servo& servo)
+{
+    return 15 - fabs(servo.Angle(0, 15, StepWait(model, 15)));
+}
+
+
+int main(int argc, char* argv[])
+{
+    auto runs = argc > 1 ? atoi(argv[1]) : 100;
+
+    if (runs < 1)
+    {
+        fprintf(stderr, "Usage: ServoCalSim [runs]\n");
+        return 1;
+    }
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const Model DEFAULT = { DEFAULT_RATE, DEFAULT_SETTLE };
+    double trueWait = 0, trueRate = 0, trueLag = 0;
+    double wait[2] = { 0, 0 }, rate[2] = { 0, 0 }, settle[2] = { 0, 0 }, shortBy[2] = { 0, 0 }, worst[2] = { 0, 0 };
+    int ok[2] = { 0, 0 };
+    double defaultShort = 0;
+
+    for (int r = 0; r < runs; r++)
+    {
+        Servo servo = { 2 + 2 * uniform(random), 10 + 30 * uniform(random) };
+        Model truth = { servo.rate, servo.lag };
+
+        trueWait += ScanWait(truth);
+        trueRate += servo.rate;
+        trueLag += servo.lag;
+        defaultShort += Short(DEFAULT, servo);
+
+        for (int m = 0; m < 2; m++)
+        {
+            Model model;
+
+            if (!Calibrate(m == 0, servo, random, model)) continue;
+
+            ok[m]++;
+            wait[m] += ScanWait(model);
+            rate[m] += model.rate;
+            settle[m] += model.settle;
+            shortBy[m] += Short(model, servo);
+            worst[m] = std::max(worst[m], Short(model, servo));
+        }
+    }
+
+    printf("%d servos, rate %.1f ms/deg and lag %.0f ms on average\n\n", runs, trueRate / runs, trueLag / runs);
+    printf("%-8s %9s %9s %10s %10s %10s\n", "model", "ms/deg", "settle", "scan wait", "short deg", "worst deg");
+    printf("%-8s %9.2f %9.1f %10.0f %10s %10s\n", "true", trueRate / runs, trueLag / runs, trueWait / runs, "-", "-");
+    printf("%-8s %9.2f %9.1f %10.0f %10.1f %10s\n", "default", DEFAULT.rate, DEFAULT.settle, ScanWait(DEFAULT), defaultShort / runs, "-");
+
+    for (int m = 0; m < 2; m++)
+    {
+        if (ok[m] == 0)
+        {
+            printf("%-8s (no calibration succeeded)\n", m == 0 ? "wall" : "edge");
+            continue;
+        }
+
+        printf("%-8s %9.2f %9.1f %10.0f %10.1f %10.1f   (%d/%d calibrated)\n", m == 0 ? "wall" : "edge",
+               rate[m] / ok[m], settle[m] / ok[m], wait[m] / ok[m], shortBy[m] / ok[m], worst[m], ok[m], runs);
+    }
+
+    return 0;
+}
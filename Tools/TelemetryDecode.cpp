@@ -0,0 +1,250 @@
+/*******************************************************************************
+ TelemetryDecode
+
+ Host-side decoder for the binary telemetry stream produced by Telemetry.cpp.
+ Reads a raw serial capture (from a file or stdin), extracts the COBS framed
+ records, verifies their checksums, and prints each record as the same text
+ line the equivalent TRACE statement used to produce, e.g.
+
+    11941: TaskCorrectCourse::CorrectCourse: dt=0.103, w0=0.000, wz=-0.620, ...
+
+ so that existing spreadsheets in the Analysis folder keep working. With the
+ -c option the records are instead printed as plain CSV rows, one column per
+ field, prefixed by the record name.
+
+ Anything on the serial line that is not a valid frame (e.g. text Logger
+ output) is ignored. Bad frames are counted and reported on stderr.
+
+ Build:
+    g++ -O2 -std=c++11 -o TelemetryDecode TelemetryDecode.cpp
+
+ Usage:
+    TelemetryDecode [-c] [capture.bin] > log.txt
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#include "../Telemetry.h"
+
+using namespace Telemetry;
+
+
+static bool csvOutput = false;
+static unsigned long goodFrames = 0;
+static unsigned long badFrames = 0;
+
+
+//******************************************************************************
+// Formats a fixed-point value with 3 decimal places (e.g. -1234 -> "-1.234")
+//******************************************************************************
+static const char* Fixed3(int32_t value, char* buffer)
+{
+    auto magnitude = (value < 0) ? -(long long)value : (long long)value;
+
+    sprintf(buffer, "%s%lld.%03lld", (value < 0) ? "-" : "", magnitude / SCALE, magnitude % SCALE);
+
+    return buffer;
+}
+
+
+//******************************************************************************
+// Decodes a COBS block. Returns the decoded length or -1 if malformed.
+//******************************************************************************
+static int CobsDecode(const uint8_t* in, size_t length, uint8_t* out)
+{
+    size_t i = 0;
+    size_t n = 0;
+
+    while (i < length)
+    {
+        uint8_t code = in[i++];
+
+        if (code == 0 || i + code - 1 > length) return -1;
+
+        for (uint8_t j = 1; j < code; j++) out[n++] = in[i++];
+
+        if (code < 0xFF && i < length) out[n++] = 0;
+    }
+
+    return int(n);
+}
+
+
+template<typename T> static bool Extract(const uint8_t* data, int length, T& record)
+{
+    if (length != int(sizeof(T))) return false;
+
+    memcpy(&record, data, sizeof(T));
+
+    return true;
+}
+
+
+static bool PrintRecord(const uint8_t* data, int length)
+{
+    char b[8][24];
+
+    switch (data[0])
+    {
+        case REC_SPIN:
+        {
+            SpinRecord r;
+
+            if (!Extract(data, length, r)) return false;
+
+            if (csvOutput)
+                printf("Spin,%lu,%lu,%s,%s,%s\n", (unsigned long)r.Header.Timestamp, (unsigned long)r.dt,
+                       Fixed3(r.w0, b[0]), Fixed3(r.w1, b[1]), Fixed3(r.angle, b[2]));
+            else
+                printf("%lu: TaskSpin::Poll: %lu.%06lu,%s,%s,%s\n", (unsigned long)r.Header.Timestamp,
+                       (unsigned long)r.dt / 1000000, (unsigned long)r.dt % 1000000,
+                       Fixed3(r.w0, b[0]), Fixed3(r.w1, b[1]), Fixed3(r.angle, b[2]));
+            return true;
+        }
+
+        case REC_CORRECT_COURSE:
+        {
+            CorrectCourseRecord r;
+
+            if (!Extract(data, length, r)) return false;
+
+            if (csvOutput)
+                printf("CorrectCourse,%lu,%s,%s,%s,%s,%s,%s,%s,%s,%d\n", (unsigned long)r.Header.Timestamp,
+                       Fixed3(r.dt, b[0]), Fixed3(r.w0, b[1]), Fixed3(r.wz, b[2]), Fixed3(r.w1, b[3]),
+                       Fixed3(r.h0, b[4]), Fixed3(r.h1, b[5]), Fixed3(r.e1, b[6]), Fixed3(r.ei, b[7]),
+                       r.correction);
+            else
+                printf("%lu: TaskCorrectCourse::CorrectCourse: dt=%s, w0=%s, wz=%s, w1=%s, h0=%s, h1=%s, e1=%s, ei=%s, correction=%d\n",
+                       (unsigned long)r.Header.Timestamp,
+                       Fixed3(r.dt, b[0]), Fixed3(r.w0, b[1]), Fixed3(r.wz, b[2]), Fixed3(r.w1, b[3]),
+                       Fixed3(r.h0, b[4]), Fixed3(r.h1, b[5]), Fixed3(r.e1, b[6]), Fixed3(r.ei, b[7]),
+                       r.correction);
+            return true;
+        }
+
+        case REC_SCAN_PING:
+        {
+            ScanPingRecord r;
+
+            if (!Extract(data, length, r)) return false;
+
+            printf(csvOutput ? "ScanPing,%lu,%d,%u,%u,%d\n" : "%lu: StateScanForNewDirection: %d,%u,%u,%d\n",
+                   (unsigned long)r.Header.Timestamp, r.scanAngle, r.ping, r.bestPing, r.bestAngle);
+            return true;
+        }
+
+        case REC_SCAN:
+        {
+            ScanRecord r;
+
+            if (!Extract(data, length, r) || r.first >= r.total) return false;
+
+            auto count = std::min(int(r.total - r.first), int(POINTS_PER_RECORD));
+
+            // CSV: Scan,timestamp,scan,source,start,chosen,first,total, then angle,range,time for each point
+            if (csvOutput)
+                printf("Scan,%lu,%u,%u,%lu,%d,%u,%u", (unsigned long)r.Header.Timestamp, r.scan, r.source,
+                       (unsigned long)r.start, r.chosenAngle, r.first, r.total);
+            else
+                printf("%lu: ScanLog::Scan: scan=%u, source=%u, start=%lu, chosen=%d, first=%u, total=%u, points=",
+                       (unsigned long)r.Header.Timestamp, r.scan, r.source, (unsigned long)r.start,
+                       r.chosenAngle, r.first, r.total);
+
+            for (int i = 0; i < count; i++)
+            {
+                auto& p = r.points[i];
+
+                printf(csvOutput ? ",%d,%u,%d" : " %d:%u:%d", p.angle, p.range, p.time * SCAN_TIME_UNIT);
+            }
+
+            printf("\n");
+            return true;
+        }
+
+        case REC_SCAN_OUTCOME:
+        {
+            ScanOutcomeRecord r;
+
+            if (!Extract(data, length, r)) return false;
+
+            printf(csvOutput ? "ScanOutcome,%lu,%u,%u,%lu\n" : "%lu: ScanLog::Outcome: scan=%u, outcome=%u, elapsed=%lu\n",
+                   (unsigned long)r.Header.Timestamp, r.scan, r.outcome, (unsigned long)r.elapsed);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+
+static void ProcessFrame(const std::vector<uint8_t>& frame)
+{
+    if (frame.empty()) return;      // Back-to-back delimiters
+
+    uint8_t data[MAX_FRAME_SIZE];
+
+    if (frame.size() > sizeof(data))
+    {
+        badFrames++;
+        return;
+    }
+
+    auto length = CobsDecode(frame.data(), frame.size(), data);
+    uint8_t sum = 0;
+
+    for (int i = 0; i < length; i++) sum += data[i];
+
+    // Must have at least a header and checksum, and the checksum must balance
+    if (length < int(sizeof(RecordHeader)) + 1 || sum != 0 || !PrintRecord(data, length - 1))
+    {
+        badFrames++;
+        return;
+    }
+
+    goodFrames++;
+}
+
+
+int main(int argc, char* argv[])
+{
+    FILE* input = stdin;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0)
+        {
+            csvOutput = true;
+        }
+        else if ((input = fopen(argv[i], "rb")) == nullptr)
+        {
+            fprintf(stderr, "Unable to open %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> frame;
+    int c;
+
+    while ((c = fgetc(input)) != EOF)
+    {
+        if (c == 0)
+        {
+            ProcessFrame(frame);
+            frame.clear();
+        }
+        else
+        {
+            frame.push_back(uint8_t(c));
+        }
+    }
+
+    fprintf(stderr, "%lu records decoded, %lu invalid frames skipped\n", goodFrames, badFrames);
+
+    return 0;
+}